@@ -0,0 +1,229 @@
+/*
+ *  nds.h
+ *
+ *  A thin stand-in for libnds, just big enough to build the game logic on
+ *  the host computer. Only the types, constants and functions the
+ *  simulation code touches are here. Video memory and OAM are plain arrays
+ *  and DMA is a memcpy(), so nothing here says anything about how fast the
+ *  real hardware is; it is for catching regressions, not for predicting
+ *  frame times.
+ *
+ */
+
+#ifndef HOST_NDS_H
+#define HOST_NDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef volatile u8 vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+
+#define BIT(n) (1u << (n))
+
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 192
+
+#define SPRITE_COUNT 128
+#define MATRIX_COUNT 32
+
+#define KEY_A BIT(0)
+#define KEY_B BIT(1)
+#define KEY_SELECT BIT(2)
+#define KEY_START BIT(3)
+#define KEY_RIGHT BIT(4)
+#define KEY_LEFT BIT(5)
+#define KEY_UP BIT(6)
+#define KEY_DOWN BIT(7)
+#define KEY_R BIT(8)
+#define KEY_L BIT(9)
+#define KEY_X BIT(10)
+#define KEY_Y BIT(11)
+#define KEY_TOUCH BIT(12)
+
+#define ATTR0_DISABLED (2 << 8)
+
+/* The sprite attribute layouts, as libnds defines them. */
+typedef union SpriteEntry {
+    struct {
+        struct {
+            u16 y : 8;
+            u16 isRotateScale : 1;
+            u16 isSizeDouble : 1;
+            u16 blendMode : 2;
+            u16 isMosaic : 1;
+            u16 colorMode : 1;
+            u16 shape : 2;
+        };
+        struct {
+            u16 x : 9;
+            u16 rotationIndex : 5;
+            u16 size : 2;
+        };
+        struct {
+            u16 gfxIndex : 10;
+            u16 priority : 2;
+            u16 palette : 4;
+        };
+        u16 attribute3;
+    };
+    struct {
+        struct {
+            u16 : 8;
+            u16 : 1;
+            u16 isHidden : 1;
+            u16 : 6;
+        };
+        struct {
+            u16 : 12;
+            u16 hFlip : 1;
+            u16 vFlip : 1;
+            u16 : 2;
+        };
+    };
+    struct {
+        u16 attribute[3];
+        u16 filler;
+    };
+} SpriteEntry;
+
+typedef struct SpriteRotation {
+    u16 filler1[3];
+    s16 hdx;
+    u16 filler2[3];
+    s16 hdy;
+    u16 filler3[3];
+    s16 vdx;
+    u16 filler4[3];
+    s16 vdy;
+} SpriteRotation;
+
+typedef union OAMTable {
+    SpriteEntry oamBuffer[SPRITE_COUNT];
+    SpriteRotation matrixBuffer[MATRIX_COUNT];
+} OAMTable;
+
+/* The host's pretend OAM, defined in nds_shim.cpp. */
+extern u16 hostOAM[SPRITE_COUNT * 4];
+#define OAM (hostOAM)
+
+/* The host's pretend VRAM bank control registers, A to I. */
+extern vu8 hostVramCR[9];
+#define VRAM_ENABLE BIT(7)
+#define VRAM_A_CR (hostVramCR[0])
+#define VRAM_B_CR (hostVramCR[1])
+#define VRAM_C_CR (hostVramCR[2])
+#define VRAM_D_CR (hostVramCR[3])
+#define VRAM_E_CR (hostVramCR[4])
+#define VRAM_F_CR (hostVramCR[5])
+#define VRAM_G_CR (hostVramCR[6])
+#define VRAM_H_CR (hostVramCR[7])
+#define VRAM_I_CR (hostVramCR[8])
+
+/*
+ *  The host's pretend display, interrupt and DMA registers. Nothing
+ *  happens on its own: a check plays the part of the hardware by calling
+ *  the VCount handler when REG_VCOUNT reaches the trigger line, and by
+ *  running HBlank DMA itself (see checkSpriteMultiplexer()).
+ */
+typedef void (*VoidFn)(void);
+extern vu32 hostDispcnt;
+extern vu16 hostVCount;
+extern int hostYTrigger;
+extern VoidFn hostVCountHandler;
+extern volatile uintptr_t hostDmaSrc[4];
+extern volatile uintptr_t hostDmaDest[4];
+extern vu32 hostDmaCr[4];
+
+#define REG_DISPCNT (hostDispcnt)
+#define REG_VCOUNT (hostVCount)
+#define DISPLAY_SPR_HBLANK BIT(23)
+
+#define IRQ_VCOUNT BIT(2)
+static inline void irqSet(u32 irq, VoidFn handler) {
+    if (irq & IRQ_VCOUNT) {
+        hostVCountHandler = handler;
+    }
+}
+static inline void irqEnable(u32) {}
+static inline void irqDisable(u32) {}
+static inline void SetYtrigger(int line) { hostYTrigger = line; }
+
+#define DMA_SRC(n) (hostDmaSrc[n])
+#define DMA_DEST(n) (hostDmaDest[n])
+#define DMA_CR(n) (hostDmaCr[n])
+#define DMA_ENABLE BIT(31)
+#define DMA_START_HBL BIT(29)
+#define DMA_32_BIT BIT(26)
+
+/* There is no cache to keep coherent on the host. */
+static inline void DC_FlushRange(const void *, u32) {}
+static inline void DC_InvalidateRange(const void *, u32) {}
+
+static inline void dmaCopyHalfWords(u8, const void * source, void * dest,
+                                    u32 size) {
+    memcpy(dest, source, size);
+}
+
+/* Copies on the host are done as soon as they start. */
+static inline bool dmaBusy(u8) { return false; }
+
+static inline void dmaCopyHalfWordsAsynch(u8, const void * source,
+                                          void * dest, u32 size) {
+    memcpy(dest, source, size);
+}
+
+static inline void dmaCopyWordsAsynch(u8, const void * source, void * dest,
+                                      u32 size) {
+    memcpy(dest, source, size);
+}
+
+static inline void dmaCopyWords(u8, const void * source, void * dest,
+                                u32 size) {
+    memcpy(dest, source, size);
+}
+
+/*
+ *  The hardware divider and square root units, done the slow way. The
+ *  results are the same as the hardware's.
+ */
+static inline s32 divf32(s32 num, s32 den) {
+    return (s32)(((s64)num << 12) / den);
+}
+
+static inline s32 div64(s64 num, s32 den) { return (s32)(num / den); }
+
+static inline u32 sqrt64(s64 a) {
+    u64 root = 0;
+    u64 bit = (u64)1 << 62;
+    u64 value = a;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (u32)root;
+}
+
+#include <nds/arm9/trig_lut.h>
+
+#endif
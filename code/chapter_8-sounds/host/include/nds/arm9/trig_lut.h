@@ -0,0 +1,35 @@
+/*
+ *  trig_lut.h
+ *
+ *  The libnds lookup table trigonometry, for the host build. Angles use the
+ *  libnds system, where a full circle is DEGREES_IN_CIRCLE units, and the
+ *  results are 4.12 fixed point.
+ *
+ */
+
+#ifndef HOST_TRIG_LUT_H
+#define HOST_TRIG_LUT_H
+
+#include <nds.h>
+
+#define DEGREES_IN_CIRCLE (1 << 15)
+
+/*
+ *  sinLerp
+ *
+ *  Returns the sine of angle, interpolated from a 512 entry table like the
+ *  one in libnds. The table is built with libm the first time it is used,
+ *  so results may be off from the real table by a unit in the last place.
+ *
+ */
+s16 sinLerp(s16 angle);
+
+/*
+ *  cosLerp
+ *
+ *  Returns the cosine of angle, interpolated from the same table.
+ *
+ */
+s16 cosLerp(s16 angle);
+
+#endif
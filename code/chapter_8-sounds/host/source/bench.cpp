@@ -0,0 +1,1306 @@
+/*
+ *  bench.cpp
+ *
+ *  Micro-benchmarks and regression checks for the game logic, run on the
+ *  host computer.
+ *
+ *  Each benchmark calls one piece of the per-frame code many times and
+ *  reports the best time per call out of a few runs. The checks compare the
+ *  game's behaviour against a reference, and make the program exit with a
+ *  failure status when they don't hold, so this can run unattended.
+ *
+ */
+
+#include "camera.h"
+#include "collision.h"
+#include "entity_store.h"
+#include "float_ship.h"
+#include "input.h"
+#include "kinematics_reference.h"
+#include "matrix_pool.h"
+#include "oam_shadow.h"
+#include "resource_cache.h"
+#include "ship.h"
+#include "sprite_mux.h"
+#include "sprites.h"
+#include "trig.h"
+#include "vram_manager.h"
+#include <math.h>
+#include <nds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* How many calls each benchmark run makes, and how many runs we take. */
+static const int ITERATIONS = 1 << 20;
+static const int RUNS = 5;
+
+/* The state the benchmarks work on. */
+static SpriteInfo shipInfo = {0, 64, 64, 0, NULL};
+static OAMTable oam;
+
+static u64 nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ *  runBenchmark
+ *
+ *  Time fn over RUNS runs of ITERATIONS calls and print the fastest run.
+ *  The fastest run is the one least disturbed by whatever else the machine
+ *  is doing, so it is the most repeatable number.
+ *
+ */
+static void runBenchmark(const char *name, void (*fn)(int iterations)) {
+  u64 best = ~(u64)0;
+  for (int run = 0; run < RUNS; run++) {
+    u64 start = nowNs();
+    fn(ITERATIONS);
+    u64 elapsed = nowNs() - start;
+    if (elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("%-28s %9.2f ns/call\n", name, (double)best / ITERATIONS);
+}
+
+/* Benchmarks */
+
+/* Somewhere to put results, so the compiler can't drop the work. */
+static volatile s32 benchSink;
+
+static void benchAccelerate(int iterations) {
+  Ship ship(&shipInfo);
+  for (int i = 0; i < iterations; i++) {
+    ship.accelerate();
+    /* Keep changing direction, so the speed isn't stuck at the limit. */
+    ship.turnClockwise();
+  }
+}
+
+/* The speed limit accelerate() used to have, for comparison. */
+static void benchAccelerateAxisClamp(int iterations) {
+  MathVector2D<fixed> velocity;
+  int angle = 29582;
+  for (int i = 0; i < iterations; i++) {
+    accelerateAxisClamp(&velocity, angle);
+    angle = (angle + 192) & (DEGREES_IN_CIRCLE - 1);
+  }
+}
+
+static void benchMoveShip(int iterations) {
+  Ship ship(&shipInfo);
+  for (int i = 0; i < 32; i++) {
+    ship.accelerate();
+  }
+  for (int i = 0; i < iterations; i++) {
+    ship.moveShip();
+  }
+}
+
+/* The same, for the float port of the ship's kinematics. */
+static void benchFloatAccelerate(int iterations) {
+  FloatShip ship = {0, 0, 0, 0, 5.67232007f};
+  for (int i = 0; i < iterations; i++) {
+    ship.accelerate();
+    ship.turnClockwise();
+  }
+  benchSink = (s32)ship.vx;
+}
+
+static void benchFloatMoveShip(int iterations) {
+  FloatShip ship = {0, 0, 0, 0, 5.67232007f};
+  for (int i = 0; i < 32; i++) {
+    ship.accelerate();
+  }
+  for (int i = 0; i < iterations; i++) {
+    ship.move();
+  }
+  benchSink = (s32)ship.x;
+}
+
+static void benchReverseTurn(int iterations) {
+  Ship ship(&shipInfo);
+  for (int i = 0; i < iterations; i++) {
+    ship.reverseTurn();
+    /* Give each call a different velocity to find the angle of. */
+    ship.turnClockwise();
+    ship.accelerate();
+  }
+}
+
+/* Vectors all the way round the circle, at a typical ship speed. */
+static s32 benchVectorX[256];
+static s32 benchVectorY[256];
+
+static void initBenchVectors() {
+  for (int i = 0; i < 256; i++) {
+    benchVectorX[i] = cosLerp(i * (DEGREES_IN_CIRCLE / 256) + 37);
+    benchVectorY[i] = sinLerp(i * (DEGREES_IN_CIRCLE / 256) + 37);
+  }
+}
+
+static void benchAtan2Lerp(int iterations) {
+  s32 sum = 0;
+  for (int i = 0; i < iterations; i++) {
+    sum += atan2Lerp(benchVectorY[i & 255], benchVectorX[i & 255]);
+  }
+  benchSink = sum;
+}
+
+/* What reverseTurn() used to do: libm's atan2 on floats. */
+static void benchAtan2Float(int iterations) {
+  s32 sum = 0;
+  for (int i = 0; i < iterations; i++) {
+    sum += atan2Float(benchVectorY[i & 255], benchVectorX[i & 255]);
+  }
+  benchSink = sum;
+}
+
+static void benchRotateSprite(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    rotateSprite(&oam.matrixBuffer[i % MATRIX_COUNT],
+                 i & (DEGREES_IN_CIRCLE - 1));
+  }
+}
+
+/*
+ *  Filling in a sprite entry's attribute bitfields, as the main loop does
+ *  for each sprite it moves.
+ */
+static void benchPackSprites(int iterations) {
+  OAMShadow shadow(&oam);
+  for (int i = 0; i < iterations; i++) {
+    int oamId = i % SPRITE_COUNT;
+    SpriteEntry *entry = &oam.oamBuffer[oamId];
+    entry->x = i;
+    entry->y = i >> 1;
+    entry->rotationIndex = i % MATRIX_COUNT;
+    shadow.markEntry(oamId);
+  }
+}
+
+/* The common case: a single sprite moved since the last frame. */
+static void benchCommitOne(int iterations) {
+  OAMShadow shadow(&oam);
+  for (int i = 0; i < iterations; i++) {
+    shadow.markEntry(i % SPRITE_COUNT);
+    shadow.commit();
+  }
+}
+
+/* The worst case: every sprite and matrix changed. */
+static void benchCommitAll(int iterations) {
+  OAMShadow shadow(&oam);
+  for (int i = 0; i < iterations; i++) {
+    shadow.markAll();
+    shadow.commit();
+  }
+}
+
+static void benchMatrixPoolUpdate(int iterations) {
+  OAMShadow shadow(&oam);
+  MatrixPool pool(&shadow);
+  int index = pool.acquire(0);
+  for (int i = 0; i < iterations; i++) {
+    pool.beginFrame();
+    index = pool.update(index, i & (DEGREES_IN_CIRCLE - 1));
+  }
+}
+
+/*
+ *  Entity updates. These count one call per entity moved, so the time per
+ *  call should stay flat as the number of entities grows.
+ */
+static const int ENTITY_COUNTS[] = {16, 256, EntityStore::MAX_ENTITIES};
+static int entityCount;
+static EntityStore entities;
+
+static void fillEntities() {
+  entities = EntityStore();
+  for (int i = 0; i < entityCount; i++) {
+    MathVector2D<fixed> position;
+    position.x = fixed::fromInt(i % WORLD_WIDTH);
+    position.y = fixed::fromInt(i % WORLD_HEIGHT);
+    MathVector2D<fixed> velocity;
+    velocity.x = fixed::fromRaw(sinLerp(i * 97) >> 2);
+    velocity.y = fixed::fromRaw(cosLerp(i * 97) >> 2);
+    entities.create(ENTITY_BULLET, position, velocity, i * 97, i);
+  }
+}
+
+static void benchIntegrate(int iterations) {
+  fillEntities();
+  for (int i = 0; i < iterations / entityCount; i++) {
+    entities.integrate();
+  }
+}
+
+/* The same work done the old way, with one heap-allocated Ship each. */
+static void benchShipObjects(int iterations) {
+  Ship **ships = new Ship *[entityCount];
+  for (int i = 0; i < entityCount; i++) {
+    ships[i] = new Ship(&shipInfo);
+    ships[i]->accelerate();
+  }
+
+  for (int i = 0; i < iterations / entityCount; i++) {
+    for (int j = 0; j < entityCount; j++) {
+      ships[j]->moveShip();
+    }
+  }
+
+  for (int i = 0; i < entityCount; i++) {
+    delete ships[i];
+  }
+  delete[] ships;
+}
+
+static void benchEntityChurn(int iterations) {
+  entities = EntityStore();
+  EntityHandle handles[64] = {};
+  MathVector2D<fixed> zero;
+  for (int i = 0; i < iterations; i++) {
+    /* Replace a pseudo-random one of 64 bullets. */
+    int pick = (i * 37) & 63;
+    entities.destroy(handles[pick]);
+    handles[pick] = entities.create(ENTITY_BULLET, zero, zero, 0);
+  }
+}
+
+/*
+ *  Collision detection. These also count one call per object, with a whole
+ *  frame's worth of objects added and tested each time.
+ */
+static const int COLLIDER_COUNTS[] = {10, 100, 1000};
+static int colliderCount;
+static CollisionGrid collisions;
+
+/* A small, repeatable random number generator. */
+static u32 randomState;
+
+static u32 nextRandom() {
+  randomState = randomState * 1664525 + 1013904223;
+  return randomState >> 8;
+}
+
+/*
+ *  Scatter count bullet-sized objects over the world, half boxes and half
+ *  circles. With mixSizes, every sixteenth is a big ship-sized one instead.
+ */
+static void addColliders(CollisionGrid *grid, int count, u32 seed,
+                         bool mixSizes) {
+  randomState = seed;
+  grid->begin();
+  for (int i = 0; i < count; i++) {
+    int size = mixSizes && i % 16 == 0 ? 64 : 8;
+    grid->add(nextRandom() % WORLD_WIDTH, nextRandom() % WORLD_HEIGHT, size,
+              size, i % 2 ? COLLIDER_CIRCLE : COLLIDER_AABB, i);
+  }
+}
+
+static void benchCollisionGrid(int iterations) {
+  for (int i = 0; i < iterations / colliderCount; i++) {
+    addColliders(&collisions, colliderCount, 1, false);
+    collisions.findContacts();
+  }
+}
+
+static void benchCollisionNaive(int iterations) {
+  for (int i = 0; i < iterations / colliderCount; i++) {
+    addColliders(&collisions, colliderCount, 1, false);
+    collisions.findContactsNaive();
+  }
+}
+
+/* Checks */
+
+/* The distance between a and b in a space that wraps every size units. */
+static float wrappedDistance(float a, float b, float size) {
+  float d = fabsf(a - b);
+  return d > size / 2 ? size - d : d;
+}
+
+/*
+ *  checkTrajectory
+ *
+ *  Fly the fixed-point ship and the float reference through the same
+ *  scripted inputs and make sure they stay within a pixel of each other.
+ *
+ *  The reference turns and thrusts by exactly Ship's rounded amounts, so
+ *  what is left is the rounding of the velocity itself. While the ship is
+ *  held at top speed, each frame's thrust is only a twentieth of the
+ *  velocity, and a velocity a few 1/4096ths off the float's heading is too
+ *  close for that thrust to pull it round. The two ships then coast in very
+ *  slightly different directions, about a third of a pixel apart every 100
+ *  frames, and that adds up over the whole flight. So the reference starts
+ *  again from the ship's state every time the thrust goes on or off, which
+ *  leaves a third of a pixel of room under the tolerance. Maths that really
+ *  broke, such as a wrong sign or a swapped sine and cosine, puts the ships
+ *  many pixels apart within one stretch.
+ *
+ */
+static const float MAX_TRAJECTORY_ERROR = 1.0f;
+static const int TRAJECTORY_FRAMES = 3000;
+static const int TRAJECTORY_STRETCH = 200;
+
+static bool checkTrajectory() {
+  Ship ship(&shipInfo);
+  FloatShip reference;
+
+  float maxError = 0;
+  for (int frame = 0; frame < TRAJECTORY_FRAMES; frame++) {
+    if (frame % TRAJECTORY_STRETCH == 0) {
+      MathVector2D<fixed> position = ship.getPosition();
+      MathVector2D<fixed> velocity = ship.getVelocity();
+      reference.x = position.x.toFloat();
+      reference.y = position.y.toFloat();
+      reference.vx = velocity.x.toFloat();
+      reference.vy = velocity.y.toFloat();
+      reference.angle =
+          ship.getAngleDeg() * 2 * (float)PI / DEGREES_IN_CIRCLE;
+    }
+
+    /* Thrust on and off, while turning one way, then the other. */
+    if ((frame / TRAJECTORY_STRETCH) % 2 == 0) {
+      ship.accelerate();
+      reference.accelerate();
+    }
+    switch ((frame / 150) % 3) {
+    case 1:
+      ship.turnClockwise();
+      reference.turnClockwise();
+      break;
+    case 2:
+      ship.turnCounterClockwise();
+      reference.turnCounterClockwise();
+      break;
+    }
+
+    ship.moveShip();
+    reference.move();
+
+    MathVector2D<fixed> position = ship.getPosition();
+    float errorX =
+        wrappedDistance(position.x.toFloat(), reference.x, WORLD_WIDTH);
+    float errorY =
+        wrappedDistance(position.y.toFloat(), reference.y, WORLD_HEIGHT);
+    maxError = fmaxf(maxError, fmaxf(errorX, errorY));
+  }
+
+  bool passed = maxError <= MAX_TRAJECTORY_ERROR;
+  printf("%-28s %9.2f px max error over %d frames: %s\n", "trajectory",
+         maxError, TRAJECTORY_FRAMES, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/* The multiplexer's virtual sprites, outside OAM. */
+static const int MUX_SPRITES = 180;
+static SpriteEntry muxEntries[MUX_SPRITES];
+static SpriteInfo muxInfo[MUX_SPRITES];
+static int muxImportance[MUX_SPRITES];
+
+/*
+ *  Place the virtual sprites: a spread all over the screen and off its top
+ *  and bottom, and a crowd in band 3, more than a band can hold, a quarter
+ *  of which are more important than the rest. The attributes are made up,
+ *  but each sprite's are different, so they can be told apart in OAM.
+ */
+static void placeMuxSprites(SpriteMultiplexer *mux, int shift) {
+  static const int SPREAD = 100;
+  mux->begin();
+  for (int i = 0; i < MUX_SPRITES; i++) {
+    int y;
+    if (i < SPREAD) {
+      y = i * 37 + shift;
+      muxInfo[i].height = 16;
+      muxImportance[i] = 0;
+    } else {
+      y = 3 * SpriteMultiplexer::BAND_HEIGHT + 2 + i % 5 + shift;
+      muxInfo[i].height = 8;
+      muxImportance[i] = i % 4 == 0 ? 2 : 1;
+    }
+    muxEntries[i].attribute[0] = y & 0xFF;
+    muxEntries[i].attribute[1] = i;
+    muxEntries[i].attribute[2] = i;
+    muxInfo[i].oamId = i;
+    muxInfo[i].width = 16;
+    muxInfo[i].angle = 0;
+    muxInfo[i].entry = &muxEntries[i];
+    mux->submit(&muxInfo[i], muxImportance[i]);
+  }
+  mux->build();
+}
+
+/*
+ *  The sprites a band should show, worked out the slow way: everything that
+ *  covers a line of the band in order of top line, and if there are too
+ *  many, the most important ones, earliest first among equals.
+ */
+static int expectedBand(int band, int *shown) {
+  static const int TOO_MANY = MUX_SPRITES;
+  int tops[MUX_SPRITES];
+  int count = 0;
+  int bandTop = band * SpriteMultiplexer::BAND_HEIGHT;
+  int bandBottom = bandTop + SpriteMultiplexer::BAND_HEIGHT;
+
+  for (int top = -(256 - SCREEN_HEIGHT); top < SCREEN_HEIGHT; top++) {
+    for (int i = 0; i < MUX_SPRITES; i++) {
+      int y = muxEntries[i].attribute[0] & 0xFF;
+      tops[i] = y >= SCREEN_HEIGHT ? y - 256 : y;
+      if (tops[i] == top && top < bandBottom &&
+          top + muxInfo[i].height > bandTop) {
+        shown[count++] = i;
+      }
+    }
+  }
+
+  int limit = SpriteMultiplexer::ENTRIES_PER_BAND;
+  if (count > limit) {
+    int kept = 0;
+    for (int importance = TOO_MANY; importance >= 0 && kept < limit;
+         importance--) {
+      for (int i = 0; i < count && kept < limit; i++) {
+        if (!(shown[i] & 0x10000) && muxImportance[shown[i]] == importance) {
+          shown[i] |= 0x10000;
+          kept++;
+        }
+      }
+    }
+    int next = 0;
+    for (int i = 0; i < count; i++) {
+      if (shown[i] & 0x10000) {
+        shown[next++] = shown[i] & 0xFFFF;
+      }
+    }
+    count = limit;
+  }
+  return count;
+}
+
+/* Returns whether band's half of OAM holds what the band should show. */
+static bool bandInOam(int band) {
+  int shown[MUX_SPRITES];
+  int count = expectedBand(band, shown);
+  const SpriteEntry *half = (const SpriteEntry *)OAM +
+                            (band % 2) * SpriteMultiplexer::ENTRIES_PER_BAND;
+
+  for (int i = 0; i < SpriteMultiplexer::ENTRIES_PER_BAND; i++) {
+    if (i >= count) {
+      if (half[i].attribute[0] != ATTR0_DISABLED) {
+        return false;
+      }
+      continue;
+    }
+    const SpriteEntry *entry = &muxEntries[shown[i]];
+    if (half[i].attribute[0] != entry->attribute[0] ||
+        half[i].attribute[1] != entry->attribute[1] ||
+        half[i].attribute[2] != entry->attribute[2]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ *  Play the hardware's part for one frame: raise the VCount interrupt on
+ *  the trigger line, and run HBlank DMA at the end of each line. On every
+ *  line, the half of OAM the line is drawn from, and the half the next
+ *  line's sprites are being read from, must hold the right bands. Returns
+ *  how many lines got that wrong.
+ */
+static int runMuxFrame() {
+  static const int LINES = 263;
+  int wrong = 0;
+
+  for (int line = 0; line < LINES; line++) {
+    REG_VCOUNT = line;
+    if (line == hostYTrigger && hostVCountHandler != NULL) {
+      hostVCountHandler();
+    }
+
+    if (line < SCREEN_HEIGHT) {
+      int band = line / SpriteMultiplexer::BAND_HEIGHT;
+      int nextBand = (line + 1) / SpriteMultiplexer::BAND_HEIGHT;
+      if (!bandInOam(band) ||
+          (line + 1 < SCREEN_HEIGHT && !bandInOam(nextBand))) {
+        wrong++;
+      }
+    }
+
+    for (int channel = 0; channel < 4; channel++) {
+      u32 control = DMA_CR(channel);
+      if ((control & DMA_ENABLE) && (control & DMA_START_HBL)) {
+        memcpy((void *)DMA_DEST(channel), (const void *)DMA_SRC(channel),
+               (control & 0xFFFF) * sizeof(u32));
+        DMA_CR(channel) = control & ~DMA_ENABLE;
+      }
+    }
+  }
+  return wrong;
+}
+
+/*
+ *  Multiplex more sprites than OAM holds, with a crowded band, and check
+ *  every line of three frames: one built and committed, one where the game
+ *  didn't get round to a commit(), and one built with the sprites moved.
+ */
+static bool checkSpriteMultiplexer() {
+  static OAMTable muxOam;
+  initOAM(&muxOam);
+  OAMShadow shadow(&muxOam);
+  static SpriteMultiplexer mux(&shadow);
+  bool passed = true;
+
+  placeMuxSprites(&mux, 0);
+  const MuxBandStats *crowded = mux.getBandStats(3);
+  passed &= crowded->requested > SpriteMultiplexer::ENTRIES_PER_BAND &&
+            crowded->shown == SpriteMultiplexer::ENTRIES_PER_BAND &&
+            crowded->dropped == crowded->requested - crowded->shown;
+  int dropped = crowded->dropped;
+  for (int band = 0; band < SpriteMultiplexer::BAND_COUNT; band++) {
+    int shown[MUX_SPRITES];
+    passed &= mux.getBandStats(band)->shown == expectedBand(band, shown);
+  }
+
+  mux.enable();
+  mux.commit();
+  int wrong = runMuxFrame();
+  wrong += runMuxFrame();
+  placeMuxSprites(&mux, 5);
+  mux.commit();
+  wrong += runMuxFrame();
+  mux.disable();
+  passed &= wrong == 0;
+
+  printf("%-28s %d dropped in band 3, %d lines wrong: %s\n",
+         "sprite multiplexer", dropped, wrong, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkEntitySprites
+ *
+ *  Place entity sprites seen from views all round the wrapped world, and
+ *  make sure each lands where Camera::toScreen() puts it, hidden only when
+ *  it is well off screen. Then make sure age() hides the sprites of the
+ *  entities it destroys.
+ *
+ */
+static bool checkEntitySprites() {
+  static const int VIEWS = 64;
+  static const int MAX_SPRITE_SIZE = 64;
+  static EntityStore store;
+  static OAMTable entityOam;
+  initOAM(&entityOam);
+  OAMShadow shadow(&entityOam);
+  bool passed = true;
+
+  store = EntityStore();
+  MathVector2D<fixed> zero;
+  MathVector2D<fixed> positions[SPRITE_COUNT];
+  for (int i = 0; i < SPRITE_COUNT; i++) {
+    positions[i].x = fixed::fromRaw(
+        (i * 0x3F1F7) & ((WORLD_WIDTH << fixed::FRACTION_BITS) - 1));
+    positions[i].y = fixed::fromRaw(
+        (i * 0x2B3C1) & ((WORLD_HEIGHT << fixed::FRACTION_BITS) - 1));
+    store.create(ENTITY_BULLET, positions[i], zero, 0, i,
+                 i % 2 ? 1 : LIFETIME_FOREVER);
+  }
+
+  int wrong = 0;
+  for (int v = 0; v < VIEWS; v++) {
+    MathVector2D<int> view;
+    view.x = v * 37 - 700;
+    view.y = v * 23 - 300;
+    store.writeSprites(&shadow, view);
+
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+      MathVector2D<int> screen = Camera::toScreen(view, positions[i]);
+      bool hidden = screen.x <= -MAX_SPRITE_SIZE || screen.x >= SCREEN_WIDTH ||
+                    screen.y <= -MAX_SPRITE_SIZE || screen.y >= SCREEN_HEIGHT;
+      const SpriteEntry *entry = &entityOam.oamBuffer[i];
+      if (entry->x != (screen.x & 0x1FF) || entry->y != (screen.y & 0xFF) ||
+          entry->isHidden != hidden) {
+        wrong++;
+      }
+    }
+  }
+  passed &= wrong == 0;
+
+  /* Show every sprite, then let the mortal half of the entities die. */
+  for (int i = 0; i < SPRITE_COUNT; i++) {
+    entityOam.oamBuffer[i].isHidden = false;
+  }
+  passed &= store.age(&shadow) == SPRITE_COUNT / 2;
+  for (int i = 0; i < SPRITE_COUNT; i++) {
+    passed &= entityOam.oamBuffer[i].isHidden == (i % 2 == 1);
+  }
+
+  printf("%-28s %d wrong over %d views: %s\n", "entity sprites", wrong,
+         VIEWS, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkEntityHandles
+ *
+ *  Create and destroy entities in a scrambled order and make sure every
+ *  live handle still finds its own entity and every dead handle is
+ *  rejected, even after its slot has been reused.
+ *
+ */
+static bool checkEntityHandles() {
+  static EntityStore store;
+  static EntityHandle handles[EntityStore::MAX_ENTITIES];
+  static EntityHandle dead[EntityStore::MAX_ENTITIES];
+  int deadCount = 0;
+  bool passed = true;
+
+  MathVector2D<fixed> zero;
+  for (int i = 0; i < EntityStore::MAX_ENTITIES; i++) {
+    MathVector2D<fixed> position;
+    position.x = fixed::fromInt(i);
+    handles[i] = store.create(ENTITY_ALIEN, position, zero, 0);
+  }
+  passed &= store.create(ENTITY_ALIEN, zero, zero, 0) == INVALID_ENTITY;
+
+  for (int round = 0; round < 4; round++) {
+    for (int i = round; i < EntityStore::MAX_ENTITIES; i += 3) {
+      if (store.isAlive(handles[i])) {
+        dead[deadCount++ % EntityStore::MAX_ENTITIES] = handles[i];
+        store.destroy(handles[i]);
+      } else {
+        MathVector2D<fixed> position;
+        position.x = fixed::fromInt(i);
+        handles[i] = store.create(ENTITY_ALIEN, position, zero, 0);
+      }
+    }
+  }
+
+  int live = 0;
+  for (int i = 0; i < EntityStore::MAX_ENTITIES; i++) {
+    if (store.isAlive(handles[i])) {
+      passed &= store.getPosition(handles[i]).x.toInt() == i;
+      live++;
+    }
+  }
+  passed &= live == store.getCount();
+  for (int i = 0; i < deadCount && i < EntityStore::MAX_ENTITIES; i++) {
+    passed &= !store.isAlive(dead[i]);
+  }
+  passed &= !store.isAlive(INVALID_ENTITY);
+
+  printf("%-28s %d live after churn: %s\n", "entity handles", live,
+         passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkCollisions
+ *
+ *  Make sure the grid finds exactly the contacts that testing every pair
+ *  finds, each one once, including across the edges of the world.
+ *
+ */
+static bool checkCollisions() {
+  static CollisionGrid grid;
+  static u8 seen[512][512];
+  bool passed = true;
+  int total = 0;
+
+  for (u32 seed = 1; seed <= 20; seed++) {
+    addColliders(&grid, 500, seed, true);
+    grid.findContactsNaive();
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < grid.getContactCount(); i++) {
+      seen[grid.getContacts()[i].a][grid.getContacts()[i].b] = 1;
+    }
+    int expected = grid.getContactCount();
+
+    grid.findContacts();
+    passed &= grid.getContactCount() == expected;
+    passed &= grid.getDroppedContacts() == 0;
+    for (int i = 0; i < grid.getContactCount(); i++) {
+      const ContactPair *pair = &grid.getContacts()[i];
+      /* Each pair must be a real contact and only be reported once. */
+      passed &= seen[pair->a][pair->b] == 1;
+      seen[pair->a][pair->b] = 2;
+    }
+    total += expected;
+  }
+
+  printf("%-28s %d contacts in 20 scenes: %s\n", "collision grid", total,
+         passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkSpeedLimit
+ *
+ *  Point the ship every way it can face and hold the thrust down. Its
+ *  speed must never go over maxSpeed (1.0), and must get there in the end,
+ *  no matter the direction.
+ *
+ */
+static bool checkSpeedLimit() {
+  /* A couple of raw units either way covers rounding in the rescale. */
+  static const s32 TOLERANCE = 2;
+  static const int THRUST_FRAMES = 100;
+
+  bool passed = true;
+  s32 lowest = 0x7FFFFFFF;
+  s32 highest = 0;
+  for (int turns = 0; turns < DEGREES_IN_CIRCLE / 192 + 1; turns++) {
+    Ship ship(&shipInfo);
+    for (int i = 0; i < turns; i++) {
+      ship.turnClockwise();
+    }
+
+    for (int frame = 0; frame < THRUST_FRAMES; frame++) {
+      ship.accelerate();
+      MathVector2D<fixed> v = ship.getVelocity();
+      s32 speed = sqrt64((s64)v.x.raw * v.x.raw + (s64)v.y.raw * v.y.raw);
+      if (speed > highest) {
+        highest = speed;
+      }
+      passed &= speed <= fixed::ONE + TOLERANCE;
+    }
+
+    MathVector2D<fixed> v = ship.getVelocity();
+    s32 speed = sqrt64((s64)v.x.raw * v.x.raw + (s64)v.y.raw * v.y.raw);
+    if (speed < lowest) {
+      lowest = speed;
+    }
+    passed &= speed >= fixed::ONE - TOLERANCE;
+  }
+
+  printf("%-28s %.4f to %.4f at every angle: %s\n", "speed limit",
+         (float)lowest / fixed::ONE, (float)highest / fixed::ONE,
+         passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkAtan2
+ *
+ *  Print how far atan2Lerp() is from libm's atan2, in libnds degrees, for
+ *  vectors of a few different lengths all the way round the circle. The
+ *  coordinates are rounded to whole numbers before either function sees
+ *  them, so short vectors only measure the function, not the rounding.
+ *
+ */
+static const double MAX_ATAN2_ERROR = 1.0;
+
+static bool checkAtan2() {
+  static const int LENGTHS[] = {16, 256, fixed::ONE, 64 * fixed::ONE};
+  static const int STEPS = 8192;
+
+  bool passed = true;
+  printf("%-28s %10s %10s\n", "atan2Lerp vs libm, length", "max error",
+         "mean error");
+  for (unsigned i = 0; i < sizeof(LENGTHS) / sizeof(int); i++) {
+    double maxError = 0;
+    double totalError = 0;
+    for (int step = 0; step < STEPS; step++) {
+      double radians = step * 2 * M_PI / STEPS;
+      s32 x = lround(cos(radians) * LENGTHS[i]);
+      s32 y = lround(sin(radians) * LENGTHS[i]);
+
+      double exact = atan2((double)y, (double)x) * DEGREES_IN_CIRCLE /
+                     (2 * M_PI);
+      double error = fabs(atan2Lerp(y, x) - exact);
+      /* 0 and DEGREES_IN_CIRCLE are the same angle. */
+      error = fmod(error, DEGREES_IN_CIRCLE);
+      if (error > DEGREES_IN_CIRCLE / 2) {
+        error = DEGREES_IN_CIRCLE - error;
+      }
+
+      maxError = fmax(maxError, error);
+      totalError += error;
+    }
+
+    printf("%28d %10.3f %10.3f\n", LENGTHS[i], maxError, totalError / STEPS);
+    passed &= maxError <= MAX_ATAN2_ERROR;
+  }
+
+  passed &= atan2Lerp(0, 0) == 0;
+  printf("%-28s within %.1f libnds degrees: %s\n", "atan2Lerp", MAX_ATAN2_ERROR,
+         passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkInputReplay
+ *
+ *  Record a made up session of someone playing, save it, load it back and
+ *  make sure playing it back gives the same input on every tick. Then cut
+ *  the file short without fixing its tick count, and make sure playing it
+ *  back stops where the data does.
+ *
+ */
+static bool checkInputReplay() {
+  static const int TICKS = 10000;
+  static InputState states[TICKS];
+  static InputRecording recording;
+  static InputRecording loaded;
+  bool passed = true;
+
+  /* Hold keys for a while at a time, and now and then drag the stylus. */
+  u32 seed = 1;
+  u16 held = 0;
+  int touchX = 0;
+  int touchY = 0;
+  InputState state = {};
+  for (int i = 0; i < TICKS; i++) {
+    seed = seed * 1664525 + 1013904223;
+    if ((seed >> 24) < 8) {
+      held = (seed >> 8) & (KEY_UP | KEY_DOWN | KEY_LEFT | KEY_RIGHT |
+                            KEY_TOUCH);
+    }
+    if (held & KEY_TOUCH) {
+      touchX = (touchX + (seed >> 28) - 7) & 0xFF;
+      touchY = (touchY + ((seed >> 20) & 0xF) - 7) % SCREEN_HEIGHT;
+    }
+    nextInputState(&state, held, touchX, touchY);
+    states[i] = state;
+    passed &= recording.record(&state);
+  }
+
+  char directory[] = "/tmp/input_replayXXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    printf("%-28s can't make a scratch directory: FAILED\n", "input replay");
+    return false;
+  }
+  char path[128];
+  snprintf(path, sizeof(path), "%s/input.rec", directory);
+
+  passed &= recording.save(path);
+  passed &= loaded.load(path);
+  passed &= loaded.getTickCount() == TICKS;
+
+  InputState replayed = {};
+  for (int i = 0; i < TICKS && passed; i++) {
+    passed &= loaded.replay(&replayed);
+    passed &= memcmp(&replayed, &states[i], sizeof(InputState)) == 0;
+  }
+  passed &= !loaded.replay(&replayed);
+
+  /* The file ends with the tick count, the length and then the data. */
+  static u8 file[16 + InputRecording::MAX_BYTES];
+  FILE *in = fopen(path, "rb");
+  size_t size = in ? fread(file, 1, sizeof(file), in) : 0;
+  if (in) {
+    fclose(in);
+  }
+  size_t header = size - recording.getLength() - 2 * sizeof(u32);
+  u32 damaged[2] = {0x7FFFFFFF, (u32)recording.getLength() - 1};
+  memcpy(&file[header], damaged, sizeof(damaged));
+  FILE *out = fopen(path, "wb");
+  passed &= out && fwrite(file, 1, size - 1, out) == size - 1;
+  if (out) {
+    fclose(out);
+  }
+
+  passed &= loaded.load(path);
+  int replayedTicks = 0;
+  while (replayedTicks <= TICKS && loaded.replay(&replayed)) {
+    replayedTicks++;
+  }
+  passed &= replayedTicks < TICKS;
+
+  remove(path);
+  remove(directory);
+
+  printf("%-28s %d ticks in %d bytes: %s\n", "input replay", TICKS,
+         recording.getLength(), passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  checkCamera
+ *
+ *  Fly a target round and round the world, with the camera following it,
+ *  and make sure it never strays far out of the deadzone. Along the way, a
+ *  sprite is placed at the target's position and at a spot that comes and
+ *  goes from the screen, and the sprites must only hold a matrix while
+ *  they are on screen.
+ *
+ */
+static bool checkCamera() {
+  static const int FRAMES = 5000;
+  static const int DEADZONE_WIDTH = 128;
+  static const int DEADZONE_HEIGHT = 96;
+  /* At one pixel a frame, the camera settles this far outside. */
+  static const int SMOOTHING_LAG = 8;
+  bool passed = true;
+
+  initOAM(&oam);
+  OAMShadow shadow(&oam);
+  MatrixPool pool(&shadow);
+  Camera camera(DEADZONE_WIDTH, DEADZONE_HEIGHT);
+
+  SpriteInfo sprites[2] = {{0, 32, 32, 0, &oam.oamBuffer[0]},
+                           {1, 32, 32, 0, &oam.oamBuffer[1]}};
+  for (int i = 0; i < 2; i++) {
+    sprites[i].entry->isRotateScale = true;
+    sprites[i].entry->rotationIndex = pool.acquire(0);
+  }
+
+  MathVector2D<fixed> target;
+  target.x = fixed::fromInt(SCREEN_WIDTH / 2);
+  target.y = fixed::fromInt(SCREEN_HEIGHT / 2);
+  MathVector2D<fixed> fixedSpot;
+  fixedSpot.x = fixed::fromInt(100);
+  fixedSpot.y = fixed::fromInt(100);
+
+  int worst = 0;
+  int culledFrames = 0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    /* Go right, then down and to the left, then up. */
+    int phase = (frame / 700) % 3;
+    target.x += fixed::fromInt(phase == 0 ? 1 : phase == 1 ? -1 : 0);
+    target.y += fixed::fromInt(phase == 0 ? 0 : phase == 1 ? 1 : -1);
+    target.x.raw &= (WORLD_WIDTH << fixed::FRACTION_BITS) - 1;
+    target.y.raw &= (WORLD_HEIGHT << fixed::FRACTION_BITS) - 1;
+    camera.follow(target);
+
+    MathVector2D<int> screen;
+    passed &= camera.toScreen(target, 0, 0, &screen);
+    int outX = abs(screen.x - SCREEN_WIDTH / 2) - DEADZONE_WIDTH / 2;
+    int outY = abs(screen.y - SCREEN_HEIGHT / 2) - DEADZONE_HEIGHT / 2;
+    worst = outX > worst ? outX : worst;
+    worst = outY > worst ? outY : worst;
+
+    /* Each matrix is held by the sprites that are on screen. */
+    int shown = camera.placeSprite(&sprites[0], target, &shadow, &pool);
+    if (camera.placeSprite(&sprites[1], fixedSpot, &shadow, &pool)) {
+      shown++;
+    } else {
+      culledFrames++;
+    }
+    passed &= pool.getUsedCount() == (shown > 0 ? 1 : 0);
+    passed &= sprites[0].entry->isRotateScale;
+  }
+  passed &= worst <= SMOOTHING_LAG;
+  passed &= culledFrames > 0 && culledFrames < FRAMES;
+
+  printf("%-28s %d px past deadzone, culled %d/%d: %s\n", "camera follow",
+         worst, culledFrames, FRAMES, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  Every pixel of the world must come back from toWorld(toScreen()) as it
+ *  went in, with the camera between pixels as it is most of the time.
+ */
+static bool checkCameraRoundTrip() {
+  static const int CAMERAS = 64;
+  int mismatches = 0;
+
+  for (int i = 0; i < CAMERAS; i++) {
+    /* Walk the camera around the world in steps of a fraction of a pixel. */
+    MathVector2D<fixed> target;
+    target.x = fixed::fromRaw(i * (fixed::ONE * 37 / 5));
+    target.y = fixed::fromRaw(-i * (fixed::ONE * 23 / 7));
+    Camera camera;
+    camera.lookAt(target);
+
+    for (int y = 0; y < WORLD_HEIGHT; y++) {
+      for (int x = 0; x < WORLD_WIDTH; x++) {
+        MathVector2D<fixed> world;
+        world.x = fixed::fromInt(x);
+        world.y = fixed::fromInt(y);
+        MathVector2D<int> screen;
+        camera.toScreen(world, 1, 1, &screen);
+        MathVector2D<int> back = camera.toWorld(screen);
+        if (back.x != x || back.y != y) {
+          mismatches++;
+        }
+      }
+    }
+  }
+
+  bool passed = mismatches == 0;
+  printf("%-28s %d of %d pixels moved: %s\n", "camera round trip", mismatches,
+         CAMERAS * WORLD_WIDTH * WORLD_HEIGHT, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/* Write a file of bytes bytes, all of them fill, under directory. */
+static bool writeAsset(const char *directory, const char *name, u32 bytes,
+                       u8 fill) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%s", directory, name);
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  for (u32 i = 0; i < bytes; i++) {
+    fputc(fill, file);
+  }
+  return fclose(file) == 0;
+}
+
+static void countCopy(DmaFence, void *userData) { (*(int *)userData)++; }
+
+/*
+ *  Queue lots of small copies that fit in the budget together, and check
+ *  they all finish in one service(), then that a copy bigger than the
+ *  budget is spread over two.
+ */
+static bool checkDmaQueue() {
+  static const int JOBS = 16;
+  static const u32 JOB_BYTES = 64;
+  static const u32 BUDGET = 4096;
+  static u8 source[JOBS * JOB_BYTES];
+  static u8 dest[BUDGET + JOBS * JOB_BYTES];
+  for (u32 i = 0; i < sizeof(source); i++) {
+    source[i] = (u8)(i * 7 + 1);
+  }
+
+  DmaQueue queue(BUDGET);
+  DmaFence fences[JOBS];
+  int copied = 0;
+  bool passed = true;
+  for (int i = 0; i < JOBS; i++) {
+    fences[i] = queue.submit(source + i * JOB_BYTES, dest + i * JOB_BYTES,
+                             JOB_BYTES, 0, DmaQueue::NO_DEADLINE, countCopy,
+                             &copied);
+    passed &= fences[i] != 0;
+  }
+
+  queue.service();
+  u32 started = queue.getBytesStarted();
+  for (int i = 0; i < JOBS; i++) {
+    passed &= queue.isComplete(fences[i]);
+  }
+  passed &= copied == JOBS && started == JOBS * JOB_BYTES;
+  passed &= memcmp(source, dest, sizeof(source)) == 0;
+
+  static u8 big[BUDGET + JOBS * JOB_BYTES];
+  DmaFence fence = queue.submit(big, dest, sizeof(big));
+  queue.service();
+  passed &= !queue.isComplete(fence) && queue.getBytesStarted() == BUDGET;
+  queue.service();
+  passed &= queue.isComplete(fence);
+
+  printf("%-28s %d of %d jobs in one service: %s\n", "dma queue", copied,
+         JOBS, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  Load assets from a scratch directory through a small cache, and check
+ *  hits, misses, which asset is thrown out, the budget, and that handles
+ *  to thrown out assets stop working.
+ */
+static bool checkResourceCache() {
+  static const u32 ASSET_BYTES = 1000;
+  static const u32 BUDGET = 2500;
+  char directory[] = "/tmp/resource_cacheXXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    printf("%-28s can't make a scratch directory: FAILED\n",
+           "resource cache");
+    return false;
+  }
+  bool passed = writeAsset(directory, "a", ASSET_BYTES, 'a');
+  passed &= writeAsset(directory, "b", ASSET_BYTES, 'b');
+  passed &= writeAsset(directory, "c", ASSET_BYTES, 'c');
+  passed &= writeAsset(directory, "big", BUDGET + 1, 'x');
+
+  char root[128];
+  snprintf(root, sizeof(root), "%s/", directory);
+  ResourceCache cache(BUDGET, root);
+
+  /* A miss, then a hit on the same data. */
+  ResourceHandle a = cache.acquire("a");
+  cache.release(a);
+  passed &= cache.acquire("a") == a && cache.getMisses() == 1 &&
+            cache.getHits() == 1;
+  cache.release(a);
+  const u8 *data = (const u8 *)cache.getData(a);
+  passed &= data != NULL && data[0] == 'a' && data[ASSET_BYTES - 1] == 'a';
+  passed &= cache.getSize(a) == ASSET_BYTES;
+
+  /* Use b, then a again, so b is the one to go when c needs room. */
+  ResourceHandle b = cache.acquire("b");
+  cache.release(b);
+  cache.release(cache.acquire("a"));
+  ResourceHandle c = cache.acquire("c");
+  cache.release(c);
+  passed &= cache.getEvictions() == 1 && cache.getData(b) == NULL &&
+            cache.getData(a) != NULL && cache.getData(c) != NULL;
+  passed &= cache.getUsedBytes() == 2 * ASSET_BYTES;
+
+  /* Too big for the budget: refused, and nothing thrown out for it. */
+  passed &= cache.acquire("big") == INVALID_RESOURCE;
+  passed &= cache.getEvictions() == 1 && cache.getData(a) != NULL &&
+            cache.getData(c) != NULL;
+  passed &= cache.acquire("missing") == INVALID_RESOURCE;
+
+  /* An acquired asset stays, so c goes for b this time. */
+  a = cache.acquire("a");
+  ResourceHandle b2 = cache.acquire("b");
+  passed &= b2 != INVALID_RESOURCE && cache.getData(c) == NULL &&
+            cache.getData(a) != NULL;
+
+  /* b came back, maybe in its old slot, but the old handle stays dead. */
+  passed &= b2 != b && cache.getData(b) == NULL;
+
+  /* A queued copy holds on to its asset until it is done. */
+  static u8 vram[ASSET_BYTES];
+  DmaQueue queue(ASSET_BYTES);
+  passed &= cache.copyToVram(b2, vram, &queue) != 0;
+  cache.release(b2);
+  cache.release(a);
+  cache.setBudget(0);
+  passed &= cache.getData(b2) != NULL;
+  queue.flush();
+  passed &= vram[0] == 'b';
+  cache.setBudget(0);
+  passed &= cache.getData(b2) == NULL && cache.getData(a) == NULL &&
+            cache.getUsedBytes() == 0;
+
+  const char *names[] = {"a", "b", "c", "big"};
+  for (int i = 0; i < 4; i++) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+    remove(path);
+  }
+  remove(directory);
+
+  printf("%-28s %lu hits, %lu misses, %lu evictions: %s\n", "resource cache",
+         (unsigned long)cache.getHits(), (unsigned long)cache.getMisses(),
+         (unsigned long)cache.getEvictions(), passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+ *  Map banks the way a level might, including some the hardware can't do,
+ *  and check that allocations find the lowest free room in the right banks.
+ */
+static bool checkVram() {
+  static const u32 KB = 1024;
+  VramManager vram;
+  bool passed = true;
+
+  /* A and B one after the other, C for the sub screen, E for sprites. */
+  passed &= vram.map(VRAM_BANK_A, VRAM_USE_MAIN_BG);
+  passed &= VRAM_A_CR == (VRAM_ENABLE | 1);
+  passed &= !vram.map(VRAM_BANK_B, VRAM_USE_MAIN_BG);
+  passed &= vram.map(VRAM_BANK_B, VRAM_USE_MAIN_BG, 1);
+  passed &= VRAM_B_CR == (VRAM_ENABLE | 1 | (1 << 3));
+  passed &= vram.map(VRAM_BANK_C, VRAM_USE_SUB_BG);
+  passed &= vram.map(VRAM_BANK_E, VRAM_USE_MAIN_SPRITE);
+
+  /* Uses and places the hardware doesn't have. */
+  passed &= !vram.map(VRAM_BANK_H, VRAM_USE_MAIN_BG);
+  passed &= !vram.map(VRAM_BANK_E, VRAM_USE_SUB_SPRITE);
+  passed &= !vram.map(VRAM_BANK_D, VRAM_USE_TEXTURE, 4);
+  passed &= VRAM_H_CR == VRAM_ENABLE && VRAM_D_CR == VRAM_ENABLE;
+
+  /* The extended palettes of F would sit on top of those of G. */
+  passed &= vram.map(VRAM_BANK_G, VRAM_USE_MAIN_BG_EXT_PALETTE);
+  passed &= !vram.map(VRAM_BANK_F, VRAM_USE_MAIN_BG_EXT_PALETTE);
+  passed &= vram.map(VRAM_BANK_F, VRAM_USE_MAIN_BG_EXT_PALETTE, 1);
+
+  /* Lowest first, lined up, and straddling A and B. */
+  s32 map = vram.allocate(VRAM_USE_MAIN_BG, 8 * KB, 2 * KB);
+  s32 tiles = vram.allocate(VRAM_USE_MAIN_BG, 3 * KB, 16 * KB);
+  s32 bitmap = vram.allocate(VRAM_USE_MAIN_BG, 192 * KB, 16 * KB);
+  s32 tooBig = vram.allocate(VRAM_USE_MAIN_BG, 64 * KB, 16 * KB);
+  passed &= map == 0 && tiles == 16 * (s32)KB && bitmap == 32 * (s32)KB;
+  passed &= tooBig == VramManager::NO_SPACE;
+  passed &= vram.allocate(VRAM_USE_SUB_SPRITE, 1, 1) == VramManager::NO_SPACE;
+
+  VramBankInfo a;
+  VramBankInfo b;
+  vram.getBankInfo(VRAM_BANK_A, &a);
+  vram.getBankInfo(VRAM_BANK_B, &b);
+  passed &= a.used == 107 * KB && b.used == 96 * KB;
+
+  /* B can't go while the bitmap is in it, and can once it's freed. */
+  passed &= !vram.unmap(VRAM_BANK_B);
+  vram.free(VRAM_USE_MAIN_BG, bitmap);
+  passed &= vram.unmap(VRAM_BANK_B);
+  passed &= VRAM_B_CR == VRAM_ENABLE;
+  passed &= vram.allocate(VRAM_USE_MAIN_BG, 128 * KB, 16 * KB) ==
+            VramManager::NO_SPACE;
+
+  /* The next level starts from nothing. */
+  vram.freeAll();
+  passed &= vram.allocate(VRAM_USE_MAIN_BG, 128 * KB, 16 * KB) == 0;
+  passed &= VramManager::getAddress(VRAM_USE_MAIN_SPRITE, 64) ==
+            (void *)0x06400040;
+  passed &= VramManager::getAddress(VRAM_USE_TEXTURE, 0) == NULL;
+
+  printf("%-28s A %lu/%luK, B %lu/%luK: %s\n", "vram banks",
+         (unsigned long)(a.used / KB), (unsigned long)(a.size / KB),
+         (unsigned long)(b.used / KB), (unsigned long)(b.size / KB),
+         passed ? "ok" : "FAILED");
+  return passed;
+}
+
+int main() {
+  initOAM(&oam);
+  initBenchVectors();
+
+  printf("Benchmarks (best of %d runs of %d calls)\n", RUNS, ITERATIONS);
+  runBenchmark("accelerate", benchAccelerate);
+  runBenchmark("accelerate (axis clamp)", benchAccelerateAxisClamp);
+  runBenchmark("accelerate (float)", benchFloatAccelerate);
+  runBenchmark("moveShip", benchMoveShip);
+  runBenchmark("moveShip (float)", benchFloatMoveShip);
+  runBenchmark("reverseTurn", benchReverseTurn);
+  runBenchmark("atan2Lerp", benchAtan2Lerp);
+  runBenchmark("atan2f (libm)", benchAtan2Float);
+  runBenchmark("rotateSprite", benchRotateSprite);
+  runBenchmark("packSprites", benchPackSprites);
+  runBenchmark("commit (one entry)", benchCommitOne);
+  runBenchmark("commit (all entries)", benchCommitAll);
+  runBenchmark("MatrixPool::update", benchMatrixPoolUpdate);
+  runBenchmark("EntityStore create+destroy", benchEntityChurn);
+
+  printf("\nEntity updates (per entity)\n");
+  for (unsigned i = 0; i < sizeof(ENTITY_COUNTS) / sizeof(int); i++) {
+    char name[32];
+    entityCount = ENTITY_COUNTS[i];
+    snprintf(name, sizeof(name), "integrate x%d", entityCount);
+    runBenchmark(name, benchIntegrate);
+    snprintf(name, sizeof(name), "Ship::moveShip x%d", entityCount);
+    runBenchmark(name, benchShipObjects);
+  }
+
+  printf("\nCollision detection (per object)\n");
+  for (unsigned i = 0; i < sizeof(COLLIDER_COUNTS) / sizeof(int); i++) {
+    char name[32];
+    colliderCount = COLLIDER_COUNTS[i];
+    snprintf(name, sizeof(name), "grid x%d", colliderCount);
+    runBenchmark(name, benchCollisionGrid);
+    snprintf(name, sizeof(name), "naive x%d", colliderCount);
+    runBenchmark(name, benchCollisionNaive);
+  }
+
+  printf("\nChecks\n");
+  bool passed = true;
+  passed &= checkTrajectory();
+  passed &= checkSpeedLimit();
+  passed &= checkAtan2();
+  passed &= checkSpriteMultiplexer();
+  passed &= checkEntityHandles();
+  passed &= checkEntitySprites();
+  passed &= checkCollisions();
+  passed &= checkInputReplay();
+  passed &= checkCamera();
+  passed &= checkCameraRoundTrip();
+  passed &= checkDmaQueue();
+  passed &= checkResourceCache();
+  passed &= checkVram();
+
+  return passed ? 0 : 1;
+}
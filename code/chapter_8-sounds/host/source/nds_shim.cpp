@@ -0,0 +1,49 @@
+/*
+ *  nds_shim.cpp
+ *
+ *  The parts of the host libnds stand-in that need a definition.
+ *
+ */
+
+#include <math.h>
+#include <nds.h>
+
+u16 hostOAM[SPRITE_COUNT * 4];
+vu8 hostVramCR[9];
+vu32 hostDispcnt;
+vu16 hostVCount;
+int hostYTrigger = -1;
+VoidFn hostVCountHandler;
+volatile uintptr_t hostDmaSrc[4];
+volatile uintptr_t hostDmaDest[4];
+vu32 hostDmaCr[4];
+
+/* One table entry every 64 angle units. */
+static const int LUT_SHIFT = 6;
+static const int LUT_SIZE = DEGREES_IN_CIRCLE >> LUT_SHIFT;
+
+static s16 sinTable[LUT_SIZE + 1];
+static bool sinTableReady = false;
+
+static void buildSinTable() {
+  for (int i = 0; i <= LUT_SIZE; i++) {
+    sinTable[i] = (s16)lround(sin(i * 2 * M_PI / LUT_SIZE) * (1 << 12));
+  }
+  sinTableReady = true;
+}
+
+s16 sinLerp(s16 angle) {
+  if (!sinTableReady) {
+    buildSinTable();
+  }
+
+  int a = angle & (DEGREES_IN_CIRCLE - 1);
+  int index = a >> LUT_SHIFT;
+  int frac = a & ((1 << LUT_SHIFT) - 1);
+
+  s32 low = sinTable[index];
+  s32 high = sinTable[index + 1];
+  return (s16)(low + (((high - low) * frac) >> LUT_SHIFT));
+}
+
+s16 cosLerp(s16 angle) { return sinLerp(angle + DEGREES_IN_CIRCLE / 4); }
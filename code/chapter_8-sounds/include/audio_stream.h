@@ -0,0 +1,169 @@
+/*
+ *  audio_stream.h
+ *
+ *  Plays a long sound, like music, from a WAV file in NitroFS without
+ *  loading the whole thing into memory.
+ *
+ *  The soundbank is loaded into RAM all at once (see main.cpp), which is
+ *  fine for short sound effects but would fill up the DS's 4 MiB with a
+ *  few minutes of music. Instead, a stream keeps a small ring buffer of
+ *  sound. maxmod takes sound out of the ring from its timer interrupt as
+ *  it plays, and service() tops it up from the file whenever the game has
+ *  time to spare. However long the file is, the stream only ever uses the
+ *  memory of one AudioStream.
+ *
+ *  If the game doesn't call service() often enough, the ring runs dry and
+ *  maxmod gets silence instead. That is an underrun, and they are counted
+ *  so they can be found and fixed.
+ *
+ *  Files can be 8 or 16-bit PCM, or IMA ADPCM (which is four times smaller
+ *  than 16-bit PCM), in mono or stereo.
+ *
+ */
+
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <maxmod9.h>
+#include <nds.h>
+#include <stdio.h>
+
+class AudioStream {
+public:
+    /* How much decoded sound we keep ready to play. */
+    static const int RING_BYTES = 16 * 1024;
+
+    /* How much of the file we read at a time. */
+    static const int READ_BYTES = 2048;
+
+    /*
+     *  How many samples maxmod asks for at a time. It must be a multiple of
+     *  16, and the ring must hold several times more than this.
+     */
+    static const int MIXER_SAMPLES = 1024;
+
+protected:
+    FILE * file;
+    bool looping;
+
+    /* Where the sound is in the file, and how much of it is left to read. */
+    long dataStart;
+    u32 dataBytes;
+    u32 dataLeft;
+
+    /* The format of the file. */
+    int channels;
+    int bitsPerSample;
+    bool adpcm;
+    u32 sampleRate;
+    int blockAlign;
+    int samplesPerBlock;
+
+    /* The format of the sound in the ring. */
+    mm_stream_formats streamFormat;
+    int frameBytes;
+
+    /*
+     *  The ring. readPosition and writePosition count the bytes ever taken
+     *  out and put in, so the ring holds writePosition - readPosition
+     *  bytes. Only the interrupt moves readPosition and only service()
+     *  moves writePosition, so neither needs a lock, only a compiler
+     *  barrier before each move.
+     */
+    u8 ring[RING_BYTES] ALIGN(4);
+    volatile u32 readPosition;
+    volatile u32 writePosition;
+
+    /* Somewhere to read the file into before decoding it. */
+    u8 readBuffer[READ_BYTES];
+
+    /* Set once the whole file has gone into the ring. */
+    volatile bool endOfFile;
+    bool playing;
+
+    /* Statistics */
+    volatile u32 underruns;
+    volatile u32 underrunSamples;
+
+    /* Only one stream can play at once, and this is it. */
+    static AudioStream * current;
+    static mm_word onStreamRequest(mm_word length, mm_addr dest,
+                                   mm_stream_formats format);
+
+    bool readHeader();
+    bool rewindData();
+    u32 freeBytes() const;
+    void putBytes(const u8 * data, u32 bytes);
+    void putSample(u32 offset, s16 sample);
+    bool fillPcm();
+    bool fillAdpcm();
+    u32 takeBytes(u8 * dest, u32 bytes);
+
+public:
+    /*
+     *  AudioStream
+     *
+     *  Create a stream with nothing to play.
+     *
+     */
+    AudioStream();
+
+    /*
+     *  ~AudioStream
+     *
+     *  Stop playing and close the file.
+     *
+     */
+    ~AudioStream();
+
+    /*
+     *  open
+     *
+     *  Open a WAV file, fill the ring, and start playing it. Playing uses
+     *  hardware timer 0. When looping is true, the sound starts over when it
+     *  gets to the end. Returns false if the file can't be read or isn't in
+     *  a format we can play.
+     *
+     */
+    bool open(const char * path, bool looping);
+
+    /*
+     *  close
+     *
+     *  Stop playing and close the file.
+     *
+     */
+    void close();
+
+    /*
+     *  service
+     *
+     *  Top up the ring from the file, reading at most maxReads times. Call
+     *  this every frame, when there is time to spare.
+     *
+     */
+    void service(int maxReads = 4);
+
+    /*
+     *  isPlaying
+     *
+     *  Returns true until a stream that doesn't loop has played to the end.
+     *
+     */
+    bool isPlaying() const;
+
+    /*
+     *  getUnderruns
+     *
+     *  Returns how many times maxmod asked for more sound than the ring
+     *  had, and how many samples of silence it got instead.
+     *
+     */
+    u32 getUnderruns() const { return underruns; }
+    u32 getUnderrunSamples() const { return underrunSamples; }
+
+    /* Returns how many bytes of sound are ready to play. */
+    u32 getBufferedBytes() const { return writePosition - readPosition; }
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ *  camera.h
+ *
+ *  Decides which part of the world is on screen, and works out where on
+ *  the screen each sprite goes.
+ *
+ *  The camera follows a target, such as the ship. The target may move
+ *  around inside a deadzone in the middle of the screen without the camera
+ *  moving at all, so small moves don't shake the whole screen. When the
+ *  target leaves the deadzone, the camera closes a fraction of the gap each
+ *  frame, which smooths out sudden changes of speed.
+ *
+ *  Sprites are placed in world coordinates. A sprite that is entirely off
+ *  screen is hidden, and gives its affine matrix back to the matrix pool,
+ *  so that only what can be seen takes up the hardware's 32 matrices.
+ *
+ */
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <nds.h>
+#include "fixed.h"
+#include "matrix_pool.h"
+#include "oam_shadow.h"
+#include "ship.h"
+#include "sprites.h"
+
+class Camera {
+protected:
+    /*
+     *  The world position at the middle of the screen. It doesn't wrap
+     *  around with the world, so that anything scrolled by it (see
+     *  parallax.h) never jumps.
+     */
+    MathVector2D<fixed> center;
+
+    /* How far the camera moved in the last call to follow(). */
+    MathVector2D<fixed> step;
+
+    /* The size of the deadzone, in pixels. */
+    int deadzoneWidth;
+    int deadzoneHeight;
+
+    /* How much of the gap to the deadzone is closed each frame. */
+    fixed smoothing;
+
+    fixed followAxis(fixed offset, int deadzone) const;
+
+public:
+    /*
+     *  Camera
+     *
+     *  Create a camera showing the world from 0, 0, with a deadzone of
+     *  _deadzoneWidth by _deadzoneHeight pixels, that closes _smoothing of
+     *  the gap to its target every frame (1 to keep up exactly).
+     *
+     */
+    Camera(int _deadzoneWidth = 128, int _deadzoneHeight = 96,
+           fixed _smoothing = fixed::fromRaw(fixed::ONE / 8));
+
+    /*
+     *  lookAt
+     *
+     *  Jump straight to showing target in the middle of the screen.
+     *
+     */
+    void lookAt(MathVector2D<fixed> target);
+
+    /*
+     *  follow
+     *
+     *  Move towards target, if it has left the deadzone. Call this once a
+     *  frame.
+     *
+     */
+    void follow(MathVector2D<fixed> target);
+
+    /*
+     *  getPosition
+     *
+     *  Returns the world position at the top left of the screen. It keeps
+     *  counting past the edges of the world instead of wrapping around.
+     *
+     */
+    MathVector2D<fixed> getPosition() const;
+
+    /*
+     *  getView
+     *
+     *  Returns the whole pixel of the world at the top left of the screen,
+     *  which is what sprites are placed against. Like getPosition(), it
+     *  doesn't wrap.
+     *
+     */
+    MathVector2D<int> getView() const;
+
+    /*
+     *  getStep
+     *
+     *  Returns how far the camera moved in the last call to follow().
+     *
+     */
+    MathVector2D<fixed> getStep() const { return step; }
+
+    /*
+     *  toScreen
+     *
+     *  Work out where on the screen the world position is, taking the short
+     *  way round the wrapped world. Returns whether a width by height box
+     *  with its top left corner there is at least partly on screen.
+     *
+     */
+    bool toScreen(MathVector2D<fixed> world, int width, int height,
+                  MathVector2D<int> * screen) const;
+
+    /*
+     *  toWorld
+     *
+     *  Returns the world position, wrapped into the world, that is shown at
+     *  the screen position. For a whole pixel of the world, toWorld() gives
+     *  back exactly what toScreen() was given.
+     *
+     */
+    MathVector2D<int> toWorld(MathVector2D<int> screen) const;
+
+    /*
+     *  toScreen, toWorld
+     *
+     *  The same, for a view from getView(). These let the simulation use a
+     *  view taken at the start of a frame, without the camera itself.
+     *
+     */
+    static MathVector2D<int> toScreen(MathVector2D<int> view,
+                                      MathVector2D<fixed> world);
+    static MathVector2D<int> toWorld(MathVector2D<int> view,
+                                     MathVector2D<int> screen);
+
+    /*
+     *  placeSprite
+     *
+     *  Move a sprite to its world position on screen, rotating it by its
+     *  angle if it is affine. Pass matrixPool for affine sprites only, which
+     *  must not be double bound. A sprite that is off screen is hidden, and
+     *  its matrix released, until it comes back. Returns whether the sprite
+     *  is on screen.
+     *
+     */
+    bool placeSprite(SpriteInfo * spriteInfo, MathVector2D<fixed> world,
+                     OAMShadow * oamShadow, MatrixPool * matrixPool = NULL);
+};
+
+#endif
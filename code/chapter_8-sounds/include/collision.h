@@ -0,0 +1,158 @@
+/*
+ *  collision.h
+ *
+ *  Finds which objects touch each frame, using a uniform grid over the
+ *  WORLD_WIDTH by WORLD_HEIGHT space the sprite hardware wraps around in.
+ *
+ *  Testing every object against every other takes n * (n - 1) / 2 tests,
+ *  which is fine for a handful of objects and hopeless for a thousand. So
+ *  first each object is dropped into the grid cells it covers (the broad
+ *  phase), and only objects sharing a cell are tested against each other
+ *  properly (the narrow phase). As long as objects are spread out, the work
+ *  grows with the number of objects rather than its square.
+ *
+ *  Objects are described fresh each frame: call begin(), add() everything
+ *  that can collide, then findContacts().
+ *
+ */
+
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <nds.h>
+#include "ship.h"
+#include "sprites.h"
+
+/*
+ *  ColliderShape
+ *
+ *  COLLIDER_AABB uses the whole width by height box. COLLIDER_CIRCLE uses
+ *  the largest circle that fits in the box, which suits round things like
+ *  moons and ships that can point any way.
+ */
+enum ColliderShape {
+    COLLIDER_AABB,
+    COLLIDER_CIRCLE,
+};
+
+/* Two objects that touch, by the ids they were added with. */
+typedef struct {
+    u16 a;
+    u16 b;
+} ContactPair;
+
+class CollisionGrid {
+public:
+    /* Each cell is this many pixels square. */
+    static const int CELL_SIZE = 32;
+    static const int GRID_WIDTH = WORLD_WIDTH / CELL_SIZE;
+    static const int GRID_HEIGHT = WORLD_HEIGHT / CELL_SIZE;
+    static const int CELL_COUNT = GRID_WIDTH * GRID_HEIGHT;
+
+    static const int MAX_COLLIDERS = 1024;
+    static const int MAX_CONTACTS = 1024;
+
+    /*
+     *  An object no bigger than a cell covers at most four cells, and it
+     *  takes a 64x64 sprite to cover nine.
+     */
+    static const int MAX_CELL_ENTRIES = MAX_COLLIDERS * 4;
+
+protected:
+    /* The colliders added this frame, in pixels. */
+    s16 colliderX[MAX_COLLIDERS];
+    s16 colliderY[MAX_COLLIDERS];
+    u16 colliderWidth[MAX_COLLIDERS];
+    u16 colliderHeight[MAX_COLLIDERS];
+    u8 colliderShape[MAX_COLLIDERS];
+    u16 colliderId[MAX_COLLIDERS];
+    int colliderCount;
+
+    /*
+     *  The grid. The colliders in cell c are cellEntries[cellStart[c]] up
+     *  to cellEntries[cellStart[c + 1]], sorted into place by cell with a
+     *  counting sort, so the whole grid is two flat arrays.
+     */
+    u16 cellStart[CELL_COUNT + 1];
+    u16 cellEntries[MAX_CELL_ENTRIES];
+    int entryCount;
+
+    ContactPair contacts[MAX_CONTACTS];
+    int contactCount;
+    int droppedContacts;
+
+    void buildGrid();
+    bool overlaps(int a, int b) const;
+    bool ownsPair(int cell, int a, int b) const;
+    void addContact(int a, int b);
+
+public:
+    /*
+     *  CollisionGrid
+     *
+     *  Create an empty grid.
+     *
+     */
+    CollisionGrid();
+
+    /*
+     *  begin
+     *
+     *  Forget last frame's colliders and contacts.
+     *
+     */
+    void begin();
+
+    /*
+     *  add
+     *
+     *  Add an object whose bounding box has its top left corner at x, y.
+     *  Coordinates wrap around the world, just like sprite coordinates.
+     *  Returns false if the grid is full.
+     *
+     */
+    bool add(int x, int y, int width, int height, ColliderShape shape,
+             u16 id);
+
+    /*
+     *  addSprite
+     *
+     *  Add a sprite's bounding box at x, y, using its oamId as the id.
+     *
+     */
+    bool addSprite(const SpriteInfo * spriteInfo, int x, int y,
+                   ColliderShape shape);
+
+    /*
+     *  findContacts
+     *
+     *  Find every pair of touching objects. Each pair is reported once.
+     *  Returns the number of contacts.
+     *
+     */
+    int findContacts();
+
+    /*
+     *  findContactsNaive
+     *
+     *  Find the same contacts by testing every pair of objects. This is
+     *  much slower, and only here to check and measure findContacts()
+     *  against.
+     *
+     */
+    int findContactsNaive();
+
+    const ContactPair * getContacts() const { return contacts; }
+    int getContactCount() const { return contactCount; }
+
+    /*
+     *  getDroppedContacts
+     *
+     *  Returns how many contacts were found after the contact list filled
+     *  up, and so were not reported.
+     *
+     */
+    int getDroppedContacts() const { return droppedContacts; }
+};
+
+#endif
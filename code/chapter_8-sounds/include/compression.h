@@ -0,0 +1,99 @@
+/*
+ *  compression.h
+ *
+ *  Loading of graphics compressed by grit (with -gzl, -gzr or -gzh) into
+ *  video memory.
+ *
+ *  Compressed data starts with a 32-bit header. The lowest byte holds the
+ *  compression type and the upper 24 bits hold the size of the data once
+ *  it is decompressed. The BIOS decompression routines understand this
+ *  format directly.
+ *
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <nds.h>
+#include "dma_queue.h"
+
+/* The compression types found in the header. */
+enum CompressionType {
+    COMPRESSION_LZ77 = 0x10,
+    COMPRESSION_HUFFMAN = 0x20,
+    COMPRESSION_RLE = 0x30,
+};
+
+/*
+ *  DecompressionPath
+ *
+ *  DECOMPRESS_DIRECT decompresses straight into video memory. Video memory
+ *  can't be written a byte at a time, so LZ77 and RLE data use the slower
+ *  "Vram" variants of the BIOS routines. The Huffman routine only ever
+ *  writes whole words, so it has no such variant and needs none.
+ *
+ *  DECOMPRESS_BOUNCE decompresses into a temporary buffer in main RAM with
+ *  the faster routines, then copies the result into video memory with DMA.
+ */
+enum DecompressionPath {
+    DECOMPRESS_DIRECT,
+    DECOMPRESS_BOUNCE,
+};
+
+/*
+ *  CompressionBenchmark
+ *
+ *  The result of benchmarkCompressed(). Times are in CPU timer ticks
+ *  (BUS_CLOCK ticks per second).
+ */
+typedef struct {
+    u32 compressedBytes;
+    u32 decodedBytes;
+    u32 rawCopyTicks;
+    u32 directTicks;
+    u32 bounceTicks;
+} CompressionBenchmark;
+
+/*
+ *  getCompressionType
+ *
+ *  Returns the CompressionType of a compressed block of data.
+ *
+ */
+int getCompressionType(const void * data);
+
+/*
+ *  getDecompressedSize
+ *
+ *  Returns the size in bytes of a compressed block of data once it has been
+ *  decompressed.
+ *
+ */
+u32 getDecompressedSize(const void * data);
+
+/*
+ *  loadCompressed
+ *
+ *  Decompress data into video memory at dst. With DECOMPRESS_BOUNCE and a
+ *  DMA queue, the copy into video memory is queued and the bounce buffer is
+ *  freed once it completes. Returns false if the bounce buffer could not
+ *  be allocated.
+ *
+ */
+bool loadCompressed(const void * data, void * dst, DecompressionPath path,
+                    DmaQueue * dmaQueue = NULL);
+
+/*
+ *  benchmarkCompressed
+ *
+ *  Load data into dst down each path and time it, along with a plain DMA
+ *  copy of the decompressed data (which is what loading an uncompressed
+ *  asset costs). compressedBytes is the size grit reports for the data (its
+ *  *Len symbol), which is what the asset costs in the ROM. Uses hardware
+ *  timers 2 and 3.
+ *
+ */
+void benchmarkCompressed(const void * data, u32 compressedBytes, void * dst,
+                         CompressionBenchmark * out);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ *  dma_queue.h
+ *
+ *  A queue of DMA transfers that are spread out over several frames.
+ *
+ *  Instead of blocking while a big copy runs, code submits a job and gets a
+ *  fence back. Once per frame (during VBlank) the queue runs as much work
+ *  as fits in its byte budget on its DMA channels, most important jobs
+ *  first. When a channel finishes a job, it goes on to the next one, so a
+ *  frame can get through many small jobs. Jobs larger than the budget are
+ *  split up and continue on the next frame.
+ *
+ *  The queue also takes care of the data cache: sources are flushed when a
+ *  job is submitted, and destinations in main RAM are invalidated when it
+ *  completes.
+ *
+ */
+
+#ifndef DMA_QUEUE_H
+#define DMA_QUEUE_H
+
+#include <nds.h>
+
+/* Identifies a submitted job. Fences are never reused. */
+typedef u32 DmaFence;
+
+/* Called when a job has finished transferring. */
+typedef void (*DmaCallback)(DmaFence fence, void * userData);
+
+class DmaQueue {
+public:
+    static const int MAX_JOBS = 32;
+    static const int DMA_CHANNELS = 4;
+
+    /* A deadline for jobs that are not in any hurry. */
+    static const u32 NO_DEADLINE = 0xFFFFFFFF;
+
+protected:
+    struct Job {
+        const u8 * src;
+        u8 * dst;
+        u32 bytes;
+        u32 started;
+        int priority;
+        u32 deadline;
+        DmaCallback callback;
+        void * userData;
+        DmaFence fence;
+        bool used;
+    };
+    Job jobs[MAX_JOBS];
+
+    /* The job each channel is busy with, or -1 when it is idle. */
+    int channelJob[DMA_CHANNELS];
+
+    u32 channelMask;
+    u32 frameBudget;
+    u32 frame;
+    DmaFence nextFence;
+
+    /* Statistics for the last call to service() */
+    u32 bytesStarted;
+    u32 deadlineMisses;
+
+    void retireChannel(int channel);
+    void retire();
+    int pickJob() const;
+    u32 chunkSize(int jobIndex, u32 budget, bool unlimited) const;
+    void startChunk(int channel, int jobIndex, u32 bytes);
+    void schedule(bool unlimited);
+
+public:
+    /*
+     *  DmaQueue
+     *
+     *  Create a queue that may start up to _frameBudget bytes of transfers
+     *  per frame, using the DMA channels whose bits are set in _channelMask.
+     *  DMA channel 3 is used by the sprite code for immediate copies, the
+     *  sprite multiplexer uses channel 1, and the parallax line table uses
+     *  channel 0, so by default the queue keeps to channel 2.
+     *
+     */
+    DmaQueue(u32 _frameBudget, u32 _channelMask = BIT(2));
+
+    /*
+     *  usesChannel
+     *
+     *  Returns whether the queue may start transfers on DMA channel channel.
+     *
+     */
+    bool usesChannel(int channel) const { return channelMask & BIT(channel); }
+
+    /*
+     *  submit
+     *
+     *  Queue a copy of bytes bytes from src to dst. Higher priority jobs are
+     *  started first. deadline is the number of frames the copy may be
+     *  spread over; a job whose deadline has arrived is finished that frame
+     *  regardless of the budget. Returns a fence for the job, or 0 if the
+     *  queue is full.
+     *
+     */
+    DmaFence submit(const void * src, void * dst, u32 bytes, int priority = 0,
+                    u32 deadline = NO_DEADLINE, DmaCallback callback = NULL,
+                    void * userData = NULL);
+
+    /*
+     *  service
+     *
+     *  Retire finished transfers and start new ones. Call this once per
+     *  frame, during VBlank. While there is budget left, it waits for a busy
+     *  channel to finish and starts the next job on it.
+     *
+     */
+    void service();
+
+    /*
+     *  isComplete
+     *
+     *  Returns true once every byte of the job has been transferred.
+     *
+     */
+    bool isComplete(DmaFence fence) const;
+
+    /*
+     *  flush
+     *
+     *  Run every queued job to completion right now, ignoring the budget.
+     *  Useful during loading screens.
+     *
+     */
+    void flush();
+
+    /*
+     *  getBytesStarted
+     *
+     *  Returns the number of bytes started by the last service().
+     *
+     */
+    u32 getBytesStarted() const;
+
+    /*
+     *  getDeadlineMisses
+     *
+     *  Returns how many jobs were still unfinished when the last service()
+     *  reached their deadline.
+     *
+     */
+    u32 getDeadlineMisses() const;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ *  entity_store.h
+ *
+ *  Storage for large numbers of simple moving objects (ships, bullets,
+ *  aliens), kept as a structure of arrays.
+ *
+ *  Instead of one heap object per entity, each property lives in its own
+ *  array: all the x positions together, all the y velocities together, and
+ *  so on. Live entities are packed at the front of the arrays, so an update
+ *  kernel is a single loop over exactly the data it needs. The ARM9 data
+ *  cache is only 4KB with 32-byte lines, so a loop that reads every byte of
+ *  each line it loads gets far more out of it than one that hops between
+ *  scattered objects.
+ *
+ *  Packing the arrays means entities move around when others are destroyed,
+ *  so the rest of the game refers to them by EntityHandle, which stays the
+ *  same for the entity's whole life.
+ *
+ */
+
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <nds.h>
+#include "fixed.h"
+#include "oam_shadow.h"
+#include "ship.h"
+
+/*
+ *  EntityHandle
+ *
+ *  The low 16 bits pick a slot in the store and the high 16 bits hold the
+ *  slot's generation, which changes every time the slot is reused. A handle
+ *  to a destroyed entity never matches its slot again, so it can be safely
+ *  detected instead of quietly referring to whatever moved in after it.
+ */
+typedef u32 EntityHandle;
+
+/* No generation is ever 0, so this handle is never valid. */
+static const EntityHandle INVALID_ENTITY = 0;
+
+enum EntityKind {
+    ENTITY_SHIP,
+    ENTITY_BULLET,
+    ENTITY_ALIEN,
+};
+
+/* An entity without a sprite of its own. */
+static const u16 NO_SPRITE = 0xFFFF;
+
+/* An entity that lives until it is destroyed. */
+static const u16 LIFETIME_FOREVER = 0;
+
+class EntityStore {
+public:
+    static const int MAX_ENTITIES = 1024;
+
+protected:
+    /*
+     *  Entity Data
+     *
+     *  Indexed by dense index. Entries [0, count) are live. Positions and
+     *  velocities are raw 20.12 fixed-point values, and angles are in libnds
+     *  degrees.
+     */
+    s32 positionX[MAX_ENTITIES];
+    s32 positionY[MAX_ENTITIES];
+    s32 velocityX[MAX_ENTITIES];
+    s32 velocityY[MAX_ENTITIES];
+    s16 angle[MAX_ENTITIES];
+    u16 sprite[MAX_ENTITIES];
+    u16 lifetime[MAX_ENTITIES];
+    u8 kind[MAX_ENTITIES];
+    int count;
+
+    /*
+     *  Handle Bookkeeping
+     *
+     *  denseToSlot maps an entity back to its slot, so its slot can be
+     *  updated when it is moved. Each slot holds the dense index of its
+     *  entity and its generation. Unused slots form a stack in freeSlots.
+     */
+    u16 denseToSlot[MAX_ENTITIES];
+    u16 slotToDense[MAX_ENTITIES];
+    u16 slotGeneration[MAX_ENTITIES];
+    u16 freeSlots[MAX_ENTITIES];
+    int freeCount;
+
+    /*
+     *  removeAt
+     *
+     *  Remove the entity at a dense index by moving the last entity into
+     *  its place.
+     *
+     */
+    void removeAt(int index);
+
+public:
+    /*
+     *  EntityStore
+     *
+     *  Create an empty store.
+     *
+     */
+    EntityStore();
+
+    /*
+     *  create
+     *
+     *  Add an entity and return its handle, or INVALID_ENTITY if the store
+     *  is full. _sprite is the OAM id the entity drives (or NO_SPRITE), and
+     *  an entity with a _lifetime other than LIFETIME_FOREVER is destroyed
+     *  by age() after that many frames.
+     *
+     */
+    EntityHandle create(EntityKind _kind, MathVector2D<fixed> position,
+                        MathVector2D<fixed> velocity, int _angle,
+                        u16 _sprite = NO_SPRITE,
+                        u16 _lifetime = LIFETIME_FOREVER);
+
+    /*
+     *  destroy
+     *
+     *  Remove an entity. Destroying a stale handle does nothing.
+     *
+     */
+    void destroy(EntityHandle handle);
+
+    /*
+     *  indexOf
+     *
+     *  Returns the current dense index of an entity, or -1 if the handle is
+     *  stale. Dense indices are only good until the next create() or
+     *  destroy().
+     *
+     */
+    int indexOf(EntityHandle handle) const;
+
+    bool isAlive(EntityHandle handle) const { return indexOf(handle) >= 0; }
+
+    int getCount() const { return count; }
+
+    /*
+     *  Per-entity Access
+     *
+     *  These take a handle that must be alive.
+     */
+    MathVector2D<fixed> getPosition(EntityHandle handle) const;
+    void setPosition(EntityHandle handle, MathVector2D<fixed> position);
+    MathVector2D<fixed> getVelocity(EntityHandle handle) const;
+    void setVelocity(EntityHandle handle, MathVector2D<fixed> velocity);
+    int getAngle(EntityHandle handle) const;
+    void setAngle(EntityHandle handle, int _angle);
+
+    /*
+     *  integrate
+     *
+     *  Move every entity by its velocity, wrapping positions around the
+     *  WORLD_WIDTH by WORLD_HEIGHT space. This is Ship::moveShip() for the
+     *  whole store at once.
+     *
+     */
+    void integrate();
+
+    /*
+     *  age
+     *
+     *  Count down the lifetime of every mortal entity, destroying those
+     *  that reach zero and hiding their sprites. Returns how many were
+     *  destroyed.
+     *
+     */
+    int age(OAMShadow * oamShadow);
+
+    /*
+     *  writeSprites
+     *
+     *  Place the sprite of every entity that has one on screen, as seen
+     *  from view (see Camera::getView()), and mark its OAM entry dirty. A
+     *  sprite well off screen is hidden until it comes back. Entity sprites
+     *  must not be affine, and no bigger than 64x64.
+     *
+     */
+    void writeSprites(OAMShadow * oamShadow, MathVector2D<int> view) const;
+};
+
+#endif
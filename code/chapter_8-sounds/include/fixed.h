@@ -0,0 +1,93 @@
+/*
+ *  fixed.h
+ *
+ *  A small fixed-point number type for the game's kinematics.
+ *
+ *  The ARM9 has no floating-point unit, so every float operation is
+ *  performed by a software routine in libgcc. Storing values as 20.12 fixed
+ *  point (the same format libnds uses for its f32 helpers and the 3D engine)
+ *  lets us do all of our per-frame math with plain integer instructions.
+ *
+ */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <nds.h>
+
+class fixed {
+public:
+    /*
+     *  Number of fractional bits. 12 fractional bits matches the output of
+     *  sinLerp() and cosLerp(), so trigonometry results can be used without
+     *  any shifting.
+     */
+    static const int FRACTION_BITS = 12;
+    static const s32 ONE = 1 << FRACTION_BITS;
+
+    /* The raw 20.12 representation. */
+    s32 raw;
+
+    fixed() : raw(0) {}
+
+    /*
+     *  fromRaw
+     *
+     *  Build a fixed from an already scaled 20.12 value, such as the result
+     *  of sinLerp().
+     *
+     */
+    static fixed fromRaw(s32 value) {
+        fixed f;
+        f.raw = value;
+        return f;
+    }
+
+    static fixed fromInt(int value) { return fromRaw(value << FRACTION_BITS); }
+
+    /*
+     *  fromFloat
+     *
+     *  Only use this for constants. The compiler folds the multiplication
+     *  away when the argument is known at compile time; at run time it would
+     *  pull in the soft-float routines we are trying to avoid.
+     *
+     */
+    static fixed fromFloat(float value) {
+        return fromRaw((s32)(value * ONE + (value < 0 ? -0.5f : 0.5f)));
+    }
+
+    /* Truncate towards negative infinity, as the hardware does with pixels. */
+    int toInt() const { return raw >> FRACTION_BITS; }
+
+    float toFloat() const { return (float)raw / ONE; }
+
+    fixed operator+(fixed other) const { return fromRaw(raw + other.raw); }
+    fixed operator-(fixed other) const { return fromRaw(raw - other.raw); }
+    fixed operator-() const { return fromRaw(-raw); }
+
+    /*
+     *  The product of two 20.12 numbers has 24 fractional bits, so widen to
+     *  64 bits before shifting back down to keep the integer part.
+     */
+    fixed operator*(fixed other) const {
+        return fromRaw((s32)(((s64)raw * other.raw) >> FRACTION_BITS));
+    }
+
+    fixed operator/(fixed other) const {
+        return fromRaw((s32)(((s64)raw << FRACTION_BITS) / other.raw));
+    }
+
+    fixed & operator+=(fixed other) { raw += other.raw; return *this; }
+    fixed & operator-=(fixed other) { raw -= other.raw; return *this; }
+    fixed & operator*=(fixed other) { *this = *this * other; return *this; }
+
+    bool operator<(fixed other) const { return raw < other.raw; }
+    bool operator>(fixed other) const { return raw > other.raw; }
+    bool operator<=(fixed other) const { return raw <= other.raw; }
+    bool operator>=(fixed other) const { return raw >= other.raw; }
+    bool operator==(fixed other) const { return raw == other.raw; }
+    bool operator!=(fixed other) const { return raw != other.raw; }
+};
+
+#endif
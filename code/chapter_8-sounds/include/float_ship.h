@@ -0,0 +1,58 @@
+/*
+ *  float_ship.h
+ *
+ *  A float port of Ship's kinematics (see ship.h), with the angle in
+ *  radians instead of libnds degrees.
+ *
+ *  The game doesn't fly this ship. It is kept as a reference: checks fly it
+ *  next to the fixed-point Ship to make sure the two follow the same path,
+ *  and benchmarks time it against Ship to show what the soft-float maths
+ *  would cost on the ARM9, which has no FPU.
+ *
+ */
+
+#ifndef FLOAT_SHIP_H
+#define FLOAT_SHIP_H
+
+struct FloatShip {
+    /* Position and velocity in pixels, and the angle in radians. */
+    float x, y;
+    float vx, vy;
+    float angle;
+
+    /*
+     *  Ship's turn speed and thrust, rounded to libnds degrees and to fixed
+     *  just as Ship's are, so the two ships steer the same way.
+     *
+     */
+    static const float TURN_SPEED;
+    static const float THRUST;
+
+    /*
+     *  accelerate
+     *
+     *  Thrust along the angle, limiting the speed to 1 pixel per frame in
+     *  any direction, as Ship::accelerate() does.
+     *
+     */
+    void accelerate();
+
+    /*
+     *  move
+     *
+     *  Move by the velocity, wrapping around the world.
+     *
+     */
+    void move();
+
+    /*
+     *  turnClockwise, turnCounterClockwise
+     *
+     *  Turn by the turn speed.
+     *
+     */
+    void turnClockwise();
+    void turnCounterClockwise();
+};
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ *  game_loop.h
+ *
+ *  Runs the game simulation at a fixed rate, no matter how long each frame
+ *  takes to draw.
+ *
+ *  If the game simply moved everything once per frame, a frame that ran
+ *  long and missed a VBlank would make the whole game run in slow motion.
+ *  Instead, the loop measures how much time has really passed (in
+ *  scanlines, which is the finest clock the video hardware gives us for
+ *  free) and runs however many fixed-length simulation ticks fit into it.
+ *  Time left over carries to the next frame. Since every tick is the same
+ *  length, the simulation does exactly the same thing given the same
+ *  input, however fast or slow the frames are.
+ *
+ *  Sprites are then drawn part of the way between the state before and
+ *  after the last tick (see getAlpha()), so motion stays smooth even when
+ *  ticks and frames don't line up.
+ *
+ */
+
+#ifndef GAME_LOOP_H
+#define GAME_LOOP_H
+
+#include <nds.h>
+#include "fixed.h"
+#include "ship.h"
+
+/* A whole frame: 192 visible lines plus 71 lines of VBlank. */
+static const int LINES_PER_FRAME = 263;
+
+class GameLoop {
+protected:
+    /* How long a simulation tick is, in scanlines. */
+    int tickLines;
+
+    /* The most ticks we will run in one frame to catch up. */
+    int maxCatchUp;
+
+    /* Time not yet simulated, in scanlines. */
+    int accumulator;
+
+    /* The clock at the last call to beginFrame(). */
+    u32 lastTime;
+
+    /* Statistics */
+    u32 droppedFrames;
+    u32 droppedTicks;
+
+    /* VBlanks since we started counting, bumped by the interrupt. */
+    static volatile u32 vblankCount;
+    static void onVBlank();
+
+public:
+    /*
+     *  GameLoop
+     *
+     *  Simulate in ticks of _tickLines scanlines (LINES_PER_FRAME gives one
+     *  tick per frame, at about 60 ticks per second). At most _maxCatchUp
+     *  ticks are run in one frame. If the game falls further behind than
+     *  that, the extra time is thrown away and the game slows down instead
+     *  of trying ever harder to catch up.
+     *
+     */
+    GameLoop(int _tickLines = LINES_PER_FRAME, int _maxCatchUp = 4);
+
+    /*
+     *  start
+     *
+     *  Install the VBlank interrupt handler that drives the clock, and
+     *  start counting time from now.
+     *
+     */
+    void start();
+
+    /*
+     *  now
+     *
+     *  Returns the number of scanlines drawn since start().
+     *
+     */
+    static u32 now();
+
+    /*
+     *  waitForLine
+     *
+     *  Wait until the display is drawing the given line of the screen. If
+     *  it is already past it, wait for the next frame's.
+     *
+     */
+    static void waitForLine(int line);
+
+    /*
+     *  beginFrame
+     *
+     *  Account for the time since the last call and return how many ticks
+     *  to simulate this frame. Usually this is 1. It is 0 when frames come
+     *  faster than ticks, and more than 1 when a frame ran long.
+     *
+     */
+    int beginFrame();
+
+    /*
+     *  getAlpha
+     *
+     *  Returns how far time has moved on past the last tick, as a fraction
+     *  of a tick from 0 up to (but not including) 1. Draw things this far
+     *  from where they were before the last tick towards where they are
+     *  now.
+     *
+     */
+    fixed getAlpha() const;
+
+    /*
+     *  interpolate
+     *
+     *  Returns the position getAlpha() of the way from previous to current,
+     *  taking the short way round the wrapped world.
+     *
+     */
+    MathVector2D<fixed> interpolate(MathVector2D<fixed> previous,
+                                    MathVector2D<fixed> current) const;
+
+    /*
+     *  getDroppedFrames
+     *
+     *  Returns how many VBlanks passed without a new frame being started,
+     *  because the frame before them took too long.
+     *
+     */
+    u32 getDroppedFrames() const { return droppedFrames; }
+
+    /*
+     *  getDroppedTicks
+     *
+     *  Returns how many ticks were thrown away because the game was more
+     *  than maxCatchUp ticks behind.
+     *
+     */
+    u32 getDroppedTicks() const { return droppedTicks; }
+
+    /*
+     *  getTickLag
+     *
+     *  Returns how far the simulation is behind real time, in scanlines.
+     *
+     */
+    int getTickLag() const { return accumulator; }
+};
+
+#endif
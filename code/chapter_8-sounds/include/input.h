@@ -0,0 +1,142 @@
+/*
+ *  input.h
+ *
+ *  The player's input for one simulation tick, and a way to record it and
+ *  play it back.
+ *
+ *  The game never asks libnds for keys directly. Instead, each tick starts
+ *  by filling out an InputState, either from the hardware or from a
+ *  recording, and the game reacts only to that. Since the simulation is
+ *  fixed-point and runs in fixed ticks (see game_loop.h), playing back a
+ *  recording makes the game do exactly what it did when it was recorded.
+ *  That makes for repeatable profiling runs in an emulator.
+ *
+ *  Most ticks look just like the one before, so recordings only store what
+ *  changed. Each tick starts with a byte of flags:
+ *
+ *      bit 7       The held keys changed. Two bytes follow with the new
+ *                  keys, low byte first.
+ *      bit 6       The touch position changed. Two bytes follow with the
+ *                  new x and y.
+ *      bits 0-5    If neither changed, the number of ticks after this one
+ *                  that didn't change either.
+ *
+ *  A player who isn't doing anything costs one byte every 64 ticks.
+ *
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <nds.h>
+
+/*
+ *  InputState
+ *
+ *  What the player is doing this tick. down holds the keys that were
+ *  pressed since the last tick. touchX and touchY only mean something while
+ *  KEY_TOUCH is held, and otherwise keep their last value.
+ */
+typedef struct {
+    u16 held;
+    u16 down;
+    u8 touchX;
+    u8 touchY;
+} InputState;
+
+/*
+ *  nextInputState
+ *
+ *  Fill out the state for a new tick from the keys held now and the state
+ *  of the tick before. Live and recorded input both go through here, so
+ *  they agree exactly.
+ *
+ */
+void nextInputState(InputState * state, u16 held, int touchX, int touchY);
+
+class InputRecording {
+public:
+    /* Room for a few minutes of busy play, or much more of calm play. */
+    static const int MAX_BYTES = 32 * 1024;
+
+protected:
+    u8 data[MAX_BYTES];
+    int length;
+    int tickCount;
+
+    /* The byte counting the current run of unchanged ticks, or -1. */
+    int runByte;
+
+    /* Where the next tick is read from, when playing back. */
+    int readPosition;
+    int ticksRead;
+    int repeatsLeft;
+
+    /* The state of the last tick recorded or played back. */
+    InputState last;
+
+    bool full;
+
+    void reset();
+
+public:
+    /*
+     *  InputRecording
+     *
+     *  Create an empty recording.
+     *
+     */
+    InputRecording();
+
+    /*
+     *  record
+     *
+     *  Add a tick to the end of the recording. Returns false, and records
+     *  nothing, once the recording is full.
+     *
+     */
+    bool record(const InputState * state);
+
+    /*
+     *  rewind
+     *
+     *  Go back to the start of the recording, to play it back.
+     *
+     */
+    void rewind();
+
+    /*
+     *  replay
+     *
+     *  Fill out the next recorded tick. Returns false when there are no
+     *  more ticks, or when the recording's data runs out before its tick
+     *  count does.
+     *
+     */
+    bool replay(InputState * state);
+
+    /*
+     *  save
+     *
+     *  Write the recording to a file, such as "fat:/input.rec". Returns
+     *  false if the file couldn't be written.
+     *
+     */
+    bool save(const char * path) const;
+
+    /*
+     *  load
+     *
+     *  Read a recording saved by save(), ready to play back. This works
+     *  from FAT or from NitroFS. Returns false if the file is missing or
+     *  isn't a recording.
+     *
+     */
+    bool load(const char * path);
+
+    int getLength() const { return length; }
+    int getTickCount() const { return tickCount; }
+    bool isFull() const { return full; }
+};
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ *  kinematics_reference.h
+ *
+ *  Older versions of the ship's maths, kept so that the benchmarks can time
+ *  the current versions against them, on the host and on the DS.
+ *
+ *  The game doesn't use any of this.
+ *
+ */
+
+#ifndef KINEMATICS_REFERENCE_H
+#define KINEMATICS_REFERENCE_H
+
+#include <nds.h>
+#include "fixed.h"
+#include "ship.h"
+
+/*
+ *  accelerateAxisClamp
+ *
+ *  Thrust along angle the way Ship::accelerate() used to, clamping each
+ *  axis of velocity to the maximum speed on its own. That let the ship go
+ *  faster diagonally than straight.
+ *
+ */
+void accelerateAxisClamp(MathVector2D<fixed> * velocity, int angle);
+
+/*
+ *  atan2Float
+ *
+ *  The angle of the vector (x, y), in libnds degrees, the way
+ *  Ship::reverseTurn() used to find it: with atan2f() on floats. Compare
+ *  with atan2Lerp() (see trig.h).
+ *
+ */
+s32 atan2Float(s32 y, s32 x);
+
+#endif
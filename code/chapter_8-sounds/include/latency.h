@@ -0,0 +1,98 @@
+/*
+ *  latency.h
+ *
+ *  Measures how long it takes from pressing a button to seeing the ship
+ *  react on screen.
+ *
+ *  A trace follows one press through the frame. When a D-pad press is read
+ *  (latencySample()), the time is noted. When the game changes a sprite's
+ *  object because of it (latencyTag()), the trace is tied to that sprite.
+ *  When OAMShadow::commit() next uploads the sprite's entry
+ *  (latencyCommit()), the trace is done: the sprite appears when the
+ *  display next reaches its top line, and the time from the press to then
+ *  goes into a histogram. One press is traced at a time.
+ *
+ *  All times are in scanlines (see GameLoop::now()). A frame is 263 lines,
+ *  so a game that reads input at the start of a frame and shows the result
+ *  on the next one has about a frame and a half of latency.
+ *
+ *  The tracer only exists when building with -DLATENCY_TRACE (see the
+ *  Makefile). Otherwise every function here compiles to nothing.
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <nds.h>
+
+/* Each histogram bucket covers this many scanlines... */
+static const int LATENCY_BUCKET_LINES = 32;
+
+/* ...and the last one also counts anything longer. */
+static const int LATENCY_BUCKETS = 32;
+
+/* The presses we trace. */
+static const u16 LATENCY_KEYS = KEY_UP | KEY_DOWN | KEY_LEFT | KEY_RIGHT;
+
+/*
+ *  LatencyStats
+ *
+ *  Everything measured so far, in scanlines.
+ */
+typedef struct {
+    u32 count;
+    u32 min;
+    u32 max;
+    u32 total;
+    u32 buckets[LATENCY_BUCKETS];
+} LatencyStats;
+
+#ifdef LATENCY_TRACE
+
+/*
+ *  latencySample
+ *
+ *  Call with the keys pressed each time input is read. A press of any of
+ *  LATENCY_KEYS starts a new trace, unless one is already waiting for its
+ *  sprite to be uploaded.
+ *
+ */
+void latencySample(u16 down);
+
+/*
+ *  latencyTag
+ *
+ *  Call when the traced press changed what a sprite will look like. The
+ *  sprite's entry must be in our OAM copy, so we know which line it starts
+ *  on when it is uploaded.
+ *
+ */
+void latencyTag(int oamId, const SpriteEntry * entry);
+
+/*
+ *  latencyCommit
+ *
+ *  Call from OAMShadow::commit() with the dirty entry bits, before they are
+ *  cleared. Finishes the trace if its sprite is being uploaded.
+ *
+ */
+void latencyCommit(const u32 * dirtyEntries);
+
+/*
+ *  latencyGetStats
+ *
+ *  Returns everything measured so far.
+ *
+ */
+const LatencyStats * latencyGetStats();
+
+#else
+
+static inline void latencySample(u16) {}
+static inline void latencyTag(int, const SpriteEntry *) {}
+static inline void latencyCommit(const u32 *) {}
+
+#endif
+
+#endif
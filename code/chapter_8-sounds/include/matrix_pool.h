@@ -0,0 +1,111 @@
+/*
+ *  matrix_pool.h
+ *
+ *  Hands out the 32 hardware affine matrices (SpriteRotation) by reference
+ *  count, instead of tying matrix n to OAM entry n.
+ *
+ *  Sprites that want the same rotation and scale share one matrix. Angles
+ *  can be quantized, so that lots of sprites at nearly the same angle (a
+ *  spray of bullets, a field of asteroids) end up sharing too.
+ *
+ */
+
+#ifndef MATRIX_POOL_H
+#define MATRIX_POOL_H
+
+#include <nds.h>
+#include "oam_shadow.h"
+
+/* A scale of 1.0 in the 8.8 fixed-point format the matrices use. */
+static const int MATRIX_SCALE_ONE = 1 << 8;
+
+class MatrixPool {
+protected:
+    struct Slot {
+        int angle;
+        int scale;
+        int refCount;
+        bool valid;
+    };
+    Slot slots[MATRIX_COUNT];
+
+    OAMShadow * oamShadow;
+
+    /* Angles are rounded to a multiple of this many libnds degrees. */
+    int angleStep;
+
+    /* Statistics for the current frame */
+    int fallbacks;
+
+    int quantize(int angle) const;
+    int find(int angle, int scale) const;
+    void write(int matrixId, int angle, int scale);
+
+public:
+    /*
+     *  MatrixPool
+     *
+     *  Manage the matrices in _oamShadow's OAM copy. Angles are rounded to
+     *  the nearest multiple of _angleStep; use 1 to keep every angle exact.
+     *
+     */
+    MatrixPool(OAMShadow * _oamShadow, int _angleStep = 1);
+
+    /*
+     *  acquire
+     *
+     *  Returns the index of a matrix that rotates counter-clockwise by angle
+     *  (in libnds degrees) and scales by scale (8.8 fixed point), taking a
+     *  reference to it. An existing matrix with the same key is reused.
+     *
+     *  When all 32 matrices are in use by other transforms, the closest
+     *  existing transform with the same scale is shared instead (or, failing
+     *  that, the closest angle at any scale), and the fallback is counted.
+     *
+     */
+    int acquire(int angle, int scale = MATRIX_SCALE_ONE);
+
+    /*
+     *  release
+     *
+     *  Drop a reference taken with acquire().
+     *
+     */
+    void release(int matrixId);
+
+    /*
+     *  update
+     *
+     *  Swap the reference held on matrixId for one matching the new angle
+     *  and scale. Returns the (possibly unchanged) matrix index.
+     *
+     */
+    int update(int matrixId, int angle, int scale = MATRIX_SCALE_ONE);
+
+    /*
+     *  beginFrame
+     *
+     *  Reset the per-frame statistics.
+     *
+     */
+    void beginFrame();
+
+    /*
+     *  getUsedCount
+     *
+     *  Returns the number of matrices currently referenced.
+     *
+     */
+    int getUsedCount() const;
+
+    /*
+     *  getFallbackCount
+     *
+     *  Returns how many acquires this frame had to share an approximate
+     *  matrix because the pool was full.
+     *
+     */
+    int getFallbackCount() const;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ *  oam_shadow.h
+ *
+ *  Tracks which parts of our OAM copy changed since they were last uploaded,
+ *  so we only spend VBlank time copying what actually changed.
+ *
+ */
+
+#ifndef OAM_SHADOW_H
+#define OAM_SHADOW_H
+
+#include <nds.h>
+
+class OAMShadow {
+protected:
+    /*
+     *  Dirty Tracking
+     *
+     *  One bit per SpriteEntry and one bit per SpriteRotation. Remember that
+     *  the rotation matrices live in the fourth halfword of the sprite
+     *  entries (matrix n is spread over entries 4n to 4n + 3), so a dirty
+     *  matrix does not need its whole sprite entries uploaded.
+     */
+    u32 dirtyEntries[SPRITE_COUNT / 32];
+    u32 dirtyMatrices;
+
+    /* The number of bytes written to OAM by the last call to commit(). */
+    u32 bytesTransferred;
+
+    /* DMA can't read our copy if it lives in DTCM (see tcm.h). */
+    bool tableInDtcm;
+
+    /*
+     *  uploadEntries
+     *
+     *  Copy a contiguous run of sprite entries (including the matrix
+     *  halfwords that live inside them) to OAM. Long runs are copied with
+     *  DMA, short ones by the CPU, as setting up DMA and flushing the cache
+     *  costs more than just copying a few words. When the table is in DTCM,
+     *  the CPU copies everything. It is quick at it there, and DMA can't
+     *  see DTCM anyway.
+     *
+     */
+    void uploadEntries(int first, int count);
+
+    /*
+     *  uploadMatrix
+     *
+     *  Copy the four halfwords of a single rotation matrix to OAM.
+     *
+     */
+    void uploadMatrix(int matrixId);
+
+public:
+    /*
+     *  DMA_THRESHOLD
+     *
+     *  Runs of at least this many bytes are sent by DMA, shorter runs are
+     *  copied with CPU stores. Does not apply to a table in DTCM.
+     */
+    static const u32 DMA_THRESHOLD = 64;
+
+    /* Our copy of OAM. This is what the game modifies. */
+    OAMTable * table;
+
+    /*
+     *  OAMShadow
+     *
+     *  Create a shadow for the OAM copy pointed to by _table. Everything
+     *  starts out dirty, so the first commit uploads the whole table.
+     *
+     */
+    OAMShadow(OAMTable * _table);
+
+    /*
+     *  markEntry
+     *
+     *  Note that attributes 0 to 2 of a sprite entry have changed.
+     *
+     */
+    void markEntry(int oamId);
+
+    /*
+     *  markMatrix
+     *
+     *  Note that a rotation matrix has changed.
+     *
+     */
+    void markMatrix(int matrixId);
+
+    /*
+     *  markAll
+     *
+     *  Force the next commit to upload the whole table.
+     *
+     */
+    void markAll();
+
+    /*
+     *  commit
+     *
+     *  Upload everything that changed since the last commit to OAM, then
+     *  clear the dirty state. This must be called during VBlank.
+     *
+     */
+    void commit();
+
+    /*
+     *  getBytesTransferred
+     *
+     *  Returns the number of bytes written to OAM by the last commit.
+     *
+     */
+    u32 getBytesTransferred() const;
+};
+
+#endif
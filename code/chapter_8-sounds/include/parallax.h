@@ -0,0 +1,155 @@
+/*
+ *  parallax.h
+ *
+ *  Scrolls the backgrounds at different rates as the camera moves, so the
+ *  far away ones seem further away.
+ *
+ *  The star field is the furthest away, so it moves the least. The planet
+ *  is closer and moves more. Both are given as a rate, which is how many
+ *  pixels the layer scrolls for each pixel the camera moves.
+ *
+ *  The star field can also be shifted sideways by a different amount on
+ *  every line of the screen. The background's X scroll is written by an
+ *  HBlank DMA, which copies the next line's value from a table into the
+ *  scroll register as each line is finished. Building the table costs a
+ *  little CPU time every frame, and nothing at all while it is drawn. The
+ *  table is leaned by the camera's sideways speed, with the bottom of the
+ *  screen, which is taken to be nearer, moving further, which gives the
+ *  star field some depth.
+ *
+ *  There are two tables. A new one is built while the other is being
+ *  copied by the DMA, and the two are swapped during VBlank, so a table is
+ *  never changed part way down the screen.
+ *
+ */
+
+#ifndef PARALLAX_H
+#define PARALLAX_H
+
+#include <nds.h>
+#include "fixed.h"
+#include "tiled_background.h"
+
+class Parallax {
+public:
+    /* The DMA channel that copies the line table. */
+    static const int DMA_CHANNEL = 0;
+
+    /*
+     *  How far a line may be shifted from the camera. The star field loads
+     *  this much extra to either side of the screen.
+     */
+    static const int MAX_LINE_OFFSET = TiledBackground::MARGIN_COLUMNS * 8;
+
+protected:
+    TiledBackground * starField;
+    int planetId;
+
+    /* The star field's X scroll register, which the DMA writes to. */
+    vs32 * lineRegister;
+
+    /* How far each layer scrolls for each pixel the camera moves. */
+    fixed starFieldRate;
+    fixed planetRate;
+
+    /* Where the planet is on screen while the camera is at 0, 0. */
+    int planetX;
+    int planetY;
+
+    /* How many pixels each line is shifted, per line from the middle. */
+    fixed lean;
+
+    /* The scroll of each layer, as worked out by the last build(). */
+    int starFieldX;
+    int starFieldY;
+    int planetScrollX;
+    int planetScrollY;
+
+    /* The camera position, in world pixels. It doesn't wrap. */
+    fixed cameraX;
+    fixed cameraY;
+
+    /*
+     *  The star field's X scroll for each line, as 20.8 fixed point, in
+     *  the form the register takes. There is one extra line, as the DMA
+     *  copies one more after the last line is drawn.
+     */
+    s32 lineTables[2][SCREEN_HEIGHT + 1];
+
+    /* The table the DMA copies from. The other is built. */
+    int front;
+    bool backReady;
+
+    void startLineDma();
+    void stopLineDma();
+
+public:
+    /*
+     *  Parallax
+     *
+     *  Scroll the star field, which is main background _starFieldId and
+     *  shown by _starField, and the planet, which is background _planetId
+     *  at _planetX, _planetY on screen. Both must be rotation backgrounds,
+     *  2 or 3, without any rotation or scaling.
+     *
+     */
+    Parallax(TiledBackground * _starField, int _starFieldId, int _planetId,
+             int _planetX, int _planetY);
+
+    /*
+     *  ~Parallax
+     *
+     *  Stop the line DMA.
+     *
+     */
+    ~Parallax();
+
+    /*
+     *  setRates
+     *
+     *  Set how many pixels the star field and the planet scroll for each
+     *  pixel the camera moves.
+     *
+     */
+    void setRates(fixed _starFieldRate, fixed _planetRate);
+
+    /*
+     *  setLean
+     *
+     *  Set how many pixels each line of the star field is shifted for each
+     *  line it is below the middle of the screen. Lines are never shifted
+     *  more than MAX_LINE_OFFSET. A lean of 0 turns the line table off.
+     *
+     */
+    void setLean(fixed _lean);
+
+    /*
+     *  setCamera
+     *
+     *  Set where the camera is in the world. This should move smoothly, and
+     *  not jump back when the world wraps around.
+     *
+     */
+    void setCamera(fixed x, fixed y);
+
+    /*
+     *  build
+     *
+     *  Work out the scroll of each layer, and build the next line table.
+     *  Call this once a frame before VBlank.
+     *
+     */
+    void build();
+
+    /*
+     *  update
+     *
+     *  Scroll the layers, and restart the line DMA on the newest table.
+     *  Call this during VBlank. It calls update() on the star field, and
+     *  then bgUpdate(), which the line table has to follow.
+     *
+     */
+    void update();
+};
+
+#endif
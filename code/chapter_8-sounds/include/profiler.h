@@ -0,0 +1,145 @@
+/*
+ *  profiler.h
+ *
+ *  A lightweight frame profiler built on the ARM9 hardware timers.
+ *
+ *  Wrap a piece of code in a zone with PROFILE_SCOPE(zone) and the time
+ *  spent in it is added up each frame. The last PROFILE_HISTORY frames are
+ *  kept, so we can report the minimum, average and maximum time each zone
+ *  takes. Results are drawn as bars over the top of the sub screen and
+ *  printed to the no$gba/melonDS debug console.
+ *
+ *  The profiler only exists when building with -DPROFILER (see the
+ *  Makefile). Otherwise every macro and function here compiles to nothing.
+ *
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <nds.h>
+
+/* The pieces of the frame we time. */
+enum ProfileZone {
+    PROFILE_UPDATE_INPUT,
+    PROFILE_HANDLE_INPUT,
+    PROFILE_MOVE_SHIP,
+    PROFILE_ROTATE_SPRITE,
+    PROFILE_UPDATE_OAM,
+    PROFILE_STREAM_AUDIO,
+    PROFILE_SCROLL_TABLES,
+    PROFILE_ZONE_COUNT
+};
+
+/* Values we report as they are, rather than time. */
+enum ProfileCounter {
+    PROFILE_COUNTER_DROPPED_FRAMES,
+    PROFILE_COUNTER_DROPPED_TICKS,
+    PROFILE_COUNTER_TICK_LAG,
+    PROFILE_COUNTER_AUDIO_UNDERRUNS,
+    PROFILE_COUNTER_SFX_VOICES,
+    PROFILE_COUNTER_SFX_DROPPED,
+    PROFILE_COUNTER_CULLED_SPRITES,
+    PROFILE_COUNTER_COUNT
+};
+
+/*
+ *  ProfileStats
+ *
+ *  Timings of a zone over the recorded history, in timer ticks (BUS_CLOCK
+ *  ticks per second, or two ARM9 cycles per tick).
+ */
+typedef struct {
+    u32 min;
+    u32 avg;
+    u32 max;
+} ProfileStats;
+
+/* How many frames of timings to keep. */
+static const int PROFILE_HISTORY = 64;
+
+#ifdef PROFILER
+
+/*
+ *  profilerNow
+ *
+ *  Returns the current time from the cascaded profiler timers.
+ *
+ */
+u32 profilerNow();
+
+/*
+ *  profilerRecord
+ *
+ *  Add ticks to a zone's total for this frame.
+ *
+ */
+void profilerRecord(ProfileZone zone, u32 ticks);
+
+/*
+ *  ProfileScope
+ *
+ *  Times the lifetime of the object and records it against a zone.
+ */
+class ProfileScope {
+protected:
+    ProfileZone zone;
+    u32 start;
+
+public:
+    ProfileScope(ProfileZone _zone) : zone(_zone), start(profilerNow()) {}
+    ~ProfileScope() { profilerRecord(zone, profilerNow() - start); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(zone) \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(zone)
+
+/*
+ *  profilerInit
+ *
+ *  Start the profiler timers. This uses hardware timers 2 and 3.
+ *
+ */
+void profilerInit();
+
+/*
+ *  profilerEndFrame
+ *
+ *  Store this frame's zone timings in the history and start a new frame.
+ *  Every so often, this also updates the overlay and prints a report.
+ *
+ */
+void profilerEndFrame();
+
+/*
+ *  profilerGetStats
+ *
+ *  Fill out the min/avg/max timings of a zone.
+ *
+ */
+void profilerGetStats(ProfileZone zone, ProfileStats * out);
+
+/*
+ *  profilerSetCounter
+ *
+ *  Set a counter to be printed with the next report.
+ *
+ */
+void profilerSetCounter(ProfileCounter counter, u32 value);
+
+#else
+
+#define PROFILE_SCOPE(zone)
+
+static inline void profilerInit() {}
+static inline void profilerEndFrame() {}
+static inline void profilerGetStats(ProfileZone, ProfileStats * out) {
+    out->min = out->avg = out->max = 0;
+}
+static inline void profilerSetCounter(ProfileCounter, u32) {}
+
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ *  resource_cache.h
+ *
+ *  Loads game assets from NitroFS by name, and keeps the ones used most
+ *  recently in RAM.
+ *
+ *  Assets linked into the program with grit headers sit in main RAM for
+ *  the whole run, whether or not they are on screen. Assets in NitroFS
+ *  only take up RAM while they are loaded. The cache is given a budget,
+ *  and when loading something new would go over it, the assets that have
+ *  gone unused the longest are thrown out to make room. They can always
+ *  be loaded again later.
+ *
+ *  Code holding on to an asset acquire()s it, and release()s it when done.
+ *  An acquired asset is never thrown out. The data is handed out as it
+ *  sits in the cache, with no copy made. It is loaded into its own
+ *  cache-line aligned buffer and flushed out of the data cache, so it can
+ *  be DMAed straight to VRAM (see copyToVram()).
+ *
+ */
+
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+#include <nds.h>
+#include "dma_queue.h"
+
+/*
+ *  ResourceHandle
+ *
+ *  The low 16 bits pick a slot in the cache and the high 16 bits hold the
+ *  slot's generation, just like an EntityHandle. A handle to an asset that
+ *  has since been thrown out no longer matches its slot.
+ */
+typedef u32 ResourceHandle;
+
+/* No generation is ever 0, so this handle is never valid. */
+static const ResourceHandle INVALID_RESOURCE = 0;
+
+class ResourceCache {
+public:
+    static const int MAX_RESOURCES = 64;
+    static const int MAX_NAME_LENGTH = 31;
+    static const int MAX_PATH_LENGTH = 64;
+
+protected:
+    struct Entry {
+        char name[MAX_NAME_LENGTH + 1];
+        u8 * data;
+        u32 size;
+        u32 lastUsed;
+        int references;
+        u16 generation;
+    };
+    Entry entries[MAX_RESOURCES];
+
+    /* Where names are looked up, such as "nitro:/". */
+    char root[MAX_PATH_LENGTH];
+
+    u32 budget;
+    u32 usedBytes;
+
+    /* Counts acquires, so entries can tell which was used last. */
+    u32 clock;
+
+    /* Statistics */
+    u32 hits;
+    u32 misses;
+    u32 evictions;
+
+    Entry * lookup(ResourceHandle handle) const;
+    int find(const char * name) const;
+    void evict(int slot);
+    int evictOldest();
+    bool makeRoom(u32 bytes);
+    int load(const char * name);
+    static void onCopied(DmaFence fence, void * userData);
+
+public:
+    /*
+     *  ResourceCache
+     *
+     *  Create an empty cache that may hold up to _budget bytes of assets,
+     *  loaded from files under _root.
+     *
+     */
+    ResourceCache(u32 _budget, const char * _root = "nitro:/");
+
+    /*
+     *  ~ResourceCache
+     *
+     *  Free every loaded asset. Nothing may still be using them.
+     *
+     */
+    ~ResourceCache();
+
+    /*
+     *  acquire
+     *
+     *  Returns a handle to the named asset, loading it if it isn't loaded
+     *  already. Returns INVALID_RESOURCE if the file can't be read, or if
+     *  it won't fit in the budget even after throwing out everything that
+     *  isn't acquired.
+     *
+     */
+    ResourceHandle acquire(const char * name);
+
+    /*
+     *  release
+     *
+     *  Say that we are done with an asset. It stays loaded until its room
+     *  is needed.
+     *
+     */
+    void release(ResourceHandle handle);
+
+    /*
+     *  getData
+     *
+     *  Returns the asset's data, or NULL if the handle is no longer valid.
+     *
+     */
+    const void * getData(ResourceHandle handle) const;
+
+    /*
+     *  getSize
+     *
+     *  Returns the size of the asset in bytes, or 0 if the handle is no
+     *  longer valid.
+     *
+     */
+    u32 getSize(ResourceHandle handle) const;
+
+    /*
+     *  copyToVram
+     *
+     *  Queue a DMA copy of the whole asset to dst. The asset is kept
+     *  acquired until the copy is done, so the caller may release() it
+     *  straight away. Returns the copy's fence, or 0 if it couldn't be
+     *  queued.
+     *
+     */
+    DmaFence copyToVram(ResourceHandle handle, void * dst, DmaQueue * dmaQueue,
+                        int priority = 0);
+
+    /*
+     *  setBudget
+     *
+     *  Change how many bytes the cache may hold, throwing out assets that
+     *  aren't acquired until it is under the new budget.
+     *
+     */
+    void setBudget(u32 _budget);
+
+    u32 getBudget() const { return budget; }
+    u32 getUsedBytes() const { return usedBytes; }
+
+    /*
+     *  getHits, getMisses, getEvictions
+     *
+     *  Returns how many acquires found their asset already loaded, how
+     *  many had to load it, and how many assets were thrown out.
+     *
+     */
+    u32 getHits() const { return hits; }
+    u32 getMisses() const { return misses; }
+    u32 getEvictions() const { return evictions; }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ *  sfx.h
+ *
+ *  Decides which sound effects get to play, when more are asked for than
+ *  there are voices to play them.
+ *
+ *  maxmod plays each effect on a mixer channel of its own, and there are
+ *  only so many of them. Calling mmEffect() every time something happens
+ *  works until a screen full of bullets and explosions uses them all up,
+ *  and then maxmod starts cutting off whichever sounds it likes. Instead,
+ *  the game asks for effects with play(), and once per frame update()
+ *  starts the ones that matter most:
+ *
+ *    - The same effect asked for several times in one frame only plays
+ *      once. Ten bullets fired together sound like one bullet anyway.
+ *    - An effect can be limited to a number of copies at once, and to
+ *      starting no more often than every so many frames.
+ *    - When every voice is busy, the new effect takes the voice of a
+ *      lower (or equal) priority effect, picking the oldest or the
+ *      quietest of them. If every voice is playing something more
+ *      important, the new effect is dropped.
+ *    - Effects are panned by where on the screen they come from.
+ *
+ */
+
+#ifndef SFX_H
+#define SFX_H
+
+#include <maxmod9.h>
+#include <nds.h>
+
+/* Which voice to take when all of them are busy. */
+enum SfxStealPolicy {
+    SFX_STEAL_OLDEST,
+    SFX_STEAL_QUIETEST,
+};
+
+/* What happened to the effects asked for in the last frame. */
+typedef struct {
+    int voicesUsed;
+    int started;
+    int merged;
+    int stolen;
+    int dropped;
+} SfxStats;
+
+class SfxManager {
+public:
+    /* The most effects that may play at once. */
+    static const int MAX_VOICES = 8;
+
+    /* The most different effects that can be set up. */
+    static const int MAX_EFFECTS = 32;
+
+    /* The most effects that can be asked for in one frame. */
+    static const int MAX_REQUESTS = 16;
+
+protected:
+    struct Effect {
+        u8 priority;
+        u8 maxInstances;
+        u8 volume;
+        u8 minInterval;
+        u32 lastStart;
+        bool used;
+    };
+    Effect effects[MAX_EFFECTS];
+
+    struct Voice {
+        mm_sfxhand handle;
+        mm_word effectId;
+        u8 priority;
+        u8 volume;
+        u32 started;
+        bool active;
+    };
+    Voice voices[MAX_VOICES];
+
+    struct Request {
+        mm_word effectId;
+        int screenX;
+    };
+    Request requests[MAX_REQUESTS];
+    int requestCount;
+
+    SfxStealPolicy stealPolicy;
+    u32 frame;
+    SfxStats stats;
+    SfxStats pending;
+
+    void refreshVoices();
+    int countInstances(mm_word effectId) const;
+    int findOldestInstance(mm_word effectId) const;
+    int findVoice(int priority) const;
+    void start(const Request * request, int voice);
+
+public:
+    /*
+     *  SfxManager
+     *
+     *  Create a manager that takes voices according to stealPolicy.
+     *
+     */
+    SfxManager(SfxStealPolicy _stealPolicy = SFX_STEAL_OLDEST);
+
+    /*
+     *  setup
+     *
+     *  Load an effect from the soundbank and say how it should be played.
+     *  Higher priorities win. maxInstances limits how many copies play at
+     *  once, and an effect won't start again until minInterval frames
+     *  after it last started. volume goes from 0 to 255.
+     *
+     */
+    void setup(mm_word effectId, int priority, int maxInstances = 1,
+               int minInterval = 0, int volume = 255);
+
+    /*
+     *  play
+     *
+     *  Ask for an effect to play, coming from screenX on the screen. It
+     *  starts on the next call to update(), if it wins a voice.
+     *
+     */
+    void play(mm_word effectId, int screenX = SCREEN_WIDTH / 2);
+
+    /*
+     *  update
+     *
+     *  Start the effects asked for since the last update, and collect the
+     *  statistics. Call this once per frame.
+     *
+     */
+    void update();
+
+    /*
+     *  getStats
+     *
+     *  Returns what happened in the last call to update().
+     *
+     */
+    const SfxStats * getStats() const { return &stats; }
+};
+
+#endif
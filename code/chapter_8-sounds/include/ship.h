@@ -11,7 +11,7 @@
 #define SHIP_H
 
 #include <nds.h>
-#include <math.h>
+#include "fixed.h"
 #include "sprites.h"
 
 #define PI (3.14159265358979323846264338327)
@@ -24,6 +24,62 @@ struct MathVector2D {
     T y;
 };
 
+/*
+ *  MathVector2D<fixed>
+ *
+ *  The fixed-point vector gets a few arithmetic operators, since the ship's
+ *  kinematics are built out of vector additions and scales.
+ *
+ */
+template <>
+struct MathVector2D<fixed> {
+    fixed x;
+    fixed y;
+
+    MathVector2D<fixed> operator+(const MathVector2D<fixed> & other) const {
+        MathVector2D<fixed> result;
+        result.x = x + other.x;
+        result.y = y + other.y;
+        return result;
+    }
+
+    MathVector2D<fixed> & operator+=(const MathVector2D<fixed> & other) {
+        x += other.x;
+        y += other.y;
+        return *this;
+    }
+
+    MathVector2D<fixed> operator*(fixed scale) const {
+        MathVector2D<fixed> result;
+        result.x = x * scale;
+        result.y = y * scale;
+        return result;
+    }
+};
+
+/*
+ *  The size of the space the hardware wraps sprite coordinates around in. A
+ *  sprite's x coordinate is 9 bits wide and its y coordinate is 8 bits wide.
+ *
+ *  The background maps don't change it. The star field (see
+ *  tiled_background.h) repeats its own 256x192 picture, scrolled at a
+ *  quarter of the camera's speed, so it lines up with nothing in the world
+ *  anyway. Everything that wraps masks by these sizes, and the collision
+ *  grid is sized from them, so they must stay powers of two.
+ */
+static const int WORLD_WIDTH = 512;
+static const int WORLD_HEIGHT = 256;
+
+/*
+ *  worldDelta
+ *
+ *  Returns how far it is from one world position to another, taking the
+ *  short way round the wrapped world.
+ *
+ */
+MathVector2D<fixed> worldDelta(MathVector2D<fixed> from,
+                               MathVector2D<fixed> to);
+
 class Ship {
 protected:
     /*
@@ -39,35 +95,28 @@ protected:
      *  Kinematic Dynamics
      *
      *  These variables track dynamic kinematic properties of the ship.
-     *  Position and velocity is stored as two dimensional floating-point
+     *  Position and velocity is stored as two dimensional fixed-point
      *  vectors (in the mathematical context, not the STL context). The angle
-     *  of the ship is stored in radians in a float.
+     *  of the ship is stored in the libnds angle system, where a full circle
+     *  is DEGREES_IN_CIRCLE units, so it can be passed straight to sinLerp()
+     *  and cosLerp().
      */
-    MathVector2D<float> position;
-    MathVector2D<float> velocity;
-    float angle; // in radians
+    MathVector2D<fixed> position;
+    MathVector2D<fixed> velocity;
+    int angle; // in libnds degrees
 
     /*
      *  Kinematic Statics
      *
      *  These variables rarely change. When modified, they can change how the
-     *  ship handles. The turning speed is stored in radians as a float. It
-     *  should be a relatively small portion of 2 * PI. Thrust, maximum speed,
-     *  and the mass of the ship are each stored as floats.
-     */
-    float turnSpeed;
-    float thrust;
-    float maxSpeed;
-    float mass;
-
-    /*
-     *  radToDeg
-     *
-     *  This function converts radians (our unit of choice for measuring
-     *  angles) to the libnds degree system. We only use this function from
-     *  within the Ship object, so we can make this a protected function.
+     *  ship handles. The turning speed is stored in libnds degrees. It
+     *  should be a relatively small portion of DEGREES_IN_CIRCLE. Thrust,
+     *  maximum speed, and the mass of the ship are each stored as fixed.
      */
-    int radToDeg(float rad);
+    int turnSpeed;
+    fixed thrust;
+    fixed maxSpeed;
+    fixed mass;
 
     void init(const Ship & other);
 
@@ -89,12 +138,14 @@ public:
      *  ownership of the SpriteInfo struct.
      *
      */
-    virtual ~Ship();
+    ~Ship();
 
     /*
      *  accelerate
      *
      *  Accelerate the ship by adding the ship's thrust to it's velocity.
+     *  The ship's speed is then limited to maxSpeed, whichever way it is
+     *  heading.
      *
      */
     void accelerate();
@@ -102,7 +153,9 @@ public:
     /*
      *  moveShip
      *
-     *  Move the ship by adding its velocity to its position.
+     *  Move the ship by adding its velocity to its position. The position
+     *  wraps around the WORLD_WIDTH by WORLD_HEIGHT space, just as the
+     *  sprite hardware does.
      *
      */
     void moveShip();
@@ -135,18 +188,18 @@ public:
     /*
      *  getPosition
      *
-     *  Returns the MathVector2D<float> representing the ship's position.
+     *  Returns the MathVector2D<fixed> representing the ship's position.
      *
      */
-    MathVector2D<float> getPosition();
+    MathVector2D<fixed> getPosition();
 
     /*
-     *  getAngleRad
+     *  getVelocity
      *
-     *  Returns the float representing the ship's angle in radians.
+     *  Returns the MathVector2D<fixed> representing the ship's velocity.
      *
      */
-    float getAngleRad();
+    MathVector2D<fixed> getVelocity();
 
     /*
      *  getAngleDeg
@@ -0,0 +1,161 @@
+/*
+ *  sprite_batch.h
+ *
+ *  Draws sprites as textured quads with the 3D engine, for when there are
+ *  more of them than OAM can hold.
+ *
+ *  OAM holds SPRITE_COUNT sprites, only MATRIX_COUNT of which can have a
+ *  rotation of their own. The 3D engine shows up as main background 0, and
+ *  it can draw up to 2048 polygons a frame, each rotated and scaled as it
+ *  likes. The catch is that its vertex memory holds 6144 vertices, and a
+ *  quad takes 4, so no more than 1536 quads fit in a frame.
+ *
+ *  Sprites are submitted with the same SpriteInfo the OAM code uses, plus
+ *  the texture to draw them with. Nothing is drawn until flush(), which
+ *  sends all the quads of each texture together, so each texture is bound
+ *  only once a frame however the sprites were submitted. Every quad gets
+ *  its own depth, so sprites submitted later are still drawn on top.
+ *
+ *  Textures are made from the same 16-color sprite graphics grit makes for
+ *  OAM. Those are laid out in 8x8 tiles, so they are rearranged into rows
+ *  on the way into texture memory. A VRAM bank must be mapped for textures,
+ *  and another for texture palettes.
+ *
+ *  Emulators that render the 3D engine in software, such as melonDS and
+ *  DeSmuME on Linux, draw it the same way the hardware does, and print the
+ *  benchmark's report to their debug console.
+ *
+ */
+
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <nds.h>
+#include "sprites.h"
+
+/*
+ *  SpriteBatchStats
+ *
+ *  What the last flush() sent to the 3D engine.
+ */
+typedef struct {
+    /* Quads submitted and drawn, and quads left out for want of room. */
+    u16 quads;
+    u16 dropped;
+    /* Polygons and vertices sent, by our count. */
+    u16 polygons;
+    u16 vertices;
+    /* The same as the hardware counted them, after clipping. */
+    u16 polygonsInRam;
+    u16 verticesInRam;
+    /* How many times a texture was bound. */
+    u16 textureBinds;
+} SpriteBatchStats;
+
+class SpriteBatch {
+public:
+    /* What the 3D engine's polygon and vertex memories hold per frame. */
+    static const int MAX_POLYGONS = 2048;
+    static const int MAX_VERTICES = 6144;
+    static const int MAX_QUADS = MAX_VERTICES / 4;
+
+    static const int MAX_TEXTURES = 16;
+
+    /* Returned by addTexture() when there's no room for another one. */
+    static const int NO_TEXTURE = -1;
+
+protected:
+    struct Texture {
+        int name;
+        int width;
+        int height;
+    };
+    Texture textures[MAX_TEXTURES];
+    int textureCount;
+
+    struct Quad {
+        s16 x;
+        s16 y;
+        s16 width;
+        s16 height;
+        s16 angle;
+        s16 scale;
+        u8 texture;
+    };
+    Quad quads[MAX_QUADS];
+    int quadCount;
+
+    /* Quads in texture order, and where each texture's quads start. */
+    u16 order[MAX_QUADS];
+    u16 textureStart[MAX_TEXTURES + 1];
+
+    /* Quads left out this frame. */
+    int dropped;
+
+    SpriteBatchStats stats;
+
+    void sortByTexture();
+    void drawQuad(int index);
+
+public:
+    /*
+     *  SpriteBatch
+     *
+     *  Start up the 3D engine, and set it up to draw in screen pixels with
+     *  a clear background, so the 2D backgrounds show through.
+     *
+     */
+    SpriteBatch();
+
+    /*
+     *  addTexture
+     *
+     *  Make a texture from width by height pixels of 16-color sprite tiles,
+     *  laid out for 1D sprite mapping, with the given 16 color palette.
+     *  Both sizes must be powers of two from 8 to 1024. Color 0 is
+     *  transparent, as it is for sprites. Returns the texture's number, or
+     *  NO_TEXTURE if it couldn't be made.
+     *
+     */
+    int addTexture(const void * tiles, const u16 * palette, int width,
+                   int height);
+
+    /*
+     *  begin
+     *
+     *  Start a new frame of sprites.
+     *
+     */
+    void begin();
+
+    /*
+     *  submit
+     *
+     *  Draw the sprite described by spriteInfo's size and angle with its
+     *  top left corner at x, y, scaled by scale (8.8 fixed point, as for
+     *  rotateScaleSprite()) about its middle. Returns false if the frame is
+     *  already full.
+     *
+     */
+    bool submit(const SpriteInfo * spriteInfo, int texture, int x, int y,
+                int scale = 1 << 8);
+
+    /*
+     *  flush
+     *
+     *  Send the frame's quads to the 3D engine, which shows them from the
+     *  next VBlank on.
+     *
+     */
+    void flush();
+
+    /*
+     *  getStats
+     *
+     *  Returns what the last flush() sent.
+     *
+     */
+    const SpriteBatchStats * getStats() const { return &stats; }
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ *  sprite_gfx.h
+ *
+ *  An allocator for sprite graphics memory (SPRITE_GFX).
+ *
+ *  In 1D tile mapping, a sprite's gfxIndex is not a tile number but a count
+ *  of "boundary" sized blocks from the start of sprite graphics memory. The
+ *  boundary is 32, 64, 128 or 256 bytes (set with DISPLAY_SPR_1D_SIZE_* in
+ *  REG_DISPCNT), so that is the unit we hand memory out in.
+ *
+ *  The allocator is a buddy allocator: every allocation is rounded up to a
+ *  power of two number of blocks, and freed blocks merge with their "buddy"
+ *  (the neighbouring block of the same size) whenever it is also free. This
+ *  keeps both allocating and freeing O(log n) and stops the memory from
+ *  fragmenting into unusable slivers as sprites come and go.
+ *
+ */
+
+#ifndef SPRITE_GFX_H
+#define SPRITE_GFX_H
+
+#include <nds.h>
+#include "dma_queue.h"
+
+/*
+ *  SpriteGfxReport
+ *
+ *  A snapshot of how sprite graphics memory is being used. All sizes are in
+ *  bytes.
+ */
+typedef struct {
+    u32 totalBytes;
+    u32 usedBytes;
+    u32 freeBytes;
+    u32 largestFreeBytes;
+    /* The number of separate free regions. */
+    u32 freeRegions;
+    /* 0 when all free memory is one region, approaching 100 as it splits. */
+    u32 fragmentationPercent;
+    /* How many bytes of graphics would have to move to compact memory. */
+    u32 compactionBytes;
+} SpriteGfxReport;
+
+class SpriteGfxAllocator {
+public:
+    /* A gfxIndex is 10 bits wide, so that is as many blocks as we can use. */
+    static const int MAX_ORDER = 10;
+    static const int MAX_BLOCKS = 1 << MAX_ORDER;
+    /* How many distinct shared graphics can be loaded at once. */
+    static const int MAX_SHARED = 64;
+
+protected:
+    /* Sprite graphics memory and its layout */
+    u16 * gfxBase;
+    u32 boundary;
+    int blockCount;
+    int topOrder;
+
+    /*
+     *  Block Bookkeeping
+     *
+     *  blockOrder and blockUsed are only meaningful for the first block of
+     *  each allocated or free region. Free regions of each order are linked
+     *  together through nextFree and prevFree, starting at freeHead.
+     */
+    u8 blockOrder[MAX_BLOCKS];
+    bool blockUsed[MAX_BLOCKS];
+    s16 nextFree[MAX_BLOCKS];
+    s16 prevFree[MAX_BLOCKS];
+    s16 freeHead[MAX_ORDER + 1];
+
+    /*
+     *  Shared Graphics
+     *
+     *  A small open-addressed hash table from source data to where that
+     *  data was uploaded, so many sprites using the same graphics share one
+     *  copy of the tiles.
+     */
+    struct SharedGfx {
+        const void * source;
+        int gfxIndex;
+        int refCount;
+        DmaFence fence;
+    };
+    SharedGfx shared[MAX_SHARED];
+
+    /* Uploads go through this queue when there is one. */
+    DmaQueue * dmaQueue;
+
+    void pushFree(int block, int order);
+    void removeFree(int block, int order);
+    int orderForBytes(u32 bytes) const;
+    int findShared(const void * source) const;
+
+public:
+    /*
+     *  SpriteGfxAllocator
+     *
+     *  Manage the bankSize bytes of sprite graphics memory at _gfxBase,
+     *  which is tiled with the given 1D boundary (in bytes).
+     *
+     */
+    SpriteGfxAllocator(u16 * _gfxBase, u32 bankSize, u32 _boundary);
+
+    /*
+     *  setDmaQueue
+     *
+     *  Send shared graphics uploads through a DMA queue instead of copying
+     *  them straight away. Pass NULL to go back to immediate copies.
+     *
+     */
+    void setDmaQueue(DmaQueue * _dmaQueue);
+
+    /*
+     *  alloc
+     *
+     *  Reserve room for bytes of graphics. Returns the gfxIndex to put in
+     *  the sprite's SpriteEntry, or -1 when there is no room.
+     *
+     */
+    int alloc(u32 bytes);
+
+    /*
+     *  free
+     *
+     *  Release memory returned by alloc().
+     *
+     */
+    void free(int gfxIndex);
+
+    /*
+     *  acquireShared
+     *
+     *  Returns a gfxIndex holding a copy of the bytes of graphics at
+     *  source. The first request uploads the graphics; later requests for
+     *  the same source just bump a reference count. Returns -1 when there
+     *  is no room.
+     *
+     *  When uploads go through a DMA queue, the graphics aren't in place
+     *  until the fence stored in *fence (if fence isn't NULL) completes.
+     *
+     */
+    int acquireShared(const void * source, u32 bytes, DmaFence * fence = NULL);
+
+    /*
+     *  releaseShared
+     *
+     *  Drop a reference taken with acquireShared(). The memory is freed
+     *  when the last reference goes away.
+     *
+     */
+    void releaseShared(const void * source);
+
+    /*
+     *  getPointer
+     *
+     *  Returns the address in sprite graphics memory of a gfxIndex.
+     *
+     */
+    u16 * getPointer(int gfxIndex) const;
+
+    /*
+     *  report
+     *
+     *  Fill out a SpriteGfxReport describing current memory use.
+     *
+     */
+    void report(SpriteGfxReport * out) const;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ *  sprite_mux.h
+ *
+ *  An optional sprite multiplexer, for showing more than SPRITE_COUNT
+ *  sprites at once.
+ *
+ *  The screen is cut into horizontal bands. Each band gets half of OAM to
+ *  itself, alternating between the two halves: while one band is being
+ *  drawn from one half, the other half is rewritten for the next band
+ *  during an HBlank. A sprite that crosses a band boundary is put in both
+ *  bands. As long as no band needs more than half of OAM, any number of
+ *  sprites (up to MAX_SPRITES) can be shown.
+ *
+ *  While the multiplexer is enabled, it owns OAM: call its commit() during
+ *  VBlank instead of the OAMShadow's.
+ *
+ */
+
+#ifndef SPRITE_MUX_H
+#define SPRITE_MUX_H
+
+#include <nds.h>
+#include "oam_shadow.h"
+#include "sprites.h"
+
+/*
+ *  MuxBandStats
+ *
+ *  How a band fared when the frame was built.
+ */
+typedef struct {
+    /* Sprites that touch the band. */
+    u16 requested;
+    /* Sprites that made it into OAM for the band. */
+    u16 shown;
+    /* Sprites left out because the band was full. */
+    u16 dropped;
+} MuxBandStats;
+
+class SpriteMultiplexer {
+public:
+    static const int BAND_COUNT = 8;
+    static const int BAND_HEIGHT = SCREEN_HEIGHT / BAND_COUNT;
+    static const int ENTRIES_PER_BAND = SPRITE_COUNT / 2;
+    static const int MAX_SPRITES = 512;
+
+    /* The DMA channel used unless another is given. */
+    static const int DMA_CHANNEL = 1;
+
+protected:
+    struct VirtualSprite {
+        SpriteInfo * info;
+        int top;
+        int bottom;
+        int importance;
+    };
+
+    OAMShadow * oamShadow;
+    int dmaChannel;
+    bool enabled;
+
+    /* The sprites submitted this frame, and the same sorted by top line. */
+    VirtualSprite sprites[MAX_SPRITES];
+    u16 sorted[MAX_SPRITES];
+    int spriteCount;
+
+    /*
+     *  Band Tables
+     *
+     *  The OAM contents for every band. There are two sets: one is read by
+     *  the interrupt handler while the frame is displayed, the other is
+     *  built for the next frame. commit() swaps them.
+     */
+    SpriteEntry bandTables[2][BAND_COUNT][ENTRIES_PER_BAND]
+        __attribute__((aligned(32)));
+    int frontTables;
+
+    MuxBandStats stats[BAND_COUNT];
+
+    /* The multiplexer the VCount interrupt handler works on. */
+    static SpriteMultiplexer * active;
+    static void onVCount();
+
+    void uploadBand(int band, bool now);
+    void startFrame();
+
+public:
+    /*
+     *  SpriteMultiplexer
+     *
+     *  Create a multiplexer that takes its rotation matrices from
+     *  _oamShadow and rewrites OAM using DMA channel _dmaChannel.
+     *
+     */
+    SpriteMultiplexer(OAMShadow * _oamShadow, int _dmaChannel = DMA_CHANNEL);
+
+    /*
+     *  enable
+     *
+     *  Take over OAM and start rewriting it every band.
+     *
+     */
+    void enable();
+
+    /*
+     *  disable
+     *
+     *  Stop multiplexing. Mark the OAMShadow dirty before committing it
+     *  again, since OAM no longer matches it.
+     *
+     */
+    void disable();
+
+    /*
+     *  begin
+     *
+     *  Start a new frame by forgetting the previously submitted sprites.
+     *
+     */
+    void begin();
+
+    /*
+     *  submit
+     *
+     *  Add a sprite to this frame. When a band has too many sprites, those
+     *  with the lowest importance are dropped first. Returns false if
+     *  MAX_SPRITES have already been submitted.
+     *
+     */
+    bool submit(SpriteInfo * info, int importance = 0);
+
+    /*
+     *  build
+     *
+     *  Sort the submitted sprites by y and build the band tables for the
+     *  next frame. Call this after all sprites are submitted and before
+     *  waiting for VBlank.
+     *
+     */
+    void build();
+
+    /*
+     *  commit
+     *
+     *  Show the frame that was last built. This must be called during
+     *  VBlank. Until it is called again, the same frame keeps being shown.
+     *
+     */
+    void commit();
+
+    /*
+     *  getBandStats
+     *
+     *  Returns the budget report of a band for the last built frame.
+     *
+     */
+    const MuxBandStats * getBandStats(int band) const;
+};
+
+#endif
@@ -48,6 +48,16 @@ void initOAM(OAMTable * oam);
  */
 void rotateSprite(SpriteRotation * spriteRotation, int angle);
 
+/*
+ *  rotateScaleSprite
+ *
+ *  Rotate a sprite counter-clockwise by the specified angle (in degrees) and
+ *  scale it by scale, an 8.8 fixed-point number (1 << 8 is the original
+ *  size).
+ *
+ */
+void rotateScaleSprite(SpriteRotation * spriteRotation, int angle, int scale);
+
 /*
  *  setSpriteVisibility
  *
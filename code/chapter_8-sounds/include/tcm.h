@@ -0,0 +1,65 @@
+/*
+ *  tcm.h
+ *
+ *  Placement of the per-frame hot path in the ARM9's tightly coupled
+ *  memory.
+ *
+ *  The ARM9 has two small memories wired straight into the CPU: 32KB of
+ *  instruction TCM (ITCM) and 16KB of data TCM (DTCM). Both are read and
+ *  written in a single cycle and never miss, unlike main RAM, which is slow
+ *  and only hidden behind 8KB of instruction cache and 4KB of data cache.
+ *  Functions marked HOT_CODE are linked into ITCM, and variables marked
+ *  HOT_DATA (initialized) or HOT_BSS (zeroed) are linked into DTCM.
+ *
+ *  Two things to keep in mind. DTCM also holds the stack, so every byte we
+ *  put there is a byte the stack can't have; run "make tcm-report" to see
+ *  how much we use. And DMA can't see DTCM at all, so data in DTCM has to
+ *  be copied by the CPU (see isInDtcm()).
+ *
+ *  Build with -DNO_TCM to leave everything in main RAM, which is handy to
+ *  measure what the TCMs buy us.
+ *
+ */
+
+#ifndef TCM_H
+#define TCM_H
+
+#include <nds.h>
+
+#ifdef NO_TCM
+
+#define HOT_CODE
+#define HOT_DATA
+#define HOT_BSS
+
+static inline bool isInDtcm(const void *) { return false; }
+
+#else
+
+/*
+ *  Code in ITCM is built as ARM code: the ARM9 fetches a whole 32-bit
+ *  instruction from ITCM in one cycle, so Thumb's smaller code buys nothing
+ *  there.
+ */
+#define HOT_CODE ITCM_CODE ARM_CODE
+#define HOT_DATA DTCM_DATA
+#define HOT_BSS DTCM_BSS
+
+/* The start of DTCM, as placed by the linker script. */
+extern "C" char __dtcm_start[];
+
+static const u32 DTCM_SIZE = 16 * 1024;
+
+/*
+ *  isInDtcm
+ *
+ *  Returns true if p points into DTCM, where DMA can't read or write it.
+ *
+ */
+static inline bool isInDtcm(const void * p) {
+    return (uintptr_t)p - (uintptr_t)__dtcm_start < DTCM_SIZE;
+}
+
+#endif
+
+#endif
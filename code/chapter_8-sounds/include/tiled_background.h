@@ -0,0 +1,111 @@
+/*
+ *  tiled_background.h
+ *
+ *  Scrolls a tiled background over a world much larger than the hardware
+ *  map, by only keeping the part around the camera loaded.
+ *
+ *  A 16-bit bitmap background costs two bytes of VRAM per pixel, so even
+ *  one screen's worth takes 128KB. A tiled background only stores each
+ *  different 8x8 tile once (grit throws out repeats, including flipped
+ *  ones, when it converts the image), plus two bytes per tile of map. A
+ *  star field is mostly the same few tiles over and over, so it shrinks to
+ *  a few KB.
+ *
+ *  The world map lives in main RAM and can be any size. The hardware map is
+ *  an extended rotation background of 64x64 tiles, which wraps around at
+ *  the edges. Only the tiles the screen can see are copied into it, each
+ *  to the place the wrapped scroll will show it. When the camera moves,
+ *  only the columns and rows that just came into view are written, so a
+ *  frame never writes more than one screen's worth of map, and usually
+ *  just a column or a row.
+ *
+ */
+
+#ifndef TILED_BACKGROUND_H
+#define TILED_BACKGROUND_H
+
+#include <nds.h>
+
+class TiledBackground {
+public:
+    /* The hardware map is this many tiles across and down. */
+    static const int MAP_TILES = 64;
+
+    /*
+     *  How many extra columns are kept loaded on either side of the screen,
+     *  so lines of it can be shifted sideways (see parallax.h).
+     */
+    static const int MARGIN_COLUMNS = 4;
+
+    /* How many tiles the screen can see some of at once, with the margin. */
+    static const int VIEW_COLUMNS = SCREEN_WIDTH / 8 + 1 + 2 * MARGIN_COLUMNS;
+    static const int VIEW_ROWS = SCREEN_HEIGHT / 8 + 1;
+
+protected:
+    int id;
+    u16 * hardwareMap;
+
+    /* The whole world, which repeats past its edges. */
+    const u16 * worldMap;
+    int worldColumns;
+    int worldRows;
+
+    /* Where the camera is, in pixels. */
+    int cameraX;
+    int cameraY;
+
+    /* The world tile at the top left of the loaded area. */
+    int loadedColumn;
+    int loadedRow;
+    bool loaded;
+
+    /* Statistics for the last call to update() */
+    u32 entriesWritten;
+
+    u16 worldTile(int column, int row) const;
+    void writeColumn(int column, int firstRow);
+    void writeRow(int row, int firstColumn);
+
+public:
+    /*
+     *  TiledBackground
+     *
+     *  Stream _worldMap, which is _worldColumns by _worldRows tiles, into
+     *  the map of background _id. The background must be a 512x512
+     *  extended rotation background, with its tiles and palette already
+     *  loaded. Nothing is written until the first update().
+     *
+     */
+    TiledBackground(int _id, const u16 * _worldMap, int _worldColumns,
+                    int _worldRows);
+
+    /*
+     *  setCamera
+     *
+     *  Set the world position, in pixels, to show at the top left of the
+     *  screen. Takes effect on the next update().
+     *
+     */
+    void setCamera(int x, int y);
+
+    /*
+     *  update
+     *
+     *  Write the newly visible parts of the map, and scroll to the camera.
+     *  Call this during VBlank, and call bgUpdate() after it.
+     *
+     */
+    void update();
+
+    /*
+     *  getEntriesWritten
+     *
+     *  Returns how many map entries the last update() wrote to VRAM.
+     *
+     */
+    u32 getEntriesWritten() const { return entriesWritten; }
+
+    int getId() const { return id; }
+};
+
+#endif
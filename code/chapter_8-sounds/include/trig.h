@@ -0,0 +1,25 @@
+/*
+ *  trig.h
+ *
+ *  Lookup table trigonometry to go with libnds' sinLerp() and cosLerp().
+ *
+ */
+
+#ifndef TRIG_H
+#define TRIG_H
+
+#include <nds.h>
+
+/*
+ *  atan2Lerp
+ *
+ *  Returns the angle of the vector (x, y), like atan2(y, x), but in libnds
+ *  degrees (from 0 up to DEGREES_IN_CIRCLE) and without any floating point.
+ *  x and y can be in any fixed-point format, as long as it's the same one.
+ *  The result is within a libnds degree (0.011 of a real degree) of the
+ *  exact angle. atan2Lerp(0, 0) is 0.
+ *
+ */
+s32 atan2Lerp(s32 y, s32 x);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ *  vram_manager.h
+ *
+ *  Keeps track of what each of the nine VRAM banks is used for, and hands
+ *  out memory from them.
+ *
+ *  Each bank can only be put to some uses, and only at some places within
+ *  each use. Bank H, for example, can only be sub screen background memory
+ *  or sub screen background extended palettes. The manager knows the
+ *  rules, as GBATEK gives them
+ *  (https://problemkaputt.de/gbatek.htm#dsmemorycontrolvram), and refuses
+ *  a mapping the hardware can't do, or one that would put two banks at the
+ *  same address. A bank that isn't being used for anything is left mapped
+ *  to LCD, where the CPU can still reach it.
+ *
+ *  Memory is allocated from a use, such as main background memory, rather
+ *  than from a bank. It may come from any bank mapped to that use, or
+ *  straddle two banks mapped next to each other. Allocations are given as
+ *  an offset from the start of the use's memory, which is what bgInit()
+ *  wants for its map and tile bases.
+ *
+ *  Between levels, everything can be freed and the banks mapped again to
+ *  suit the next level. A bank can't be remapped while anything is still
+ *  allocated from it.
+ *
+ */
+
+#ifndef VRAM_MANAGER_H
+#define VRAM_MANAGER_H
+
+#include <nds.h>
+
+enum VramBank {
+    VRAM_BANK_A,
+    VRAM_BANK_B,
+    VRAM_BANK_C,
+    VRAM_BANK_D,
+    VRAM_BANK_E,
+    VRAM_BANK_F,
+    VRAM_BANK_G,
+    VRAM_BANK_H,
+    VRAM_BANK_I,
+    VRAM_BANK_COUNT
+};
+
+enum VramUse {
+    VRAM_USE_LCD,
+    VRAM_USE_MAIN_BG,
+    VRAM_USE_MAIN_SPRITE,
+    VRAM_USE_SUB_BG,
+    VRAM_USE_SUB_SPRITE,
+    VRAM_USE_TEXTURE,
+    VRAM_USE_TEXTURE_PALETTE,
+    VRAM_USE_MAIN_BG_EXT_PALETTE,
+    VRAM_USE_MAIN_SPRITE_EXT_PALETTE,
+    VRAM_USE_SUB_BG_EXT_PALETTE,
+    VRAM_USE_SUB_SPRITE_EXT_PALETTE,
+    VRAM_USE_ARM7,
+    VRAM_USE_COUNT
+};
+
+/*
+ *  VramBankInfo
+ *
+ *  What a bank is being used for, and how much of it is allocated.
+ */
+typedef struct {
+    VramUse use;
+    /* Where the bank starts within the use's memory. */
+    u32 start;
+    /* How much of the use's memory the bank provides. */
+    u32 size;
+    /* How many of those bytes are allocated. */
+    u32 used;
+} VramBankInfo;
+
+class VramManager {
+public:
+    static const int MAX_ALLOCATIONS = 64;
+
+    /* Returned by allocate() when there's no room. */
+    static const s32 NO_SPACE = -1;
+
+protected:
+    struct Mapping {
+        VramUse use;
+        u32 start;
+        u32 size;
+    };
+    Mapping mappings[VRAM_BANK_COUNT];
+
+    struct Allocation {
+        VramUse use;
+        u32 start;
+        u32 size;
+    };
+    Allocation allocations[MAX_ALLOCATIONS];
+    int allocationCount;
+
+    bool isMapped(VramUse use, u32 start, u32 end) const;
+    bool isFree(VramUse use, u32 start, u32 end) const;
+    u32 usedBytes(VramUse use, u32 start, u32 end) const;
+
+public:
+    /*
+     *  VramManager
+     *
+     *  Map every bank to LCD, with nothing allocated.
+     *
+     */
+    VramManager();
+
+    /*
+     *  map
+     *
+     *  Put bank to use, at the offsetth place the hardware allows for that
+     *  bank and use (the OFS field of the bank's control register). Returns
+     *  false, leaving the bank as it was, if the hardware can't map the bank
+     *  there, if another bank is already there, or if the bank still has
+     *  memory allocated from it.
+     *
+     */
+    bool map(VramBank bank, VramUse use, int offset = 0);
+
+    /*
+     *  unmap
+     *
+     *  Map bank to LCD. Returns false if it still has memory allocated
+     *  from it.
+     *
+     */
+    bool unmap(VramBank bank) { return map(bank, VRAM_USE_LCD); }
+
+    /*
+     *  allocate
+     *
+     *  Find bytes of use's memory, starting on a multiple of alignment (a
+     *  power of two, at least 1), in whichever banks are mapped to it.
+     *  Returns the offset from the start of the use's memory, or NO_SPACE.
+     *
+     */
+    s32 allocate(VramUse use, u32 bytes, u32 alignment);
+
+    /*
+     *  free
+     *
+     *  Give back memory from allocate().
+     *
+     */
+    void free(VramUse use, s32 offset);
+
+    /*
+     *  freeAll
+     *
+     *  Give back everything allocated, ready to remap the banks for a new
+     *  level.
+     *
+     */
+    void freeAll() { allocationCount = 0; }
+
+    /*
+     *  getAddress
+     *
+     *  Returns where the CPU sees an offset in use's memory. Only
+     *  background and sprite memory can be seen by the CPU. The rest
+     *  returns NULL.
+     *
+     */
+    static void * getAddress(VramUse use, s32 offset);
+
+    /*
+     *  getBankInfo
+     *
+     *  Fill in what bank is used for and how much of it is allocated.
+     *
+     */
+    void getBankInfo(VramBank bank, VramBankInfo * info) const;
+
+    /*
+     *  getUseName
+     *
+     *  Returns a short name for use, for reports.
+     *
+     */
+    static const char * getUseName(VramUse use);
+};
+
+#endif
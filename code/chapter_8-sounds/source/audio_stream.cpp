@@ -0,0 +1,417 @@
+/*
+ *  audio_stream.cpp
+ *
+ *  Plays a long sound, like music, from a WAV file in NitroFS without
+ *  loading the whole thing into memory.
+ *
+ */
+
+#include "audio_stream.h"
+#include "profiler.h"
+#include <maxmod9.h>
+#include <nds.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The WAV format codes we can play. */
+static const int WAVE_FORMAT_PCM = 1;
+static const int WAVE_FORMAT_IMA_ADPCM = 0x11;
+
+/* IMA ADPCM step sizes, and how each code moves through them. */
+static const s16 ADPCM_STEPS[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const s8 ADPCM_INDEX_CHANGE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static u16 read16(const u8 *p) { return p[0] | p[1] << 8; }
+
+static u32 read32(const u8 *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (u32)p[3] << 24;
+}
+
+/*
+ *  The ring isn't volatile, so without this the compiler could move the
+ *  copies in and out of it past the position updates, and the other side
+ *  would see bytes that aren't there yet, or overwrite ones not yet read.
+ *  The ARM9 keeps its own memory accesses in order, so stopping the
+ *  compiler is enough.
+ */
+static inline void ringBarrier() { asm volatile("" ::: "memory"); }
+
+/* One channel of an ADPCM decoder. */
+typedef struct {
+  int predictor;
+  int index;
+} AdpcmChannel;
+
+static s16 decodeNibble(AdpcmChannel *channel, int nibble) {
+  int step = ADPCM_STEPS[channel->index];
+  int diff = step >> 3;
+  if (nibble & 1) {
+    diff += step >> 2;
+  }
+  if (nibble & 2) {
+    diff += step >> 1;
+  }
+  if (nibble & 4) {
+    diff += step;
+  }
+  if (nibble & 8) {
+    diff = -diff;
+  }
+
+  int predictor = channel->predictor + diff;
+  if (predictor > 32767) {
+    predictor = 32767;
+  } else if (predictor < -32768) {
+    predictor = -32768;
+  }
+  channel->predictor = predictor;
+
+  int index = channel->index + ADPCM_INDEX_CHANGE[nibble];
+  if (index < 0) {
+    index = 0;
+  } else if (index > 88) {
+    index = 88;
+  }
+  channel->index = index;
+
+  return predictor;
+}
+
+AudioStream *AudioStream::current = NULL;
+
+AudioStream::AudioStream() {
+  file = NULL;
+  playing = false;
+  readPosition = 0;
+  writePosition = 0;
+  endOfFile = false;
+  underruns = 0;
+  underrunSamples = 0;
+}
+
+AudioStream::~AudioStream() { close(); }
+
+bool AudioStream::readHeader() {
+  u8 header[12];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  /* Look through the chunks for the format, then the sound data. */
+  bool haveFormat = false;
+  for (;;) {
+    u8 chunk[8];
+    if (fread(chunk, sizeof(chunk), 1, file) != 1) {
+      return false;
+    }
+    u32 size = read32(chunk + 4);
+
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      u8 format[20];
+      u32 formatBytes = size < sizeof(format) ? size : sizeof(format);
+      if (size < 16 || fread(format, formatBytes, 1, file) != 1) {
+        return false;
+      }
+      int formatCode = read16(format);
+      channels = read16(format + 2);
+      sampleRate = read32(format + 4);
+      blockAlign = read16(format + 12);
+      bitsPerSample = read16(format + 14);
+      adpcm = formatCode == WAVE_FORMAT_IMA_ADPCM;
+
+      if (adpcm) {
+        if (size < 20 || bitsPerSample != 4) {
+          return false;
+        }
+        samplesPerBlock = read16(format + 18);
+      } else if (formatCode != WAVE_FORMAT_PCM ||
+                 (bitsPerSample != 8 && bitsPerSample != 16)) {
+        return false;
+      }
+      if (channels < 1 || channels > 2) {
+        return false;
+      }
+      haveFormat = true;
+      fseek(file, size - formatBytes, SEEK_CUR);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        return false;
+      }
+      dataStart = ftell(file);
+      dataBytes = size;
+      return true;
+    } else {
+      fseek(file, size, SEEK_CUR);
+    }
+
+    /* Chunks are padded to an even size. */
+    if (size & 1) {
+      fseek(file, 1, SEEK_CUR);
+    }
+  }
+}
+
+bool AudioStream::rewindData() {
+  dataLeft = dataBytes;
+  return fseek(file, dataStart, SEEK_SET) == 0;
+}
+
+u32 AudioStream::freeBytes() const {
+  return RING_BYTES - (writePosition - readPosition);
+}
+
+/* Copy bytes into the ring. The caller has checked that they fit. */
+void AudioStream::putBytes(const u8 *data, u32 bytes) {
+  u32 start = writePosition & (RING_BYTES - 1);
+  u32 first = RING_BYTES - start;
+  if (first > bytes) {
+    first = bytes;
+  }
+  memcpy(&ring[start], data, first);
+  memcpy(&ring[0], data + first, bytes - first);
+}
+
+/* Write one 16-bit sample into the ring, offset bytes past writePosition. */
+void AudioStream::putSample(u32 offset, s16 sample) {
+  u32 at = (writePosition + offset) & (RING_BYTES - 1);
+  *(s16 *)&ring[at] = sample;
+}
+
+bool AudioStream::fillPcm() {
+  u32 bytes = freeBytes();
+  if (bytes > (u32)READ_BYTES) {
+    bytes = READ_BYTES;
+  }
+  if (bytes > dataLeft) {
+    bytes = dataLeft;
+  }
+  bytes -= bytes % frameBytes;
+  if (bytes == 0) {
+    return false;
+  }
+
+  if (fread(readBuffer, 1, bytes, file) != bytes) {
+    return false;
+  }
+  dataLeft -= bytes;
+
+  /* WAV files store 8-bit sound unsigned, and the DS plays it signed. */
+  if (bitsPerSample == 8) {
+    for (u32 i = 0; i < bytes; i++) {
+      readBuffer[i] ^= 0x80;
+    }
+  }
+
+  putBytes(readBuffer, bytes);
+  ringBarrier();
+  writePosition += bytes;
+  return true;
+}
+
+/*
+ *  Decode one ADPCM block. Each channel starts with its first sample and
+ *  step index, then the channels take turns with four bytes (eight
+ *  samples) at a time, low nibble first.
+ */
+bool AudioStream::fillAdpcm() {
+  u32 bytes = blockAlign < (int)dataLeft ? blockAlign : dataLeft;
+  u32 headerBytes = 4 * channels;
+  if (bytes <= headerBytes) {
+    dataLeft = 0;
+    return false;
+  }
+
+  /* The last block may be short. */
+  int samples = 1 + (bytes - headerBytes) * 2 / channels;
+  if (samples > samplesPerBlock) {
+    samples = samplesPerBlock;
+  }
+  if ((u32)(samples * frameBytes) > freeBytes()) {
+    return false;
+  }
+
+  if (fread(readBuffer, 1, bytes, file) != bytes) {
+    return false;
+  }
+  dataLeft -= bytes;
+
+  AdpcmChannel state[2];
+  for (int c = 0; c < channels; c++) {
+    state[c].predictor = (s16)read16(&readBuffer[c * 4]);
+    state[c].index = readBuffer[c * 4 + 2];
+    if (state[c].index > 88) {
+      state[c].index = 88;
+    }
+    putSample(c * 2, state[c].predictor);
+  }
+
+  const u8 *data = &readBuffer[headerBytes];
+  for (int group = 0; 1 + group * 8 < samples; group++) {
+    for (int c = 0; c < channels; c++) {
+      for (int i = 0; i < 8; i++) {
+        int sample = 1 + group * 8 + i;
+        int nibble = (data[i / 2] >> ((i & 1) * 4)) & 0xF;
+        s16 value = decodeNibble(&state[c], nibble);
+        if (sample < samples) {
+          putSample(sample * frameBytes + c * 2, value);
+        }
+      }
+      data += 4;
+    }
+  }
+
+  ringBarrier();
+  writePosition += samples * frameBytes;
+  return true;
+}
+
+bool AudioStream::open(const char *path, bool _looping) {
+  close();
+
+  file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  if (!readHeader() || blockAlign > READ_BYTES) {
+    close();
+    return false;
+  }
+
+  /* ADPCM is decoded to 16-bit samples. */
+  int outputBits = adpcm ? 16 : bitsPerSample;
+  frameBytes = channels * outputBits / 8;
+  if (outputBits == 8) {
+    streamFormat =
+        channels == 1 ? MM_STREAM_8BIT_MONO : MM_STREAM_8BIT_STEREO;
+  } else {
+    streamFormat =
+        channels == 1 ? MM_STREAM_16BIT_MONO : MM_STREAM_16BIT_STEREO;
+  }
+
+  /* A decoded block has to fit in the ring with room to spare. */
+  if (adpcm && samplesPerBlock * frameBytes > RING_BYTES / 2) {
+    close();
+    return false;
+  }
+
+  looping = _looping;
+  readPosition = 0;
+  writePosition = 0;
+  endOfFile = false;
+  underruns = 0;
+  underrunSamples = 0;
+  rewindData();
+
+  /* Fill the ring before we start, so there is something to play. */
+  service(RING_BYTES / READ_BYTES + 1);
+
+  current = this;
+  playing = true;
+
+  mm_stream stream;
+  stream.sampling_rate = sampleRate;
+  stream.buffer_length = MIXER_SAMPLES;
+  stream.callback = onStreamRequest;
+  stream.format = streamFormat;
+  stream.timer = MM_TIMER0;
+  stream.manual = false;
+  mmStreamOpen(&stream);
+
+  return true;
+}
+
+void AudioStream::close() {
+  if (playing) {
+    mmStreamClose();
+    playing = false;
+    current = NULL;
+  }
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+void AudioStream::service(int maxReads) {
+  PROFILE_SCOPE(PROFILE_STREAM_AUDIO);
+
+  if (file == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < maxReads && !endOfFile; i++) {
+    if (dataLeft == 0) {
+      if (!looping || !rewindData()) {
+        endOfFile = true;
+        break;
+      }
+    }
+    if (!(adpcm ? fillAdpcm() : fillPcm())) {
+      break;
+    }
+  }
+}
+
+bool AudioStream::isPlaying() const {
+  return playing && !(endOfFile && writePosition == readPosition);
+}
+
+/* Copy sound out of the ring. Returns how many bytes there were. */
+u32 AudioStream::takeBytes(u8 *dest, u32 bytes) {
+  u32 available = writePosition - readPosition;
+  if (bytes > available) {
+    bytes = available;
+  }
+
+  u32 start = readPosition & (RING_BYTES - 1);
+  u32 first = RING_BYTES - start;
+  if (first > bytes) {
+    first = bytes;
+  }
+  memcpy(dest, &ring[start], first);
+  memcpy(dest + first, &ring[0], bytes - first);
+
+  ringBarrier();
+  readPosition += bytes;
+  return bytes;
+}
+
+/*
+ *  maxmod calls this from its timer interrupt when it needs more sound. It
+ *  always gets all it asked for, padded with silence if need be.
+ */
+mm_word AudioStream::onStreamRequest(mm_word length, mm_addr dest,
+                                     mm_stream_formats) {
+  AudioStream *stream = current;
+  if (stream == NULL) {
+    return 0;
+  }
+
+  u32 wanted = length * stream->frameBytes;
+  u32 got = stream->takeBytes((u8 *)dest, wanted);
+  if (got < wanted) {
+    memset((u8 *)dest + got, 0, wanted - got);
+
+    /* Running out at the end of the file is not an underrun. */
+    if (!stream->endOfFile) {
+      stream->underruns++;
+      stream->underrunSamples += (wanted - got) / stream->frameBytes;
+    }
+  }
+
+  return length;
+}
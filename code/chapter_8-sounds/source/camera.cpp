@@ -0,0 +1,145 @@
+/*
+ *  camera.cpp
+ *
+ *  Decides which part of the world is on screen, and works out where on
+ *  the screen each sprite goes.
+ *
+ */
+
+#include "camera.h"
+#include <nds.h>
+
+Camera::Camera(int _deadzoneWidth, int _deadzoneHeight, fixed _smoothing) {
+  deadzoneWidth = _deadzoneWidth;
+  deadzoneHeight = _deadzoneHeight;
+  smoothing = _smoothing;
+  center.x = fixed::fromInt(SCREEN_WIDTH / 2);
+  center.y = fixed::fromInt(SCREEN_HEIGHT / 2);
+  step.x = fixed();
+  step.y = fixed();
+}
+
+void Camera::lookAt(MathVector2D<fixed> target) {
+  center += worldDelta(center, target);
+  step.x = fixed();
+  step.y = fixed();
+}
+
+/*
+ *  Returns how far to move along one axis, given how far the target is
+ *  from the middle of the screen along it.
+ */
+fixed Camera::followAxis(fixed offset, int deadzone) const {
+  fixed half = fixed::fromInt(deadzone / 2);
+  if (offset > half) {
+    return (offset - half) * smoothing;
+  } else if (offset < -half) {
+    return (offset + half) * smoothing;
+  }
+  return fixed();
+}
+
+void Camera::follow(MathVector2D<fixed> target) {
+  MathVector2D<fixed> offset = worldDelta(center, target);
+  step.x = followAxis(offset.x, deadzoneWidth);
+  step.y = followAxis(offset.y, deadzoneHeight);
+  center += step;
+}
+
+MathVector2D<fixed> Camera::getPosition() const {
+  MathVector2D<fixed> position;
+  position.x = center.x - fixed::fromInt(SCREEN_WIDTH / 2);
+  position.y = center.y - fixed::fromInt(SCREEN_HEIGHT / 2);
+  return position;
+}
+
+MathVector2D<int> Camera::getView() const {
+  MathVector2D<fixed> position = getPosition();
+  MathVector2D<int> view;
+  view.x = position.x.toInt();
+  view.y = position.y.toInt();
+  return view;
+}
+
+bool Camera::toScreen(MathVector2D<fixed> world, int width, int height,
+                      MathVector2D<int> *screen) const {
+  *screen = toScreen(getView(), world);
+  return screen->x > -width && screen->x < SCREEN_WIDTH &&
+         screen->y > -height && screen->y < SCREEN_HEIGHT;
+}
+
+MathVector2D<int> Camera::toWorld(MathVector2D<int> screen) const {
+  return toWorld(getView(), screen);
+}
+
+MathVector2D<int> Camera::toScreen(MathVector2D<int> view,
+                                   MathVector2D<fixed> world) {
+  /*
+   *  Measure from the middle of the screen, so that the short way round
+   *  the world is the one that goes closest to the screen. The view is a
+   *  whole pixel, so the only rounding is of the world position itself,
+   *  which toWorld() undoes exactly for whole pixels.
+   */
+  MathVector2D<fixed> middle;
+  middle.x = fixed::fromInt(view.x + SCREEN_WIDTH / 2);
+  middle.y = fixed::fromInt(view.y + SCREEN_HEIGHT / 2);
+  MathVector2D<fixed> offset = worldDelta(middle, world);
+
+  MathVector2D<int> screen;
+  screen.x = offset.x.toInt() + SCREEN_WIDTH / 2;
+  screen.y = offset.y.toInt() + SCREEN_HEIGHT / 2;
+  return screen;
+}
+
+MathVector2D<int> Camera::toWorld(MathVector2D<int> view,
+                                  MathVector2D<int> screen) {
+  MathVector2D<int> world;
+  world.x = (view.x + screen.x) & (WORLD_WIDTH - 1);
+  world.y = (view.y + screen.y) & (WORLD_HEIGHT - 1);
+  return world;
+}
+
+bool Camera::placeSprite(SpriteInfo *spriteInfo, MathVector2D<fixed> world,
+                         OAMShadow *oamShadow, MatrixPool *matrixPool) {
+  SpriteEntry *entry = spriteInfo->entry;
+  bool affine = matrixPool != NULL;
+
+  /*
+   *  setSpriteVisibility() hides a sprite by turning off its affine flag
+   *  and turning on its hidden flag, so that is how a culled sprite looks.
+   */
+  bool culled = entry->isHidden && !entry->isRotateScale;
+
+  MathVector2D<int> screen;
+  if (!toScreen(world, spriteInfo->width, spriteInfo->height, &screen)) {
+    if (!culled) {
+      if (affine) {
+        matrixPool->release(entry->rotationIndex);
+      }
+      setSpriteVisibility(entry, true);
+      oamShadow->markEntry(spriteInfo->oamId);
+    }
+    return false;
+  }
+
+  if (affine) {
+    if (culled) {
+      entry->rotationIndex = matrixPool->acquire(spriteInfo->angle);
+    } else {
+      entry->rotationIndex =
+          matrixPool->update(entry->rotationIndex, spriteInfo->angle);
+    }
+  }
+  if (culled) {
+    setSpriteVisibility(entry, false, affine);
+  }
+
+  /*
+   *  Sprite coordinates wrap, so a sprite hanging off the top or left works.
+   *  OAM keeps 9 bits of x and 8 bits of y, whatever size the world is.
+   */
+  entry->x = screen.x & 0x1FF;
+  entry->y = screen.y & 0xFF;
+  oamShadow->markEntry(spriteInfo->oamId);
+  return true;
+}
@@ -0,0 +1,248 @@
+/*
+ *  collision.cpp
+ *
+ *  Finds which objects touch each frame, using a uniform grid over the
+ *  wrapped world.
+ *
+ */
+
+#include "collision.h"
+#include <assert.h>
+#include <nds.h>
+
+/*
+ *  The largest object we can place, in pixels. That's a double size 64x64
+ *  affine sprite, which covers at most 5x5 cells.
+ */
+static const int MAX_COLLIDER_SIZE = 128;
+static const int MAX_CELLS_PER_COLLIDER =
+    (MAX_COLLIDER_SIZE / CollisionGrid::CELL_SIZE + 1) *
+    (MAX_COLLIDER_SIZE / CollisionGrid::CELL_SIZE + 1);
+
+/* Wrap a distance into the range [-size / 2, size / 2). */
+static int wrapDelta(int d, int size) {
+  return ((d + size / 2) & (size - 1)) - size / 2;
+}
+
+static int clamp(int value, int low, int high) {
+  if (value < low) {
+    return low;
+  }
+  if (value > high) {
+    return high;
+  }
+  return value;
+}
+
+/* Does the span starting at b start inside the span starting at a? */
+static bool startsInside(int a, int aLength, int b, int size) {
+  return ((b - a) & (size - 1)) < aLength;
+}
+
+/*
+ *  List the grid cells a box covers, wrapping around the edges of the
+ *  world. Returns how many there are.
+ */
+static int cellsCovered(int x, int y, int width, int height, u16 *cells) {
+  int firstX = x / CollisionGrid::CELL_SIZE;
+  int lastX = (x + width - 1) / CollisionGrid::CELL_SIZE;
+  int firstY = y / CollisionGrid::CELL_SIZE;
+  int lastY = (y + height - 1) / CollisionGrid::CELL_SIZE;
+
+  int count = 0;
+  for (int cy = firstY; cy <= lastY; cy++) {
+    int row = cy & (CollisionGrid::GRID_HEIGHT - 1);
+    for (int cx = firstX; cx <= lastX; cx++) {
+      int column = cx & (CollisionGrid::GRID_WIDTH - 1);
+      cells[count++] = row * CollisionGrid::GRID_WIDTH + column;
+    }
+  }
+  return count;
+}
+
+CollisionGrid::CollisionGrid() { begin(); }
+
+void CollisionGrid::begin() {
+  colliderCount = 0;
+  entryCount = 0;
+  contactCount = 0;
+  droppedContacts = 0;
+}
+
+bool CollisionGrid::add(int x, int y, int width, int height,
+                        ColliderShape shape, u16 id) {
+  assert(width > 0 && width <= MAX_COLLIDER_SIZE);
+  assert(height > 0 && height <= MAX_COLLIDER_SIZE);
+
+  x &= WORLD_WIDTH - 1;
+  y &= WORLD_HEIGHT - 1;
+
+  int cellsX = (x + width - 1) / CELL_SIZE - x / CELL_SIZE + 1;
+  int cellsY = (y + height - 1) / CELL_SIZE - y / CELL_SIZE + 1;
+  if (colliderCount == MAX_COLLIDERS ||
+      entryCount + cellsX * cellsY > MAX_CELL_ENTRIES) {
+    return false;
+  }
+  entryCount += cellsX * cellsY;
+
+  int i = colliderCount++;
+  colliderX[i] = x;
+  colliderY[i] = y;
+  colliderWidth[i] = width;
+  colliderHeight[i] = height;
+  colliderShape[i] = shape;
+  colliderId[i] = id;
+  return true;
+}
+
+bool CollisionGrid::addSprite(const SpriteInfo *spriteInfo, int x, int y,
+                              ColliderShape shape) {
+  return add(x, y, spriteInfo->width, spriteInfo->height, shape,
+             spriteInfo->oamId);
+}
+
+void CollisionGrid::buildGrid() {
+  u16 cells[MAX_CELLS_PER_COLLIDER];
+  u16 cursor[CELL_COUNT];
+
+  /* Count how many colliders land in each cell... */
+  for (int c = 0; c <= CELL_COUNT; c++) {
+    cellStart[c] = 0;
+  }
+  for (int i = 0; i < colliderCount; i++) {
+    int count = cellsCovered(colliderX[i], colliderY[i], colliderWidth[i],
+                             colliderHeight[i], cells);
+    for (int k = 0; k < count; k++) {
+      cellStart[cells[k] + 1]++;
+    }
+  }
+
+  /* ...turn the counts into where each cell's list starts... */
+  for (int c = 0; c < CELL_COUNT; c++) {
+    cellStart[c + 1] += cellStart[c];
+    cursor[c] = cellStart[c];
+  }
+
+  /* ...and drop each collider into its cells. */
+  for (int i = 0; i < colliderCount; i++) {
+    int count = cellsCovered(colliderX[i], colliderY[i], colliderWidth[i],
+                             colliderHeight[i], cells);
+    for (int k = 0; k < count; k++) {
+      cellEntries[cursor[cells[k]]++] = i;
+    }
+  }
+}
+
+/*
+ *  The narrow phase. Boxes are tested first, as any two shapes that touch
+ *  have touching boxes. Circles are then tested in doubled coordinates, so
+ *  that centres and radii stay whole numbers.
+ */
+bool CollisionGrid::overlaps(int a, int b) const {
+  bool overlapX =
+      startsInside(colliderX[a], colliderWidth[a], colliderX[b], WORLD_WIDTH) ||
+      startsInside(colliderX[b], colliderWidth[b], colliderX[a], WORLD_WIDTH);
+  bool overlapY = startsInside(colliderY[a], colliderHeight[a], colliderY[b],
+                               WORLD_HEIGHT) ||
+                  startsInside(colliderY[b], colliderHeight[b], colliderY[a],
+                               WORLD_HEIGHT);
+  if (!overlapX || !overlapY) {
+    return false;
+  }
+  if (colliderShape[a] == COLLIDER_AABB && colliderShape[b] == COLLIDER_AABB) {
+    return true;
+  }
+
+  /* Make a the circle. */
+  if (colliderShape[a] != COLLIDER_CIRCLE) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+
+  /* The centre of b relative to the centre of a. */
+  int dx = wrapDelta((colliderX[b] * 2 + colliderWidth[b]) -
+                         (colliderX[a] * 2 + colliderWidth[a]),
+                     WORLD_WIDTH * 2);
+  int dy = wrapDelta((colliderY[b] * 2 + colliderHeight[b]) -
+                         (colliderY[a] * 2 + colliderHeight[a]),
+                     WORLD_HEIGHT * 2);
+  int radiusA = colliderWidth[a] < colliderHeight[a] ? colliderWidth[a]
+                                                     : colliderHeight[a];
+
+  if (colliderShape[b] == COLLIDER_CIRCLE) {
+    int radiusB = colliderWidth[b] < colliderHeight[b] ? colliderWidth[b]
+                                                       : colliderHeight[b];
+    int reach = radiusA + radiusB;
+    return dx * dx + dy * dy < reach * reach;
+  }
+
+  /* The point of box b closest to the centre of circle a. */
+  int closestX = clamp(0, dx - colliderWidth[b], dx + colliderWidth[b]);
+  int closestY = clamp(0, dy - colliderHeight[b], dy + colliderHeight[b]);
+  return closestX * closestX + closestY * closestY < radiusA * radiusA;
+}
+
+/*
+ *  Two colliders that share several cells would be found in each of them.
+ *  The top left corner of the area where their boxes overlap lies in
+ *  exactly one cell, which both colliders are in, so only that cell reports
+ *  the pair.
+ */
+bool CollisionGrid::ownsPair(int cell, int a, int b) const {
+  int startX =
+      startsInside(colliderX[a], colliderWidth[a], colliderX[b], WORLD_WIDTH)
+          ? colliderX[b]
+          : colliderX[a];
+  int startY = startsInside(colliderY[a], colliderHeight[a], colliderY[b],
+                            WORLD_HEIGHT)
+                   ? colliderY[b]
+                   : colliderY[a];
+  return cell == (startY / CELL_SIZE) * GRID_WIDTH + startX / CELL_SIZE;
+}
+
+void CollisionGrid::addContact(int a, int b) {
+  if (contactCount == MAX_CONTACTS) {
+    droppedContacts++;
+    return;
+  }
+  contacts[contactCount].a = colliderId[a];
+  contacts[contactCount].b = colliderId[b];
+  contactCount++;
+}
+
+int CollisionGrid::findContacts() {
+  contactCount = 0;
+  droppedContacts = 0;
+  buildGrid();
+
+  for (int cell = 0; cell < CELL_COUNT; cell++) {
+    int end = cellStart[cell + 1];
+    for (int i = cellStart[cell]; i < end; i++) {
+      for (int j = i + 1; j < end; j++) {
+        int a = cellEntries[i];
+        int b = cellEntries[j];
+        if (overlaps(a, b) && ownsPair(cell, a, b)) {
+          addContact(a, b);
+        }
+      }
+    }
+  }
+
+  return contactCount;
+}
+
+int CollisionGrid::findContactsNaive() {
+  contactCount = 0;
+  droppedContacts = 0;
+
+  for (int a = 0; a < colliderCount; a++) {
+    for (int b = a + 1; b < colliderCount; b++) {
+      if (overlaps(a, b)) {
+        addContact(a, b);
+      }
+    }
+  }
+
+  return contactCount;
+}
@@ -0,0 +1,108 @@
+/*
+ *  compression.cpp
+ *
+ *  Loading of graphics compressed by grit (with -gzl, -gzr or -gzh) into
+ *  video memory.
+ *
+ */
+
+#include "compression.h"
+#include <nds.h>
+#include <stdlib.h>
+
+/* The DMA channel used when there is no queue to copy bounce buffers. */
+static const int BOUNCE_DMA_CHANNEL = 3;
+
+/* The timers the benchmark may use (it also takes the next one up). */
+static const int BENCHMARK_TIMER = 2;
+
+int getCompressionType(const void *data) {
+  return *(const u32 *)data & 0xF0;
+}
+
+u32 getDecompressedSize(const void *data) { return *(const u32 *)data >> 8; }
+
+static void freeBounceBuffer(DmaFence fence, void *userData) {
+  (void)fence;
+  free(userData);
+}
+
+/* Decompress into main RAM (vram false) or into video memory (vram true). */
+static void decompressTo(const void *data, void *dst, bool vram) {
+  switch (getCompressionType(data)) {
+  case COMPRESSION_LZ77:
+    decompress(data, dst, vram ? LZ77Vram : LZ77);
+    break;
+  case COMPRESSION_RLE:
+    decompress(data, dst, vram ? RLEVram : RLE);
+    break;
+  case COMPRESSION_HUFFMAN:
+    /* This writes 32 bits at a time, which video memory is fine with. */
+    decompress(data, dst, HUFF);
+    break;
+  }
+}
+
+bool loadCompressed(const void *data, void *dst, DecompressionPath path,
+                    DmaQueue *dmaQueue) {
+  if (path == DECOMPRESS_DIRECT) {
+    decompressTo(data, dst, true);
+    return true;
+  }
+
+  u32 size = getDecompressedSize(data);
+  void *buffer = malloc(size);
+  if (buffer == NULL) {
+    return false;
+  }
+  decompressTo(data, buffer, false);
+
+  /*
+   *  The queue flushes the buffer out of the data cache for us, and frees
+   *  it once the copy is done.
+   */
+  if (dmaQueue &&
+      dmaQueue->submit(buffer, dst, size, 0, DmaQueue::NO_DEADLINE,
+                       freeBounceBuffer, buffer) != 0) {
+    return true;
+  }
+
+  DC_FlushRange(buffer, size);
+  dmaCopyWords(BOUNCE_DMA_CHANNEL, buffer, dst, size);
+  free(buffer);
+  return true;
+}
+
+void benchmarkCompressed(const void *data, u32 compressedBytes, void *dst,
+                         CompressionBenchmark *out) {
+  u32 size = getDecompressedSize(data);
+  out->compressedBytes = compressedBytes;
+  out->decodedBytes = size;
+  out->directTicks = 0;
+  out->rawCopyTicks = 0;
+  out->bounceTicks = 0;
+
+  void *buffer = malloc(size);
+  if (buffer == NULL) {
+    return;
+  }
+
+  /* Bounce path: decompress to main RAM, then DMA to video memory. */
+  cpuStartTiming(BENCHMARK_TIMER);
+  decompressTo(data, buffer, false);
+  DC_FlushRange(buffer, size);
+  dmaCopyWords(BOUNCE_DMA_CHANNEL, buffer, dst, size);
+  out->bounceTicks = cpuEndTiming();
+
+  /* Uncompressed path: just the DMA of already decompressed data. */
+  cpuStartTiming(BENCHMARK_TIMER);
+  dmaCopyWords(BOUNCE_DMA_CHANNEL, buffer, dst, size);
+  out->rawCopyTicks = cpuEndTiming();
+
+  /* Direct path: decompress straight into video memory. */
+  cpuStartTiming(BENCHMARK_TIMER);
+  decompressTo(data, dst, true);
+  out->directTicks = cpuEndTiming();
+
+  free(buffer);
+}
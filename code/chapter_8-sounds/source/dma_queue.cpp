@@ -0,0 +1,270 @@
+/*
+ *  dma_queue.cpp
+ *
+ *  A queue of DMA transfers that are spread out over several frames.
+ *
+ */
+
+#include "dma_queue.h"
+#include <nds.h>
+
+/* Main RAM is the only memory the data cache sits in front of. */
+static bool isMainRam(const void *address) {
+  return ((uintptr_t)address >> 24) == 0x02;
+}
+
+DmaQueue::DmaQueue(u32 _frameBudget, u32 _channelMask) {
+  frameBudget = _frameBudget;
+  channelMask = _channelMask;
+  frame = 0;
+  nextFence = 1;
+  bytesStarted = 0;
+  deadlineMisses = 0;
+
+  for (int i = 0; i < MAX_JOBS; i++) {
+    jobs[i].used = false;
+  }
+  for (int i = 0; i < DMA_CHANNELS; i++) {
+    channelJob[i] = -1;
+  }
+}
+
+DmaFence DmaQueue::submit(const void *src, void *dst, u32 bytes, int priority,
+                          u32 deadline, DmaCallback callback, void *userData) {
+  int index = -1;
+  for (int i = 0; i < MAX_JOBS; i++) {
+    if (!jobs[i].used) {
+      index = i;
+      break;
+    }
+  }
+  if (index < 0) {
+    return 0;
+  }
+
+  /*
+   *  DMA reads memory directly, so anything the CPU wrote to the source
+   *  that is still sitting in the data cache has to be written back first.
+   */
+  DC_FlushRange(src, bytes);
+
+  Job *job = &jobs[index];
+  job->src = (const u8 *)src;
+  job->dst = (u8 *)dst;
+  job->bytes = bytes;
+  job->started = 0;
+  job->priority = priority;
+  if (deadline == NO_DEADLINE || frame + deadline < frame) {
+    job->deadline = NO_DEADLINE;
+  } else {
+    job->deadline = frame + deadline;
+  }
+  job->callback = callback;
+  job->userData = userData;
+  job->fence = nextFence++;
+  job->used = true;
+
+  return job->fence;
+}
+
+void DmaQueue::retireChannel(int channel) {
+  int index = channelJob[channel];
+  channelJob[channel] = -1;
+
+  Job *job = &jobs[index];
+  if (job->started < job->bytes) {
+    /* Only part of the job is done. It carries on in a later chunk. */
+    return;
+  }
+
+  /* Make sure the CPU doesn't read stale cached data over the copy. */
+  if (isMainRam(job->dst)) {
+    DC_InvalidateRange(job->dst, job->bytes);
+  }
+
+  job->used = false;
+  if (job->callback) {
+    job->callback(job->fence, job->userData);
+  }
+}
+
+void DmaQueue::retire() {
+  for (int channel = 0; channel < DMA_CHANNELS; channel++) {
+    if (channelJob[channel] >= 0 && !dmaBusy(channel)) {
+      retireChannel(channel);
+    }
+  }
+}
+
+int DmaQueue::pickJob() const {
+  /*
+   *  Jobs whose deadline has arrived go first, then higher priority jobs,
+   *  then the jobs with the nearest deadline.
+   */
+  int best = -1;
+  for (int i = 0; i < MAX_JOBS; i++) {
+    const Job *job = &jobs[i];
+    if (!job->used || job->started == job->bytes) {
+      continue;
+    }
+
+    bool running = false;
+    for (int channel = 0; channel < DMA_CHANNELS; channel++) {
+      if (channelJob[channel] == i) {
+        running = true;
+      }
+    }
+    if (running) {
+      continue;
+    }
+
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+
+    const Job *other = &jobs[best];
+    bool urgent = job->deadline <= frame;
+    bool otherUrgent = other->deadline <= frame;
+    if (urgent != otherUrgent) {
+      if (urgent) {
+        best = i;
+      }
+    } else if (job->priority != other->priority) {
+      if (job->priority > other->priority) {
+        best = i;
+      }
+    } else if (job->deadline < other->deadline) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void DmaQueue::startChunk(int channel, int jobIndex, u32 bytes) {
+  Job *job = &jobs[jobIndex];
+  const u8 *src = job->src + job->started;
+  u8 *dst = job->dst + job->started;
+
+  /* Word transfers move twice as much per bus cycle, when we can use them. */
+  if ((((uintptr_t)src | (uintptr_t)dst | bytes) & 3) == 0) {
+    dmaCopyWordsAsynch(channel, src, dst, bytes);
+  } else {
+    dmaCopyHalfWordsAsynch(channel, src, dst, bytes);
+  }
+
+  job->started += bytes;
+  channelJob[channel] = jobIndex;
+  bytesStarted += bytes;
+}
+
+u32 DmaQueue::chunkSize(int jobIndex, u32 budget, bool unlimited) const {
+  const Job *job = &jobs[jobIndex];
+  u32 remaining = job->bytes - job->started;
+  if (unlimited || job->deadline <= frame || remaining <= budget) {
+    return remaining;
+  }
+  /* Keep the pieces word aligned, so the rest can use word copies. */
+  return budget & ~3;
+}
+
+void DmaQueue::schedule(bool unlimited) {
+  u32 budget = frameBudget;
+
+  /*
+   *  A channel that finishes goes straight on to the next job, for as long
+   *  as the budget lasts, so lots of small jobs don't take a frame each.
+   *  The last chunk on each channel is left running, and is retired on a
+   *  later call.
+   */
+  for (;;) {
+    bool started = false;
+    bool waiting = false;
+    for (int channel = 0; channel < DMA_CHANNELS; channel++) {
+      if (!(channelMask & BIT(channel))) {
+        continue;
+      }
+      if (channelJob[channel] >= 0) {
+        if (dmaBusy(channel)) {
+          waiting = true;
+          continue;
+        }
+        retireChannel(channel);
+      }
+
+      int index = pickJob();
+      if (index < 0) {
+        continue;
+      }
+      u32 chunk = chunkSize(index, budget, unlimited);
+      if (chunk == 0) {
+        continue;
+      }
+
+      startChunk(channel, index, chunk);
+      budget = chunk > budget ? 0 : budget - chunk;
+      started = true;
+    }
+
+    if (!started) {
+      /* Stop, unless there is more to start once a busy channel is free. */
+      if (!waiting) {
+        return;
+      }
+      int index = pickJob();
+      if (index < 0 || chunkSize(index, budget, unlimited) == 0) {
+        return;
+      }
+    }
+  }
+}
+
+void DmaQueue::service() {
+  frame++;
+  bytesStarted = 0;
+
+  retire();
+  schedule(false);
+
+  deadlineMisses = 0;
+  for (int i = 0; i < MAX_JOBS; i++) {
+    if (jobs[i].used && jobs[i].deadline < frame) {
+      deadlineMisses++;
+    }
+  }
+}
+
+bool DmaQueue::isComplete(DmaFence fence) const {
+  for (int i = 0; i < MAX_JOBS; i++) {
+    if (jobs[i].used && jobs[i].fence == fence) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void DmaQueue::flush() {
+  for (;;) {
+    bool pending = false;
+    for (int i = 0; i < MAX_JOBS; i++) {
+      if (jobs[i].used) {
+        pending = true;
+      }
+    }
+    if (!pending) {
+      return;
+    }
+
+    for (int channel = 0; channel < DMA_CHANNELS; channel++) {
+      while (channelJob[channel] >= 0 && dmaBusy(channel)) {
+        /* Wait for the channel to finish. */
+      }
+    }
+    retire();
+    schedule(true);
+  }
+}
+
+u32 DmaQueue::getBytesStarted() const { return bytesStarted; }
+
+u32 DmaQueue::getDeadlineMisses() const { return deadlineMisses; }
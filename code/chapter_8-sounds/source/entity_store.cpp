@@ -0,0 +1,238 @@
+/*
+ *  entity_store.cpp
+ *
+ *  Storage for large numbers of simple moving objects, kept as a structure
+ *  of arrays.
+ *
+ */
+
+#include "entity_store.h"
+#include "tcm.h"
+#include <assert.h>
+#include <nds.h>
+
+static int handleSlot(EntityHandle handle) { return handle & 0xFFFF; }
+
+static u16 handleGeneration(EntityHandle handle) { return handle >> 16; }
+
+static EntityHandle makeHandle(int slot, u16 generation) {
+  return ((EntityHandle)generation << 16) | slot;
+}
+
+EntityStore::EntityStore() {
+  count = 0;
+
+  /* Hand out low slots first, just to make handles easier to read. */
+  freeCount = MAX_ENTITIES;
+  for (int i = 0; i < MAX_ENTITIES; i++) {
+    freeSlots[i] = MAX_ENTITIES - 1 - i;
+    slotGeneration[i] = 1;
+  }
+}
+
+EntityHandle EntityStore::create(EntityKind _kind,
+                                 MathVector2D<fixed> position,
+                                 MathVector2D<fixed> velocity, int _angle,
+                                 u16 _sprite, u16 _lifetime) {
+  if (freeCount == 0) {
+    return INVALID_ENTITY;
+  }
+
+  int slot = freeSlots[--freeCount];
+  int index = count++;
+
+  positionX[index] = position.x.raw;
+  positionY[index] = position.y.raw;
+  velocityX[index] = velocity.x.raw;
+  velocityY[index] = velocity.y.raw;
+  angle[index] = _angle;
+  sprite[index] = _sprite;
+  lifetime[index] = _lifetime;
+  kind[index] = _kind;
+
+  denseToSlot[index] = slot;
+  slotToDense[slot] = index;
+
+  return makeHandle(slot, slotGeneration[slot]);
+}
+
+void EntityStore::removeAt(int index) {
+  int slot = denseToSlot[index];
+
+  /* Retire the handle, skipping generation 0 when it wraps. */
+  if (++slotGeneration[slot] == 0) {
+    slotGeneration[slot] = 1;
+  }
+  freeSlots[freeCount++] = slot;
+
+  /* Fill the hole with the last entity, so the arrays stay packed. */
+  int last = --count;
+  if (index != last) {
+    positionX[index] = positionX[last];
+    positionY[index] = positionY[last];
+    velocityX[index] = velocityX[last];
+    velocityY[index] = velocityY[last];
+    angle[index] = angle[last];
+    sprite[index] = sprite[last];
+    lifetime[index] = lifetime[last];
+    kind[index] = kind[last];
+
+    int movedSlot = denseToSlot[last];
+    denseToSlot[index] = movedSlot;
+    slotToDense[movedSlot] = index;
+  }
+}
+
+void EntityStore::destroy(EntityHandle handle) {
+  int index = indexOf(handle);
+  if (index >= 0) {
+    removeAt(index);
+  }
+}
+
+int EntityStore::indexOf(EntityHandle handle) const {
+  int slot = handleSlot(handle);
+  if (slot >= MAX_ENTITIES ||
+      slotGeneration[slot] != handleGeneration(handle)) {
+    return -1;
+  }
+
+  /* A free slot's generation has already moved on, so this slot is live. */
+  return slotToDense[slot];
+}
+
+MathVector2D<fixed> EntityStore::getPosition(EntityHandle handle) const {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  MathVector2D<fixed> position;
+  position.x = fixed::fromRaw(positionX[index]);
+  position.y = fixed::fromRaw(positionY[index]);
+  return position;
+}
+
+void EntityStore::setPosition(EntityHandle handle,
+                              MathVector2D<fixed> position) {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  positionX[index] = position.x.raw;
+  positionY[index] = position.y.raw;
+}
+
+MathVector2D<fixed> EntityStore::getVelocity(EntityHandle handle) const {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  MathVector2D<fixed> velocity;
+  velocity.x = fixed::fromRaw(velocityX[index]);
+  velocity.y = fixed::fromRaw(velocityY[index]);
+  return velocity;
+}
+
+void EntityStore::setVelocity(EntityHandle handle,
+                              MathVector2D<fixed> velocity) {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  velocityX[index] = velocity.x.raw;
+  velocityY[index] = velocity.y.raw;
+}
+
+int EntityStore::getAngle(EntityHandle handle) const {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  return angle[index] & (DEGREES_IN_CIRCLE - 1);
+}
+
+void EntityStore::setAngle(EntityHandle handle, int _angle) {
+  int index = indexOf(handle);
+  assert(index >= 0);
+
+  angle[index] = _angle;
+}
+
+HOT_CODE void EntityStore::integrate() {
+  const s32 maskX = (WORLD_WIDTH << fixed::FRACTION_BITS) - 1;
+  const s32 maskY = (WORLD_HEIGHT << fixed::FRACTION_BITS) - 1;
+
+  /*
+   *  Do the x and y axes in separate passes. Each pass only streams through
+   *  two arrays, which keeps the cache from evicting lines we are still
+   *  using.
+   */
+  for (int i = 0; i < count; i++) {
+    positionX[i] = (positionX[i] + velocityX[i]) & maskX;
+  }
+  for (int i = 0; i < count; i++) {
+    positionY[i] = (positionY[i] + velocityY[i]) & maskY;
+  }
+}
+
+int EntityStore::age(OAMShadow *oamShadow) {
+  int destroyed = 0;
+
+  /*
+   *  Walk backwards, so the entity removeAt() moves into a hole has
+   *  already been aged this frame.
+   */
+  for (int i = count - 1; i >= 0; i--) {
+    if (lifetime[i] != LIFETIME_FOREVER && --lifetime[i] == 0) {
+      if (sprite[i] != NO_SPRITE) {
+        setSpriteVisibility(&oamShadow->table->oamBuffer[sprite[i]], true);
+        oamShadow->markEntry(sprite[i]);
+      }
+      removeAt(i);
+      destroyed++;
+    }
+  }
+
+  return destroyed;
+}
+
+/*
+ *  Returns where along one axis of the screen a raw fixed-point world
+ *  position goes, given the world position at the middle of the screen.
+ *  The world wraps every worldSize pixels, which is a power of two.
+ */
+static inline int toScreen(s32 position, int middle, int worldSize,
+                           int screenSize) {
+  int offset = ((position >> fixed::FRACTION_BITS) - middle + worldSize / 2) &
+               (worldSize - 1);
+  return offset - worldSize / 2 + screenSize / 2;
+}
+
+HOT_CODE void EntityStore::writeSprites(OAMShadow *oamShadow,
+                                        MathVector2D<int> view) const {
+  /* The biggest sprite the hardware has. */
+  static const int MAX_SPRITE_SIZE = 64;
+
+  /*
+   *  Measure from the middle of the screen, as Camera::toScreen() does, so
+   *  that each entity is placed the short way round the world from it.
+   */
+  int middleX = view.x + SCREEN_WIDTH / 2;
+  int middleY = view.y + SCREEN_HEIGHT / 2;
+
+  for (int i = 0; i < count; i++) {
+    if (sprite[i] == NO_SPRITE) {
+      continue;
+    }
+
+    int x = toScreen(positionX[i], middleX, WORLD_WIDTH, SCREEN_WIDTH);
+    int y = toScreen(positionY[i], middleY, WORLD_HEIGHT, SCREEN_HEIGHT);
+
+    /*
+     *  Entity sprites aren't affine, so the hidden bit alone hides them
+     *  (see setSpriteVisibility()). A sprite hanging off the top or left
+     *  wraps round to show its visible part.
+     */
+    SpriteEntry *entry = &oamShadow->table->oamBuffer[sprite[i]];
+    entry->isHidden = x <= -MAX_SPRITE_SIZE || x >= SCREEN_WIDTH ||
+                      y <= -MAX_SPRITE_SIZE || y >= SCREEN_HEIGHT;
+    entry->x = x & 0x1FF;
+    entry->y = y & 0xFF;
+    oamShadow->markEntry(sprite[i]);
+  }
+}
@@ -0,0 +1,33 @@
+/*
+ *  float_ship.cpp
+ *
+ *  A float port of Ship's kinematics.
+ *
+ */
+
+#include "float_ship.h"
+#include "ship.h"
+#include <math.h>
+
+const float FloatShip::TURN_SPEED = 192 * 2 * (float)PI / DEGREES_IN_CIRCLE;
+const float FloatShip::THRUST = fixed::fromFloat(.05).toFloat();
+
+void FloatShip::accelerate() {
+  vx += THRUST * sinf(angle);
+  vy -= THRUST * cosf(angle);
+
+  float speed = sqrtf(vx * vx + vy * vy);
+  if (speed > 1) {
+    vx /= speed;
+    vy /= speed;
+  }
+}
+
+void FloatShip::move() {
+  x = fmodf(x + vx + WORLD_WIDTH, WORLD_WIDTH);
+  y = fmodf(y + vy + WORLD_HEIGHT, WORLD_HEIGHT);
+}
+
+void FloatShip::turnClockwise() { angle += TURN_SPEED; }
+
+void FloatShip::turnCounterClockwise() { angle -= TURN_SPEED; }
@@ -0,0 +1,121 @@
+/*
+ *  game_loop.cpp
+ *
+ *  Runs the game simulation at a fixed rate, no matter how long each frame
+ *  takes to draw.
+ *
+ */
+
+#include "game_loop.h"
+#include "profiler.h"
+#include <nds.h>
+
+/* VBlank starts when the hardware begins drawing this line. */
+static const int VBLANK_START_LINE = SCREEN_HEIGHT;
+
+volatile u32 GameLoop::vblankCount = 0;
+
+void GameLoop::onVBlank() { vblankCount++; }
+
+GameLoop::GameLoop(int _tickLines, int _maxCatchUp) {
+  tickLines = _tickLines;
+  maxCatchUp = _maxCatchUp;
+  accumulator = 0;
+  lastTime = 0;
+  droppedFrames = 0;
+  droppedTicks = 0;
+}
+
+void GameLoop::start() {
+  irqSet(IRQ_VBLANK, onVBlank);
+  irqEnable(IRQ_VBLANK);
+  lastTime = now();
+
+  /*
+   *  Start half a tick in, so that the small changes in when each frame
+   *  calls beginFrame() don't flip between running zero ticks and two.
+   */
+  accumulator = tickLines / 2;
+}
+
+u32 GameLoop::now() {
+  /*
+   *  Count whole frames by VBlanks, then add the lines drawn since the last
+   *  one. If a VBlank happens between reading the two, start over.
+   */
+  u32 frames;
+  int line;
+  do {
+    frames = vblankCount;
+    line = REG_VCOUNT;
+  } while (frames != vblankCount);
+
+  int linesSinceVBlank =
+      (line - VBLANK_START_LINE + LINES_PER_FRAME) % LINES_PER_FRAME;
+  return frames * LINES_PER_FRAME + linesSinceVBlank;
+}
+
+void GameLoop::waitForLine(int line) {
+  /*
+   *  Spin on the line counter. A VCOUNT interrupt could wait more politely,
+   *  but we only wait this way to measure things, and the interrupt might
+   *  be in use already.
+   *
+   *  If the line has already gone by this frame, first wait for the frame
+   *  to end, or we would return straight away.
+   */
+  while (REG_VCOUNT > line && REG_VCOUNT < SCREEN_HEIGHT) {
+  }
+  while (REG_VCOUNT < line || REG_VCOUNT >= SCREEN_HEIGHT) {
+  }
+}
+
+int GameLoop::beginFrame() {
+  u32 time = now();
+  s32 elapsed = time - lastTime;
+  lastTime = time;
+
+  /*
+   *  Right as VBlank starts, the line counter can wrap before the interrupt
+   *  has counted the new frame, and time seems to go backwards. Just wait
+   *  for it to catch up.
+   */
+  if (elapsed < 0) {
+    elapsed = 0;
+  }
+
+  /* Any whole frame beyond the first is one we never drew. */
+  int frames = (elapsed + LINES_PER_FRAME / 2) / LINES_PER_FRAME;
+  if (frames > 1) {
+    droppedFrames += frames - 1;
+  }
+
+  accumulator += elapsed;
+  int ticks = accumulator / tickLines;
+  accumulator -= ticks * tickLines;
+
+  /* Give up on time we can't catch up on, rather than fall further behind. */
+  if (ticks > maxCatchUp) {
+    droppedTicks += ticks - maxCatchUp;
+    ticks = maxCatchUp;
+  }
+
+  profilerSetCounter(PROFILE_COUNTER_DROPPED_FRAMES, droppedFrames);
+  profilerSetCounter(PROFILE_COUNTER_DROPPED_TICKS, droppedTicks);
+  profilerSetCounter(PROFILE_COUNTER_TICK_LAG, accumulator);
+
+  return ticks;
+}
+
+fixed GameLoop::getAlpha() const {
+  return fixed::fromRaw((accumulator << fixed::FRACTION_BITS) / tickLines);
+}
+
+MathVector2D<fixed> GameLoop::interpolate(MathVector2D<fixed> previous,
+                                          MathVector2D<fixed> current) const {
+  MathVector2D<fixed> delta = worldDelta(previous, current);
+  MathVector2D<fixed> result = previous + delta * getAlpha();
+  result.x.raw &= (WORLD_WIDTH << fixed::FRACTION_BITS) - 1;
+  result.y.raw &= (WORLD_HEIGHT << fixed::FRACTION_BITS) - 1;
+  return result;
+}
@@ -0,0 +1,181 @@
+/*
+ *  input.cpp
+ *
+ *  The player's input for one simulation tick, and a way to record it and
+ *  play it back.
+ *
+ */
+
+#include "input.h"
+#include <nds.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The flags at the start of each recorded tick. */
+static const u8 HELD_CHANGED = BIT(7);
+static const u8 TOUCH_CHANGED = BIT(6);
+static const u8 REPEAT_MASK = 0x3F;
+
+/* Recording files start with this, then the tick count and byte length. */
+static const char FILE_MAGIC[4] = {'I', 'N', 'P', '1'};
+
+void nextInputState(InputState *state, u16 held, int touchX, int touchY) {
+  state->down = held & ~state->held;
+  state->held = held;
+
+  /* Touch coordinates are only valid while the screen is touched. */
+  if (held & KEY_TOUCH) {
+    state->touchX = touchX;
+    state->touchY = touchY;
+  }
+}
+
+InputRecording::InputRecording() { reset(); }
+
+void InputRecording::reset() {
+  length = 0;
+  tickCount = 0;
+  full = false;
+  runByte = -1;
+  memset(&last, 0, sizeof(last));
+  rewind();
+}
+
+bool InputRecording::record(const InputState *state) {
+  u8 flags = 0;
+  if (state->held != last.held) {
+    flags |= HELD_CHANGED;
+  }
+  if (state->touchX != last.touchX || state->touchY != last.touchY) {
+    flags |= TOUCH_CHANGED;
+  }
+
+  /* Lengthen the current run of unchanged ticks, if there is room in it. */
+  if (flags == 0 && runByte >= 0 && data[runByte] < REPEAT_MASK) {
+    data[runByte]++;
+    tickCount++;
+    return true;
+  }
+
+  int bytes = 1;
+  if (flags & HELD_CHANGED) {
+    bytes += 2;
+  }
+  if (flags & TOUCH_CHANGED) {
+    bytes += 2;
+  }
+  if (length + bytes > MAX_BYTES) {
+    full = true;
+    return false;
+  }
+
+  runByte = flags == 0 ? length : -1;
+  data[length++] = flags;
+  if (flags & HELD_CHANGED) {
+    data[length++] = state->held & 0xFF;
+    data[length++] = state->held >> 8;
+  }
+  if (flags & TOUCH_CHANGED) {
+    data[length++] = state->touchX;
+    data[length++] = state->touchY;
+  }
+
+  last = *state;
+  tickCount++;
+  return true;
+}
+
+void InputRecording::rewind() {
+  readPosition = 0;
+  ticksRead = 0;
+  repeatsLeft = 0;
+  memset(&last, 0, sizeof(last));
+}
+
+bool InputRecording::replay(InputState *state) {
+  if (ticksRead == tickCount) {
+    return false;
+  }
+
+  if (repeatsLeft > 0) {
+    repeatsLeft--;
+  } else {
+    /* A damaged file can claim more ticks than its data holds. */
+    if (readPosition >= length) {
+      return false;
+    }
+    u8 flags = data[readPosition];
+    int bytes = 1;
+    if (flags & HELD_CHANGED) {
+      bytes += 2;
+    }
+    if (flags & TOUCH_CHANGED) {
+      bytes += 2;
+    }
+    if (readPosition + bytes > length) {
+      return false;
+    }
+
+    readPosition++;
+    if (flags & HELD_CHANGED) {
+      last.held = data[readPosition] | data[readPosition + 1] << 8;
+      readPosition += 2;
+    }
+    if (flags & TOUCH_CHANGED) {
+      last.touchX = data[readPosition];
+      last.touchY = data[readPosition + 1];
+      readPosition += 2;
+    }
+    if ((flags & (HELD_CHANGED | TOUCH_CHANGED)) == 0) {
+      repeatsLeft = flags & REPEAT_MASK;
+    }
+  }
+
+  /* The same as nextInputState(), with the touch position as recorded. */
+  state->down = last.held & ~state->held;
+  state->held = last.held;
+  state->touchX = last.touchX;
+  state->touchY = last.touchY;
+
+  ticksRead++;
+  return true;
+}
+
+bool InputRecording::save(const char *path) const {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  u32 header[2] = {(u32)tickCount, (u32)length};
+  bool written = fwrite(FILE_MAGIC, sizeof(FILE_MAGIC), 1, file) == 1 &&
+                 fwrite(header, sizeof(header), 1, file) == 1 &&
+                 fwrite(data, 1, length, file) == (size_t)length;
+  return fclose(file) == 0 && written;
+}
+
+bool InputRecording::load(const char *path) {
+  reset();
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  char magic[sizeof(FILE_MAGIC)];
+  u32 header[2];
+  bool valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+               memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0 &&
+               fread(header, sizeof(header), 1, file) == 1 &&
+               header[1] <= (u32)MAX_BYTES &&
+               fread(data, 1, header[1], file) == header[1];
+  fclose(file);
+
+  if (!valid) {
+    return false;
+  }
+
+  tickCount = header[0];
+  length = header[1];
+  return true;
+}
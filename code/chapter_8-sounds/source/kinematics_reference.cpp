@@ -0,0 +1,37 @@
+/*
+ *  kinematics_reference.cpp
+ *
+ *  Older versions of the ship's maths, kept so that the benchmarks can time
+ *  the current versions against them.
+ *
+ */
+
+#include "kinematics_reference.h"
+#include <math.h>
+#include <nds.h>
+
+void accelerateAxisClamp(MathVector2D<fixed> *velocity, int angle) {
+  const fixed thrust = fixed::fromFloat(.05);
+  const fixed maxSpeed = fixed::fromInt(1);
+
+  velocity->x += thrust * fixed::fromRaw(sinLerp(angle));
+  if (velocity->x > maxSpeed) {
+    velocity->x = maxSpeed;
+  }
+  if (velocity->x < -maxSpeed) {
+    velocity->x = -maxSpeed;
+  }
+
+  velocity->y -= thrust * fixed::fromRaw(cosLerp(angle));
+  if (velocity->y > maxSpeed) {
+    velocity->y = maxSpeed;
+  }
+  if (velocity->y < -maxSpeed) {
+    velocity->y = -maxSpeed;
+  }
+}
+
+s32 atan2Float(s32 y, s32 x) {
+  float angle = atan2f((float)y / fixed::ONE, (float)x / fixed::ONE);
+  return (s32)(angle * (DEGREES_IN_CIRCLE / (2 * PI)));
+}
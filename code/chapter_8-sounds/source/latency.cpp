@@ -0,0 +1,129 @@
+/*
+ *  latency.cpp
+ *
+ *  Measures how long it takes from pressing a button to seeing the ship
+ *  react on screen.
+ *
+ */
+
+#include "latency.h"
+
+#ifdef LATENCY_TRACE
+
+#include "game_loop.h"
+#include <nds.h>
+#include <stdio.h>
+
+/* How many traces to finish between reports. */
+static const int REPORT_INTERVAL = 16;
+
+/*
+ *  GameLoop::now() counts from the start of VBlank, so the display reaches
+ *  line 0 this many lines into each frame.
+ */
+static const int FIRST_LINE_OFFSET = LINES_PER_FRAME - SCREEN_HEIGHT;
+
+enum TraceState {
+  TRACE_IDLE,
+  TRACE_SAMPLED,
+  TRACE_TAGGED,
+};
+
+static TraceState state = TRACE_IDLE;
+static u32 sampleTime;
+static int tracedOamId;
+static const SpriteEntry *tracedEntry;
+
+static LatencyStats stats = {0, 0xFFFFFFFF, 0, 0, {0}};
+
+/* Print the histogram to the emulator's debug console. */
+static void printReport() {
+  char line[96];
+
+  snprintf(line, sizeof(line),
+           "latency (lines): n %lu min %lu avg %lu max %lu\n",
+           (unsigned long)stats.count, (unsigned long)stats.min,
+           (unsigned long)(stats.total / stats.count),
+           (unsigned long)stats.max);
+  nocashMessage(line);
+
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (stats.buckets[i] == 0) {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%4d-%4d%s %lu\n", i * LATENCY_BUCKET_LINES,
+             (i + 1) * LATENCY_BUCKET_LINES - 1,
+             i == LATENCY_BUCKETS - 1 ? "+" : " ",
+             (unsigned long)stats.buckets[i]);
+    nocashMessage(line);
+  }
+}
+
+static void addLatency(u32 lines) {
+  stats.count++;
+  stats.total += lines;
+  if (lines < stats.min) {
+    stats.min = lines;
+  }
+  if (lines > stats.max) {
+    stats.max = lines;
+  }
+
+  u32 bucket = lines / LATENCY_BUCKET_LINES;
+  if (bucket >= (u32)LATENCY_BUCKETS) {
+    bucket = LATENCY_BUCKETS - 1;
+  }
+  stats.buckets[bucket]++;
+
+  if (stats.count % REPORT_INTERVAL == 0) {
+    printReport();
+  }
+}
+
+void latencySample(u16 down) {
+  if (!(down & LATENCY_KEYS) || state == TRACE_TAGGED) {
+    return;
+  }
+
+  /* A press that changed nothing yet is forgotten in favour of this one. */
+  state = TRACE_SAMPLED;
+  sampleTime = GameLoop::now();
+}
+
+void latencyTag(int oamId, const SpriteEntry *entry) {
+  if (state != TRACE_SAMPLED) {
+    return;
+  }
+
+  state = TRACE_TAGGED;
+  tracedOamId = oamId;
+  tracedEntry = entry;
+}
+
+void latencyCommit(const u32 *dirtyEntries) {
+  if (state != TRACE_TAGGED ||
+      !(dirtyEntries[tracedOamId / 32] & BIT(tracedOamId % 32))) {
+    return;
+  }
+
+  /*
+   *  The new entry is seen when the display next gets to the sprite's top
+   *  line. Uploads made during VBlank show up on the coming frame. Uploads
+   *  made any later missed it, and show up on the frame after. A sprite
+   *  whose y is past the bottom of the screen wraps around to the top.
+   */
+  int top = tracedEntry->y < SCREEN_HEIGHT ? tracedEntry->y : 0;
+  u32 commitTime = GameLoop::now();
+  u32 frameStart = commitTime - commitTime % LINES_PER_FRAME;
+  u32 shownTime = frameStart + FIRST_LINE_OFFSET + top;
+  if (commitTime % LINES_PER_FRAME >= (u32)FIRST_LINE_OFFSET) {
+    shownTime += LINES_PER_FRAME;
+  }
+
+  addLatency(shownTime - sampleTime);
+  state = TRACE_IDLE;
+}
+
+const LatencyStats *latencyGetStats() { return &stats; }
+
+#endif
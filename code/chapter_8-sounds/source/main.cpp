@@ -6,80 +6,207 @@
  *
  */
 
+#include "audio_stream.h"
+#include "camera.h"
+#include "collision.h"
+#include "compression.h"
+#include "dma_queue.h"
+#include "entity_store.h"
+#include "float_ship.h"
+#include "game_loop.h"
+#include "input.h"
+#include "kinematics_reference.h"
+#include "latency.h"
+#include "matrix_pool.h"
+#include "oam_shadow.h"
+#include "parallax.h"
+#include "profiler.h"
+#include "resource_cache.h"
+#include "sfx.h"
 #include "ship.h"
+#include "sprite_batch.h"
+#include "sprite_gfx.h"
+#include "sprite_mux.h"
 #include "sprites.h"
+#include "tcm.h"
+#include "tiled_background.h"
+#include "trig.h"
+#include "vram_manager.h"
 #include <assert.h>
+#include <fat.h>
+#include <filesystem.h>
 #include <maxmod9.h>
 #include <nds.h>
+#include <stdio.h>
 
 /* Backgrounds */
-#include "planet.h"
 #include "splash.h"
 #include "starField.h"
 /* Sprites */
+#include "alienship.h"
 #include "moon.h"
 #include "orangeShuttle.h"
+#include "weapon.h"
 /* Sounds */
 #include "soundbank.h"
 #include "soundbank_bin.h"
 
-/* Select a low priority DMA channel to perform our background copying. */
-static const int DMA_CHANNEL = 3;
+/*
+ *  How many bytes the DMA queue may start copying each frame. Loading is
+ *  done with the queue flushed, so this only limits copies made while the
+ *  game is running.
+ */
+static const u32 DMA_FRAME_BUDGET = 32 * 1024;
+
+/*
+ *  Where input recordings are kept. Build with -DINPUT_RECORD to record
+ *  everything the player does and press SELECT to save it, and with
+ *  -DINPUT_REPLAY to play it back (see input.h). Replays are looked for in
+ *  NitroFS first, so a recording can be built into the ROM.
+ */
+static const char *INPUT_RECORDING_PATH = "fat:/input.rec";
+static const char *INPUT_REPLAY_NITRO_PATH = "nitro:/input.rec";
+
+/*
+ *  Assets that aren't linked in are loaded from NitroFS, and kept in RAM up
+ *  to this budget (see resource_cache.h). The build makes the planet from
+ *  nitrogfx/planet.png.
+ */
+static const u32 RESOURCE_BUDGET = 64 * 1024;
+static const char *PLANET_RESOURCE = "planet.img.bin";
+
+/* The music streamed when building with -DSTREAM_MUSIC. */
+static const char *MUSIC_PATH = "nitro:/music.wav";
 
-void initVideo() {
+/*
+ *  When building with -DLATE_INPUT, input is read on this line of the
+ *  frame rather than as soon as the last frame is done. That leaves just
+ *  enough time to run a tick and update the sprites before VBlank, so the
+ *  press is seen a frame sooner. Move it up if the game gets busier.
+ */
+static const int LATE_INPUT_LINE = 160;
+
+/*
+ *  Background map, tile and bitmap bases are given to bgInit() in these
+ *  steps of memory.
+ */
+static const u32 MAP_BASE_BYTES = 2 * 1024;
+static const u32 TILE_BASE_BYTES = 16 * 1024;
+static const u32 BMP_BASE_BYTES = 16 * 1024;
+
+/* Where the planet is on screen before the camera moves. */
+static const int PLANET_X = SCREEN_WIDTH / 2 - 32;
+static const int PLANET_Y = 32;
+
+/*
+ *  How many pixels the star field and the planet scroll for each pixel the
+ *  camera moves, and how far the star field leans for each pixel a frame
+ *  the camera moves sideways (see parallax.h).
+ */
+static const fixed STAR_FIELD_RATE = fixed::fromRaw(fixed::ONE / 4);
+static const fixed PLANET_RATE = fixed::fromRaw(fixed::ONE / 2);
+static const fixed STAR_FIELD_LEAN = fixed::fromRaw(fixed::ONE / 16);
+
+/*
+ *  Aliens drift around the world, and the ship shoots at them with A. Both
+ *  are entities (see entity_store.h) that drive a sprite each, the aliens
+ *  from ALIEN_OAM_ID on and the bullets from BULLET_OAM_ID on. Bullets take
+ *  turns with their sprites, so a new one replaces the oldest when all
+ *  BULLET_COUNT are flying. Lifetimes and the time between shots are in
+ *  ticks.
+ */
+static const int ALIEN_COUNT = 8;
+static const int ALIEN_OAM_ID = 2;
+static const int ALIEN_PALETTE = 2;
+static const fixed ALIEN_SPEED = fixed::fromRaw(fixed::ONE / 4);
+static const int BULLET_COUNT = 16;
+static const int BULLET_OAM_ID = ALIEN_OAM_ID + ALIEN_COUNT;
+static const int BULLET_PALETTE = 3;
+static const fixed BULLET_SPEED = fixed::fromInt(3);
+static const int BULLET_LIFETIME = 90;
+static const int FIRE_INTERVAL = 6;
+
+/*
+ *  Our copy of OAM. Every sprite update of every frame touches it, so it
+ *  lives in DTCM (see tcm.h).
+ */
+static OAMTable oamTable HOT_BSS;
+
+void initVideo(VramManager *vram) {
   /*
    *  Map VRAM to display a background on the main and sub screens.
    *
-   *  The vramSetPrimaryBanks function takes four arguments, one for each of
-   *  the major VRAM banks. We can use it as shorthand for assigning values
-   *  to each of the VRAM bank's control registers.
+   *  The VRAM manager (see vram_manager.h) writes each bank's control
+   *  register for us, after checking that the hardware can really put the
+   *  bank there. It also keeps track of which parts of each bank are in
+   *  use, so the backgrounds and sprites below ask it for memory instead of
+   *  picking addresses by hand.
    *
-   *  We map banks A and B to main screen  background memory. This gives us
-   *  256KB, which is a healthy amount for 16-bit graphics.
+   *  We map bank A to main screen background memory. Its 128KB is plenty
+   *  for the star field's tiles and map and the planet's 16-bit bitmap.
    *
-   *  We map bank C to sub screen background memory.
-   *
-   *  We map bank D to LCD. This setting is generally used for when we aren't
-   *  using a particular bank.
+   *  We map bank C to sub screen background memory, for the splash screen.
    *
    *  We map bank E to main screen sprite memory (aka object memory).
+   *
+   *  Banks B and D stay mapped to LCD, the setting for banks we aren't
+   *  using, so they are free for whatever needs them later.
    */
-  vramSetPrimaryBanks(VRAM_A_MAIN_BG_0x06000000, VRAM_B_MAIN_BG_0x06020000,
-                      VRAM_C_SUB_BG_0x06200000, VRAM_D_LCD);
-
-  vramSetBankE(VRAM_E_MAIN_SPRITE);
+  bool mapped = vram->map(VRAM_BANK_A, VRAM_USE_MAIN_BG);
+  mapped &= vram->map(VRAM_BANK_C, VRAM_USE_SUB_BG);
+  mapped &= vram->map(VRAM_BANK_E, VRAM_USE_MAIN_SPRITE);
 
+#ifdef SPRITE_BATCH_BENCHMARK
+  /*
+   *  Drawing sprites with the 3D engine needs texture memory, so put bank
+   *  D to use, and bank F for the textures' palettes. Background 0 shows
+   *  what the 3D engine draws.
+   */
+  mapped &= vram->map(VRAM_BANK_D, VRAM_USE_TEXTURE);
+  mapped &= vram->map(VRAM_BANK_F, VRAM_USE_TEXTURE_PALETTE);
+  videoSetMode(MODE_5_3D | DISPLAY_SPR_ACTIVE | DISPLAY_SPR_1D);
+#else
   /*  Set the video mode on the main screen. */
   videoSetMode(MODE_5_2D |          // Set the graphics mode to Mode 5
                DISPLAY_SPR_ACTIVE | // Enable sprites for display
                DISPLAY_SPR_1D       // Enable 1D tiled sprites
   );
+#endif
 
   /*  Set the video mode on the sub screen. */
   videoSetModeSub(MODE_5_2D);       // Set the graphics mode to Mode 5
+
+  assert(mapped);
 }
 
-void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
+#ifdef PROFILER
+void reportVram(const VramManager *vram) {
+  /* Print what each bank is used for, and how full it is. */
+  nocashMessage("bank use              start  size  used\n");
+  for (int bank = 0; bank < VRAM_BANK_COUNT; bank++) {
+    VramBankInfo info;
+    vram->getBankInfo((VramBank)bank, &info);
+
+    char line[64];
+    snprintf(line, sizeof(line), "%c    %-16s %4luK %4luK %4luK\n",
+             'A' + bank, VramManager::getUseName(info.use),
+             (unsigned long)(info.start / 1024),
+             (unsigned long)(info.size / 1024),
+             (unsigned long)(info.used / 1024));
+    nocashMessage(line);
+  }
+}
+#endif
+
+void initSprites(OAMTable *oam, SpriteInfo *spriteInfo,
+                 SpriteGfxAllocator *spriteGfx, MatrixPool *matrixPool,
+                 DmaQueue *dmaQueue) {
   /*  Define some sprite configuration specific constants.
    *
    *  We will use these to compute the proper index into memory for certain
-   *  tiles or palettes.
-   *
-   *  OFFSET_MULTIPLIER is calculated based on the following formula from
-   *  GBATEK (https://problemkaputt.de/gbatek.htm#dsvideoobjs):
-   *      TileVramAddress = TileNumber * BoundaryValue
-   *  Since SPRITE_GFX is a uint16*, the compiler will increment the address
-   *  it points to by 2 for each change in 1 of the array index into
-   *  SPRITE_GFX. (The compiler does pointer arithmetic.)
+   *  palettes. Tiles are handed out by the sprite graphics allocator.
    */
-  static const int BYTES_PER_16_COLOR_TILE = 32;
   static const int COLORS_PER_PALETTE = 16;
-  static const int BOUNDARY_VALUE = 32; /* This is the default boundary value
-                                         * (can be set in REG_DISPCNT) */
-  static const int OFFSET_MULTIPLIER = BOUNDARY_VALUE / sizeof(SPRITE_GFX[0]);
-
-  /* Keep track of the available tiles. */
-  int nextAvailableTileIdx = 0;
 
   /* Create the ship sprite. */
   static const int SHUTTLE_OAM_ID = 0;
@@ -103,12 +230,6 @@ void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
    */
   shuttle->y = SCREEN_HEIGHT / 2 - shuttleInfo->height;
   shuttle->isRotateScale = true;
-  /* This assert is a check to see a matrix is available to store the affine
-   * transformation matrix for this sprite. Of course, you don't have to have
-   * the matrix id match the affine id, but if you do make them match, this
-   * assert can be helpful.
-   */
-  assert(!shuttle->isRotateScale || (shuttleInfo->oamId < MATRIX_COUNT));
   shuttle->isSizeDouble = false;
   shuttle->blendMode = OBJMODE_NORMAL;
   shuttle->isMosaic = false;
@@ -119,12 +240,13 @@ void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
    *  Configure attribute 1.
    *
    *  rotationIndex refers to the loation of affine transformation matrix. We
-   *  set it to a location computed with a macro. OBJSIZE_64, in our case
-   *  since we are making a square sprite, creates a 64x64 sprite.
+   *  get one from the matrix pool, which rotates it for us and shares it
+   *  with any other sprite at the same angle. OBJSIZE_64, in our case since
+   *  we are making a square sprite, creates a 64x64 sprite.
    */
   shuttle->x =
       SCREEN_WIDTH / 2 - shuttleInfo->width * 2 + shuttleInfo->width / 2;
-  shuttle->rotationIndex = shuttleInfo->oamId;
+  shuttle->rotationIndex = matrixPool->acquire(shuttleInfo->angle);
   shuttle->size = OBJSIZE_64;
 
   /*
@@ -134,14 +256,13 @@ void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
    *  be placed onto, which palette the sprite should use, and whether or not
    *  to show the sprite.
    */
-  shuttle->gfxIndex = nextAvailableTileIdx;
-  nextAvailableTileIdx += orangeShuttleTilesLen / BYTES_PER_16_COLOR_TILE;
+  int shuttleGfxIndex =
+      spriteGfx->acquireShared(orangeShuttleTiles, orangeShuttleTilesLen);
+  assert(shuttleGfxIndex >= 0);
+  shuttle->gfxIndex = shuttleGfxIndex;
   shuttle->priority = OBJPRIORITY_0;
   shuttle->palette = shuttleInfo->oamId;
 
-  /* Rotate the sprite */
-  rotateSprite(&oam->matrixBuffer[shuttleInfo->oamId], shuttleInfo->angle);
-
   /*************************************************************************/
 
   /* Create the moon sprite. */
@@ -165,11 +286,6 @@ void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
    */
   moon->y = SCREEN_WIDTH / 2 + moonInfo->height / 2;
   moon->isRotateScale = false;
-  /* This assert is a check to see a matrix is available to store the affine
-   * transformation matrix for this sprite. Of course, you don't have to have
-   * the matrix id match the affine id, but if you do make them match, this
-   * assert can be helpful. */
-  assert(!moon->isRotateScale || (moonInfo->oamId < MATRIX_COUNT));
   moon->isHidden = false;
   moon->blendMode = OBJMODE_NORMAL;
   moon->isMosaic = false;
@@ -196,56 +312,136 @@ void initSprites(OAMTable *oam, SpriteInfo *spriteInfo) {
    *  be placed onto, which palette the sprite should use, and whether or not
    *  to show the sprite.
    */
-  moon->gfxIndex = nextAvailableTileIdx;
-  nextAvailableTileIdx += moonTilesLen / BYTES_PER_16_COLOR_TILE;
+  int moonGfxIndex = spriteGfx->acquireShared(moonTiles, moonTilesLen);
+  assert(moonGfxIndex >= 0);
+  moon->gfxIndex = moonGfxIndex;
   moon->priority = OBJPRIORITY_2;
   moon->palette = moonInfo->oamId;
 
   /*************************************************************************/
 
+  /*
+   *  Create the alien and bullet sprites. The entity store moves them and
+   *  shows or hides them (see EntityStore::writeSprites()), so they start
+   *  out hidden. Each kind shares one copy of its tiles and one palette.
+   */
+  int alienGfxIndex =
+      spriteGfx->acquireShared(alienshipTiles, alienshipTilesLen);
+  int bulletGfxIndex = spriteGfx->acquireShared(weaponTiles, weaponTilesLen);
+  assert(alienGfxIndex >= 0 && bulletGfxIndex >= 0);
+  assert(BULLET_OAM_ID + BULLET_COUNT <= SPRITE_COUNT);
+
+  for (int oamId = ALIEN_OAM_ID; oamId < BULLET_OAM_ID + BULLET_COUNT;
+       oamId++) {
+    bool alien = oamId < BULLET_OAM_ID;
+    SpriteInfo *info = &spriteInfo[oamId];
+    SpriteEntry *entry = &oam->oamBuffer[oamId];
+
+    info->oamId = oamId;
+    info->width = alien ? 64 : 8;
+    info->height = info->width;
+    info->angle = 0;
+    info->entry = entry;
+
+    entry->isRotateScale = false;
+    entry->isHidden = true;
+    entry->blendMode = OBJMODE_NORMAL;
+    entry->isMosaic = false;
+    entry->colorMode = OBJCOLOR_16;
+    entry->shape = OBJSHAPE_SQUARE;
+    entry->hFlip = false;
+    entry->vFlip = false;
+    entry->size = alien ? OBJSIZE_64 : OBJSIZE_8;
+    entry->gfxIndex = alien ? alienGfxIndex : bulletGfxIndex;
+    entry->priority = OBJPRIORITY_1;
+    entry->palette = alien ? ALIEN_PALETTE : BULLET_PALETTE;
+  }
+
+  /*************************************************************************/
+
   /* Copy over the sprite palettes */
-  dmaCopyHalfWords(SPRITE_DMA_CHANNEL, orangeShuttlePal,
+  dmaQueue->submit(orangeShuttlePal,
                    &SPRITE_PALETTE[shuttleInfo->oamId * COLORS_PER_PALETTE],
                    orangeShuttlePalLen);
-  dmaCopyHalfWords(SPRITE_DMA_CHANNEL, moonPal,
+  dmaQueue->submit(moonPal,
                    &SPRITE_PALETTE[moonInfo->oamId * COLORS_PER_PALETTE],
                    moonPalLen);
+  dmaQueue->submit(alienshipPal,
+                   &SPRITE_PALETTE[ALIEN_PALETTE * COLORS_PER_PALETTE],
+                   alienshipPalLen);
+  dmaQueue->submit(weaponPal,
+                   &SPRITE_PALETTE[BULLET_PALETTE * COLORS_PER_PALETTE],
+                   weaponPalLen);
 
-  /* Copy the sprite graphics to sprite graphics memory */
-  dmaCopyHalfWords(SPRITE_DMA_CHANNEL, orangeShuttleTiles,
-                   &SPRITE_GFX[shuttle->gfxIndex * OFFSET_MULTIPLIER],
-                   orangeShuttleTilesLen);
-  dmaCopyHalfWords(SPRITE_DMA_CHANNEL, moonTiles,
-                   &SPRITE_GFX[moon->gfxIndex * OFFSET_MULTIPLIER],
-                   moonTilesLen);
+  /*
+   *  The sprite graphics were already queued for copying to sprite graphics
+   *  memory when we acquired them from the allocator.
+   */
 }
 
-void displayStarField() {
-  /*  Set up affine background 3 on main screen as a 16-bit color background. */
+TiledBackground *displayStarField(DmaQueue *dmaQueue, VramManager *vram) {
+  /*
+   *  Find room in background memory for the star field's 64x64 tile map,
+   *  which takes 8KB, and for its tiles. Map bases come in steps of 2KB
+   *  and tile bases in steps of 16KB, so that is how the memory is lined
+   *  up.
+   */
+  s32 mapOffset = vram->allocate(
+      VRAM_USE_MAIN_BG,
+      TiledBackground::MAP_TILES * TiledBackground::MAP_TILES * sizeof(u16),
+      MAP_BASE_BYTES);
+  s32 tileOffset = vram->allocate(VRAM_USE_MAIN_BG,
+                                  getDecompressedSize(starFieldTiles),
+                                  TILE_BASE_BYTES);
+  assert(mapOffset != VramManager::NO_SPACE &&
+         tileOffset != VramManager::NO_SPACE);
+
+  /*
+   *  Set up affine background 3 on main screen as an extended rotation
+   *  background.
+   */
   int id = bgInit(3,
-                  BgType_Bmp16,
-                  BgSize_B16_256x256,
-                  0, // Map base: The starting place in memory
-                  0); // Tile base: Not used in 16-bit backgrounds
+                  BgType_ExRotation,
+                  BgSize_ER_512x512,
+                  mapOffset / MAP_BASE_BYTES,
+                  tileOffset / TILE_BASE_BYTES);
 
   /* Use the lowest possible priority */
   bgSetPriority(id, 3);
 
-  /* Copy graphics data */
-  dmaCopyHalfWords(DMA_CHANNEL, starFieldBitmap, /* This variable is generated
-                                                  * for us by grit. */
-                   bgGetGfxPtr(id),              /* Our address for main
-                                                  * background 3 */
-                   starFieldBitmapLen);          /* This length (in bytes) is
-                                                  * generated from grit. */
+  /*
+   *  Decompress the tiles. grit compresses them with LZ77 (see
+   *  starField.grit), and we decompress them into main RAM and queue a
+   *  copy into video memory. The palette is copied as it is.
+   */
+  loadCompressed(starFieldTiles, /* This variable is generated for us by
+                                  * grit. */
+                 bgGetGfxPtr(id), /* Our address for main background 3 */
+                 DECOMPRESS_BOUNCE, dmaQueue);
+  dmaQueue->submit(starFieldPal, BG_PALETTE, starFieldPalLen);
+
+  /*
+   *  The map is copied in as the background scrolls. The star field image
+   *  is 32x24 tiles, and the world repeats it over and over.
+   */
+  return new TiledBackground(id, starFieldMap, SCREEN_WIDTH / 8,
+                             SCREEN_HEIGHT / 8);
 }
 
-void displayPlanet() {
+int displayPlanet(VramManager *vram, ResourceCache *resources) {
+  /*
+   *  A 128x128 16-bit bitmap takes 32KB. Bitmap bases come in steps of
+   *  16KB.
+   */
+  s32 offset = vram->allocate(VRAM_USE_MAIN_BG, 128 * 128 * sizeof(u16),
+                              BMP_BASE_BYTES);
+  assert(offset != VramManager::NO_SPACE);
+
   /*  Set up affine background 2 on main as a 16-bit color background. */
   int id = bgInit(2,
                   BgType_Bmp16,
                   BgSize_B16_128x128,
-                  8,
+                  offset / BMP_BASE_BYTES,
                   0);
 
   /* Set a low priority, but higher than priority 3 */
@@ -253,73 +449,485 @@ void displayPlanet() {
 
   /*  Place main screen background 2 in an interesting place. */
   bgSetScroll(id,
-              -(SCREEN_WIDTH / 2 - 32),
-              -32);
+              -PLANET_X,
+              -PLANET_Y);
 
-  /* Copy graphics data */
-  dmaCopyHalfWords(DMA_CHANNEL, planetBitmap,
+  /*
+   *  Decompress the graphics data. The planet is mostly transparent black,
+   *  so grit compresses it with RLE. It is small, so decompress it straight
+   *  into video memory.
+   *
+   *  Unlike the other backgrounds, the planet isn't linked into the
+   *  program. It is read from NitroFS through the resource cache, and once
+   *  it is in video memory the cache may throw the file out again whenever
+   *  it needs the room.
+   */
+  ResourceHandle planet = resources->acquire(PLANET_RESOURCE);
+  if (planet != INVALID_RESOURCE) {
+    loadCompressed(resources->getData(planet),
                    bgGetGfxPtr(id),
-                   planetBitmapLen);
+                   DECOMPRESS_DIRECT);
+    resources->release(planet);
+  } else {
+    nocashMessage("can't load the planet from nitro:/planet.img.bin\n");
+  }
+
+  return id;
 }
 
-void displaySplash() {
+void displaySplash(VramManager *vram) {
+  /* A 256x256 16-bit bitmap fills all 128KB of bank C. */
+  s32 offset = vram->allocate(VRAM_USE_SUB_BG, 256 * 256 * sizeof(u16),
+                              BMP_BASE_BYTES);
+  assert(offset != VramManager::NO_SPACE);
+
   /*  Set up affine background 3 on the sub screen as a 16-bit color
    *  background.
    */
   int id = bgInitSub(3,
                      BgType_Bmp16,
                      BgSize_B16_256x256,
-                     0,
+                     offset / BMP_BASE_BYTES,
                      0);
 
   /* Use the lowest possible priority */
   bgSetPriority(id, 3);
 
-  /* Copy graphics data */
-  dmaCopyHalfWords(DMA_CHANNEL, splashBitmap,
-                   bgGetGfxPtr(id),
-                   splashBitmapLen);
+  /*
+   *  Decompress the graphics data straight into video memory. This one is
+   *  Huffman compressed, and a bounce buffer for it would need all 128KB
+   *  in main RAM.
+   */
+  loadCompressed(splashBitmap,
+                 bgGetGfxPtr(id),
+                 DECOMPRESS_DIRECT);
 }
 
-void initBackgrounds() {
+Parallax *initBackgrounds(DmaQueue *dmaQueue, VramManager *vram,
+                          ResourceCache *resources) {
   /* Display the backgrounds. */
-  displayStarField();
-  displayPlanet();
-  displaySplash();
+  TiledBackground *starField = displayStarField(dmaQueue, vram);
+  int planetId = displayPlanet(vram, resources);
+  displaySplash(vram);
 
   /* Refresh background registers */
   bgUpdate();
+
+  /* The star field is further away than the planet, so it moves less. */
+  Parallax *parallax = new Parallax(starField, starField->getId(), planetId,
+                                    PLANET_X, PLANET_Y);
+  parallax->setRates(STAR_FIELD_RATE, PLANET_RATE);
+  return parallax;
+}
+
+#ifdef ASSET_BENCHMARK
+void benchmarkAsset(const char *name, const void *data, u32 compressedBytes,
+                    void *dst) {
+  CompressionBenchmark result;
+  benchmarkCompressed(data, compressedBytes, dst, &result);
+
+  char line[128];
+  snprintf(line, sizeof(line),
+           "%s: ROM %lu B (raw %lu B), ticks raw %lu direct %lu bounce %lu\n",
+           name, (unsigned long)result.compressedBytes,
+           (unsigned long)result.decodedBytes,
+           (unsigned long)result.rawCopyTicks,
+           (unsigned long)result.directTicks,
+           (unsigned long)result.bounceTicks);
+  nocashMessage(line);
+}
+
+void benchmarkAssets(ResourceCache *resources) {
+  /*
+   *  Compare loading each compressed background against copying it
+   *  uncompressed, and print the results to the emulator's debug console.
+   *  The assets end up loaded again, so this is safe to run at start up.
+   */
+  benchmarkAsset("starField", starFieldTiles, starFieldTilesLen,
+                 bgGetGfxPtr(3));
+  ResourceHandle planet = resources->acquire(PLANET_RESOURCE);
+  if (planet != INVALID_RESOURCE) {
+    benchmarkAsset("planet", resources->getData(planet),
+                   resources->getSize(planet), bgGetGfxPtr(2));
+    resources->release(planet);
+  }
+  benchmarkAsset("splash", splashBitmap, splashBitmapLen, BG_GFX_SUB);
+}
+#endif
+
+#ifdef SPRITE_MULTIPLEXER
+/*
+ *  A swarm of moons, shown along with the ship and the moon when building
+ *  with -DSPRITE_MULTIPLEXER. Together they are more sprites than OAM
+ *  holds, so the multiplexer shares OAM out band by band (see
+ *  sprite_mux.h). The swarm's entries live outside OAM.
+ */
+static const int SWARM_SIZE = 256;
+static SpriteEntry swarmEntries[SWARM_SIZE];
+static SpriteInfo swarmInfo[SWARM_SIZE];
+
+void initSwarm(const SpriteInfo *moonInfo) {
+  for (int i = 0; i < SWARM_SIZE; i++) {
+    /*
+     *  One moon starts on each of the 256 lines, so every band has the same
+     *  number of them, leaving room for the ship and the moon.
+     */
+    swarmEntries[i] = *moonInfo->entry;
+    swarmEntries[i].x = (i * 53) % (SCREEN_WIDTH - moonInfo->width);
+    swarmEntries[i].y = (i * 29) & 0xFF;
+    swarmInfo[i] = *moonInfo;
+    swarmInfo[i].entry = &swarmEntries[i];
+  }
+}
+
+void submitSwarm(SpriteMultiplexer *multiplexer) {
+  /* Drift down the screen a line a frame, wrapping around. */
+  for (int i = 0; i < SWARM_SIZE; i++) {
+    swarmEntries[i].y = (swarmEntries[i].y + 1) & 0xFF;
+    multiplexer->submit(&swarmInfo[i]);
+  }
+}
+#endif
+
+#ifdef HOT_PATH_BENCHMARK
+/* Results go here, so that the compiler can't leave out the calls. */
+static volatile s32 benchmarkSink;
+
+void benchmarkHotPathStep(const char *name, u32 ticks, int calls) {
+  char line[96];
+  snprintf(line, sizeof(line), "%s: %lu ticks/call\n", name,
+           (unsigned long)(ticks / calls));
+  nocashMessage(line);
 }
 
-void updateInput(touchPosition *touch) {
+void benchmarkHotPath(SpriteInfo *spriteInfo, OAMShadow *oamShadow) {
+  /*
+   *  Time each hot function over a batch of calls and print the average to
+   *  the emulator's debug console. Build once normally and once with
+   *  -DNO_TCM to compare running from the TCMs against main RAM. The
+   *  float ship shows what the fixed-point maths saves.
+   */
+  static const int CALLS = 1000;
+  Ship ship(spriteInfo);
+
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    ship.accelerate();
+    ship.turnClockwise();
+  }
+  benchmarkHotPathStep("accelerate", cpuEndTiming(), CALLS);
+
+  /* The per-axis speed limit accelerate() used to have. */
+  MathVector2D<fixed> velocity;
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    accelerateAxisClamp(&velocity, (i * 192) & (DEGREES_IN_CIRCLE - 1));
+  }
+  benchmarkHotPathStep("accelerate (axis clamp)", cpuEndTiming(), CALLS);
+
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    ship.moveShip();
+  }
+  benchmarkHotPathStep("moveShip", cpuEndTiming(), CALLS);
+
+  /* The float port of the ship's kinematics, to compare against. */
+  FloatShip floatShip = {0, 0, 0, 0, 5.67232007f};
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    floatShip.accelerate();
+    floatShip.turnClockwise();
+  }
+  benchmarkHotPathStep("accelerate (float)", cpuEndTiming(), CALLS);
+
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    floatShip.move();
+  }
+  benchmarkHotPathStep("moveShip (float)", cpuEndTiming(), CALLS);
+
+  /*
+   *  reverseTurn()'s angle finding, against the atan2f() it replaced, over
+   *  vectors all the way round the circle.
+   */
+  static s32 vectorX[256];
+  static s32 vectorY[256];
+  for (int i = 0; i < 256; i++) {
+    vectorX[i] = cosLerp(i * (DEGREES_IN_CIRCLE / 256) + 37);
+    vectorY[i] = sinLerp(i * (DEGREES_IN_CIRCLE / 256) + 37);
+  }
+  s32 sum = 0;
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    sum += atan2Lerp(vectorY[i & 255], vectorX[i & 255]);
+  }
+  benchmarkHotPathStep("atan2Lerp", cpuEndTiming(), CALLS);
+  benchmarkSink = sum;
+
+  sum = 0;
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    sum += atan2Float(vectorY[i & 255], vectorX[i & 255]);
+  }
+  benchmarkHotPathStep("atan2 (float)", cpuEndTiming(), CALLS);
+  benchmarkSink = sum;
+
+  /* Borrow a matrix in the OAM copy, and put it back when we're done. */
+  SpriteRotation *matrix = &oamShadow->table->matrixBuffer[MATRIX_COUNT - 1];
+  SpriteRotation saved = *matrix;
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    rotateSprite(matrix, i * 32);
+  }
+  benchmarkHotPathStep("rotateSprite", cpuEndTiming(), CALLS);
+  *matrix = saved;
+
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    oamShadow->markEntry(i % SPRITE_COUNT);
+    oamShadow->commit();
+  }
+  benchmarkHotPathStep("commit (one entry)", cpuEndTiming(), CALLS);
+
+  cpuStartTiming(2);
+  for (int i = 0; i < CALLS; i++) {
+    oamShadow->markAll();
+    oamShadow->commit();
+  }
+  benchmarkHotPathStep("commit (all entries)", cpuEndTiming(), CALLS);
+}
+#endif
+
+#ifdef SPRITE_BATCH_BENCHMARK
+void benchmarkSpriteBatch(const SpriteInfo *moonInfo) {
+  /*
+   *  Draw bigger and bigger swarms of spinning moons with the 3D engine,
+   *  for a second each. Print how long each frame took to build, and how
+   *  much of the 3D engine's polygon and vertex memory it used, to the
+   *  emulator's debug console.
+   */
+  static const int COUNTS[] = {64, 256, 1024, SpriteBatch::MAX_QUADS};
+  static const int FRAMES = 60;
+
+  SpriteBatch *batch = new SpriteBatch();
+  int texture = batch->addTexture(moonTiles, moonPal, moonInfo->width,
+                                  moonInfo->height);
+  if (texture == SpriteBatch::NO_TEXTURE) {
+    nocashMessage("sprite batch: can't make the moon texture\n");
+    return;
+  }
+
+  SpriteInfo moon = *moonInfo;
+  for (unsigned c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); c++) {
+    int count = COUNTS[c];
+    u32 ticks = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+      cpuStartTiming(2);
+      batch->begin();
+      for (int i = 0; i < count; i++) {
+        moon.angle = (i * 512 + frame * 128) & (DEGREES_IN_CIRCLE - 1);
+        batch->submit(&moon, texture, (i * 37) % (SCREEN_WIDTH - 32),
+                      (i * 23) % (SCREEN_HEIGHT - 32));
+      }
+      batch->flush();
+      ticks += cpuEndTiming();
+      swiWaitForVBlank();
+    }
+
+    const SpriteBatchStats *stats = batch->getStats();
+    char line[128];
+    snprintf(line, sizeof(line),
+             "%4d sprites: %lu ticks/frame, polygons %d/%d (%d in RAM), "
+             "vertices %d/%d (%d in RAM), %d binds\n",
+             count, (unsigned long)(ticks / FRAMES), stats->polygons,
+             SpriteBatch::MAX_POLYGONS, stats->polygonsInRam,
+             stats->vertices, SpriteBatch::MAX_VERTICES,
+             stats->verticesInRam, stats->textureBinds);
+    nocashMessage(line);
+  }
+
+  /* Leave the 3D layer empty for the game. */
+  batch->begin();
+  batch->flush();
+}
+#endif
+
+/*
+ *  moonTouchesShip
+ *
+ *  Returns true if the moon, were it at x, y, would touch the ship. Both
+ *  are round, so they are tested as circles.
+ */
+bool moonTouchesShip(CollisionGrid *collisions, SpriteInfo *shipInfo,
+                     MathVector2D<fixed> shipPos, SpriteInfo *moonInfo, int x,
+                     int y) {
+  collisions->begin();
+  collisions->addSprite(shipInfo, shipPos.x.toInt(), shipPos.y.toInt(),
+                        COLLIDER_CIRCLE);
+  collisions->addSprite(moonInfo, x, y, COLLIDER_CIRCLE);
+  return collisions->findContacts() > 0;
+}
+
+/*
+ *  spawnAliens
+ *
+ *  Spread the aliens out around the world, each drifting off a different
+ *  way.
+ */
+void spawnAliens(EntityStore *entities) {
+  for (int i = 0; i < ALIEN_COUNT; i++) {
+    int angle = i * (DEGREES_IN_CIRCLE / ALIEN_COUNT);
+
+    MathVector2D<fixed> position;
+    position.x = fixed::fromInt(i * (WORLD_WIDTH / ALIEN_COUNT));
+    position.y = fixed::fromInt((i * 97) & (WORLD_HEIGHT - 1));
+    MathVector2D<fixed> velocity;
+    velocity.x = fixed::fromRaw(sinLerp(angle)) * ALIEN_SPEED;
+    velocity.y = -(fixed::fromRaw(cosLerp(angle)) * ALIEN_SPEED);
+
+    entities->create(ENTITY_ALIEN, position, velocity, angle,
+                     ALIEN_OAM_ID + i);
+  }
+}
+
+/*
+ *  fireBullet
+ *
+ *  Shoot a bullet from the middle of the ship, the way it is pointing. It
+ *  takes over the sprite of the oldest bullet, replacing it if it is still
+ *  flying.
+ */
+void fireBullet(EntityStore *entities, Ship *ship, const SpriteInfo *shipInfo,
+                EntityHandle *bullets, int *nextBullet) {
+  static const int BULLET_SIZE = 8;
+  int angle = ship->getAngleDeg();
+
+  MathVector2D<fixed> position = ship->getPosition();
+  position.x += fixed::fromInt((shipInfo->width - BULLET_SIZE) / 2);
+  position.y += fixed::fromInt((shipInfo->height - BULLET_SIZE) / 2);
+  MathVector2D<fixed> direction;
+  direction.x = fixed::fromRaw(sinLerp(angle));
+  direction.y = -fixed::fromRaw(cosLerp(angle));
+  MathVector2D<fixed> velocity =
+      ship->getVelocity() + direction * BULLET_SPEED;
+
+  int bullet = *nextBullet;
+  entities->destroy(bullets[bullet]);
+  bullets[bullet] =
+      entities->create(ENTITY_BULLET, position, velocity, angle,
+                       BULLET_OAM_ID + bullet, BULLET_LIFETIME);
+  *nextBullet = (bullet + 1) % BULLET_COUNT;
+}
+
+void updateInput(InputState *input, InputRecording *recording) {
+  PROFILE_SCOPE(PROFILE_UPDATE_INPUT);
+
+#ifdef INPUT_REPLAY
+  /* Play back the recording, then hand over to the player. */
+  if (recording->replay(input)) {
+    return;
+  }
+#endif
+
   // Update the key registers with current values.
   scanKeys();
 
   // Update the touch screen values.
-  touchRead(touch);
+  touchPosition touch;
+  touchRead(&touch);
+
+  nextInputState(input, keysHeld(), touch.px, touch.py);
+
+#ifdef INPUT_RECORD
+  recording->record(input);
+#else
+  (void)recording;
+#endif
 }
 
-void handleInput(Ship *ship, MathVector2D<int> *moonPos, SpriteInfo *moonInfo,
-                 touchPosition *touch) {
+/*
+ *  initNitroFS
+ *
+ *  Mount the ROM's filesystem, the first time we need it. Returns false if
+ *  the ROM doesn't have one.
+ */
+bool initNitroFS() {
+  static bool tried = false;
+  static bool mounted = false;
+  if (!tried) {
+    tried = true;
+    mounted = nitroFSInit(NULL);
+  }
+  return mounted;
+}
+
+#ifdef INPUT_RECORD
+/*
+ *  saveRecording
+ *
+ *  Save the input recorded so far, and print how it went to the emulator's
+ *  debug console.
+ */
+void saveRecording(InputRecording *recording) {
+  char line[96];
+  bool saved = recording->save(INPUT_RECORDING_PATH);
+  snprintf(line, sizeof(line), "%s %d ticks (%d bytes%s) to %s\n",
+           saved ? "saved" : "failed to save", recording->getTickCount(),
+           recording->getLength(), recording->isFull() ? ", full" : "",
+           INPUT_RECORDING_PATH);
+  nocashMessage(line);
+}
+#endif
+
+#ifdef INPUT_REPLAY
+/*
+ *  loadRecording
+ *
+ *  Load the recording to play back, from NitroFS if the ROM has one, or
+ *  else from FAT.
+ */
+void loadRecording(InputRecording *recording) {
+  char line[96];
+  const char *path = INPUT_REPLAY_NITRO_PATH;
+  bool loaded = initNitroFS() && recording->load(path);
+  if (!loaded) {
+    path = INPUT_RECORDING_PATH;
+    loaded = fatInitDefault() && recording->load(path);
+  }
+  snprintf(line, sizeof(line), "%s %d ticks from %s\n",
+           loaded ? "replaying" : "no recording to replay,",
+           recording->getTickCount(), path);
+  nocashMessage(line);
+}
+#endif
+
+HOT_CODE void handleInput(Ship *ship, const SpriteInfo *shipInfo,
+                          MathVector2D<int> *moonPos, SpriteInfo *moonInfo,
+                          const InputState *input, SfxManager *sfx,
+                          MathVector2D<int> view) {
+  PROFILE_SCOPE(PROFILE_HANDLE_INPUT);
 
   /* Handle up and down parts of D-Pad. */
-  if (keysDown() & KEY_UP) {
-    // Play our sound only when the button is initially pressed
-    mmEffect(SFX_THRUST);
+  if (input->down & KEY_UP) {
+    // Play our sound only when the button is initially pressed, panned to
+    // wherever the middle of the ship is on screen.
+    MathVector2D<int> shipScreen =
+        Camera::toScreen(view, ship->getPosition());
+    sfx->play(SFX_THRUST, shipScreen.x + shipInfo->width / 2);
   }
-  if (keysHeld() & KEY_UP) {
+  if (input->held & KEY_UP) {
     // accelerate ship
     ship->accelerate();
-  } else if (keysHeld() & KEY_DOWN) {
+  } else if (input->held & KEY_DOWN) {
     // reverse ship direction
     ship->reverseTurn();
   }
 
   /* Handle left and right parts of D-Pad. */
-  if (keysHeld() & KEY_LEFT) {
+  if (input->held & KEY_LEFT) {
     // rotate counter clockwise
     ship->turnCounterClockwise();
-  } else if (keysHeld() & KEY_RIGHT) {
+  } else if (input->held & KEY_RIGHT) {
     // rotate clockwise
     ship->turnClockwise();
   }
@@ -333,33 +941,48 @@ void handleInput(Ship *ship, MathVector2D<int> *moonPos, SpriteInfo *moonInfo,
    *  enough that I wanted to put it in the case study.
    */
   static MathVector2D<int> moonGrip;
-  if (keysDown() & KEY_TOUCH) {
+  if (input->down & KEY_TOUCH) {
     /* Record the grip */
-    moonGrip.x = touch->px;
-    moonGrip.y = touch->py;
-  } else if (keysHeld() & KEY_TOUCH) {
-    int newX = moonPos->x + touch->px - moonGrip.x;
-    int newY = moonPos->y + touch->py - moonGrip.y;
+    moonGrip.x = input->touchX;
+    moonGrip.y = input->touchY;
+  } else if (input->held & KEY_TOUCH) {
+    /*
+     *  The moon lives in the world, and moves through it as far as the
+     *  stylus moved. Only keeping it on screen needs the camera, and that
+     *  uses the view from the start of the frame, so every tick of a frame
+     *  sees the same one.
+     */
+    moonPos->x = (moonPos->x + input->touchX - moonGrip.x) & (WORLD_WIDTH - 1);
+    moonPos->y =
+        (moonPos->y + input->touchY - moonGrip.y) & (WORLD_HEIGHT - 1);
+
+    MathVector2D<fixed> moonWorld;
+    moonWorld.x = fixed::fromInt(moonPos->x);
+    moonWorld.y = fixed::fromInt(moonPos->y);
+    MathVector2D<int> moonScreen = Camera::toScreen(view, moonWorld);
+    int newX = moonScreen.x;
+    int newY = moonScreen.y;
 
     /* Prevent dragging off the screen. */
     if (newX < 0) {
-      moonPos->x = 0;
+      moonScreen.x = 0;
     } else if (newX > (SCREEN_WIDTH - moonInfo->width)) {
-      moonPos->x = SCREEN_WIDTH - moonInfo->width;
+      moonScreen.x = SCREEN_WIDTH - moonInfo->width;
     } else {
-      moonPos->x = newX;
+      moonScreen.x = newX;
     }
     if (newY < 0) {
-      moonPos->y = 0;
+      moonScreen.y = 0;
     } else if (newY > (SCREEN_HEIGHT - moonInfo->height)) {
-      moonPos->y = SCREEN_HEIGHT - moonInfo->height;
+      moonScreen.y = SCREEN_HEIGHT - moonInfo->height;
     } else {
-      moonPos->y = newY;
+      moonScreen.y = newY;
     }
+    *moonPos = Camera::toWorld(view, moonScreen);
 
     /* Record the grip again. */
-    moonGrip.x = touch->px;
-    moonGrip.y = touch->py;
+    moonGrip.x = input->touchX;
+    moonGrip.y = input->touchY;
   }
 }
 
@@ -374,63 +997,341 @@ int main() {
    *  VRAM banks. Next, confiure the background control registers.
    */
   lcdMainOnBottom();
-  initVideo();
-  initBackgrounds();
+  VramManager *vram = new VramManager();
+  initVideo(vram);
+
+  /*
+   *  All of our copies into video memory go through a DMA queue, which
+   *  spreads them over as many frames as needed.
+   */
+  DmaQueue *dmaQueue = new DmaQueue(DMA_FRAME_BUDGET);
+
+  /* Each DMA channel belongs to one user, or their transfers mix. */
+  assert(!dmaQueue->usesChannel(SPRITE_DMA_CHANNEL) &&
+         !dmaQueue->usesChannel(Parallax::DMA_CHANNEL) &&
+         !dmaQueue->usesChannel(SpriteMultiplexer::DMA_CHANNEL));
+
+  /*
+   *  Assets in NitroFS are loaded on demand through a cache (see
+   *  resource_cache.h).
+   */
+  initNitroFS();
+  ResourceCache *resources = new ResourceCache(RESOURCE_BUDGET);
+
+  Parallax *parallax = initBackgrounds(dmaQueue, vram, resources);
 
   /* Initialize maxmod using the memory based soundbank set up. */
   mmInitDefaultMem((mm_addr)soundbank_bin);
 
+  /*
+   *  Manage the sprite graphics memory in bank E. Sprite tile numbers
+   *  count from the start of sprite memory, so the allocator's memory has
+   *  to start there too.
+   *
+   *  GBATEK (https://problemkaputt.de/gbatek.htm#dsvideoobjs) gives the
+   *  address of a sprite's tiles as:
+   *      TileVramAddress = TileNumber * BoundaryValue
+   *  We use the default boundary value of 32 bytes (it can be set in
+   *  REG_DISPCNT), so the allocator hands out memory in 32 byte blocks.
+   */
+  static const int SPRITE_BANK_SIZE = 64 * 1024;
+  static const int BOUNDARY_VALUE = 32;
+  s32 spriteOffset = vram->allocate(VRAM_USE_MAIN_SPRITE, SPRITE_BANK_SIZE,
+                                    BOUNDARY_VALUE);
+  assert(spriteOffset == 0);
+  SpriteGfxAllocator *spriteGfx = new SpriteGfxAllocator(
+      (u16 *)VramManager::getAddress(VRAM_USE_MAIN_SPRITE, spriteOffset),
+      SPRITE_BANK_SIZE, BOUNDARY_VALUE);
+  spriteGfx->setDmaQueue(dmaQueue);
+
   /* Set up a few sprites. */
   SpriteInfo spriteInfo[SPRITE_COUNT];
-  OAMTable *oam = new OAMTable();
+  OAMTable *oam = &oamTable;
   initOAM(oam);
-  initSprites(oam, spriteInfo);
+
+  /*
+   *  Track changes to our OAM copy, so that each frame we only upload the
+   *  sprite entries and matrices we actually touched.
+   */
+  OAMShadow oamShadow(oam);
+
+  /* Hand out affine matrices to the sprites that want them. */
+  MatrixPool matrixPool(&oamShadow);
+
+  initSprites(oam, spriteInfo, spriteGfx, &matrixPool, dmaQueue);
+
+  /* We are still loading, so finish all of the copies right away. */
+  dmaQueue->flush();
+
+#ifdef ASSET_BENCHMARK
+  benchmarkAssets(resources);
+#endif
+
+#ifdef HOT_PATH_BENCHMARK
+  benchmarkHotPath(&spriteInfo[0], &oamShadow);
+#endif
+
+#ifdef SPRITE_BATCH_BENCHMARK
+  benchmarkSpriteBatch(&spriteInfo[1]);
+#endif
 
   /*************************************************************************/
 
-  /* Keep track of the touch screen coordinates. */
-  touchPosition touch;
+  /* What the player is doing, and a recording of it (see input.h). */
+  InputState input = {};
+  InputRecording *recording = new InputRecording();
+#ifdef INPUT_RECORD
+  if (!fatInitDefault()) {
+    nocashMessage("no FAT filesystem, recordings can't be saved\n");
+  }
+#endif
+#ifdef INPUT_REPLAY
+  loadRecording(recording);
+#endif
 
   /* Make the ship object. */
   static const int SHUTTLE_OAM_ID = 0;
-  SpriteEntry *shipEntry = &oam->oamBuffer[SHUTTLE_OAM_ID];
-  SpriteRotation *shipRotation = &oam->matrixBuffer[SHUTTLE_OAM_ID];
-  Ship *ship = new Ship(&spriteInfo[SHUTTLE_OAM_ID]);
+  SpriteInfo *shipInfo = &spriteInfo[SHUTTLE_OAM_ID];
+  Ship *ship = new Ship(shipInfo);
 
-  /* Make the moon. */
+  /*
+   *  Make the moon. It starts in the world wherever it starts on screen,
+   *  as the camera starts at 0, 0. moonPos is where it is being dragged to,
+   *  and moonPlaced where it ended up.
+   */
   static const int MOON_OAM_ID = 1;
   SpriteEntry *moonEntry = &oam->oamBuffer[MOON_OAM_ID];
   SpriteInfo *moonInfo = &spriteInfo[MOON_OAM_ID];
   MathVector2D<int> *moonPos = new MathVector2D<int>();
   moonPos->x = moonEntry->x;
   moonPos->y = moonEntry->y;
+  MathVector2D<int> moonPlaced = *moonPos;
+
+  /* Find out when things bump into each other. */
+  CollisionGrid *collisions = new CollisionGrid();
+
+  /*
+   *  The aliens and bullets, and the handles of the bullets in the order
+   *  they take turns with their sprites.
+   */
+  EntityStore *entities = new EntityStore();
+  spawnAliens(entities);
+  EntityHandle bullets[BULLET_COUNT] = {};
+  int nextBullet = 0;
+  int fireCooldown = 0;
+
+#ifdef SPRITE_MULTIPLEXER
+  /* Take over OAM, to show the swarm of moons as well. */
+  SpriteMultiplexer *multiplexer = new SpriteMultiplexer(&oamShadow);
+  initSwarm(moonInfo);
+  multiplexer->enable();
+#endif
+
+  /*
+   *  Set up sound data. Effects are started by the manager, which shares
+   *  out the voices (see sfx.h). Thrust can overlap itself once, but not
+   *  restart more than every few frames when the button is tapped fast.
+   */
+  SfxManager *sfx = new SfxManager();
+  sfx->setup(SFX_THRUST, 1, 2, 4);
+
+#ifdef STREAM_MUSIC
+  /* Music is too big to load, so it plays straight from the file. */
+  AudioStream *music = new AudioStream();
+  if (!initNitroFS() || !music->open(MUSIC_PATH, true)) {
+    nocashMessage("can't stream music from nitro:/music.wav\n");
+  }
+#endif
+
+  /* Start timing frames, when built with the profiler. */
+  profilerInit();
+#ifdef PROFILER
+  reportVram(vram);
+#endif
 
-  /* Set up sound data. */
-  mmLoadEffect(SFX_THRUST);
+  /*
+   *  Run the simulation in fixed ticks of one frame each, whatever the
+   *  frame rate really is (see game_loop.h).
+   */
+  GameLoop gameLoop;
+  gameLoop.start();
+
+  MathVector2D<fixed> previousPosition = ship->getPosition();
+
+  /* Follow the ship around the world (see camera.h). */
+  Camera camera;
 
   for (;;) {
-    /* Update the game state. */
-    updateInput(&touch);
-    handleInput(ship, moonPos, moonInfo, &touch);
-    ship->moveShip();
-
-    /* Update ship sprite attributes. */
-    MathVector2D<float> position = ship->getPosition();
-    shipEntry->x = (int)position.x;
-    shipEntry->y = (int)position.y;
-    rotateSprite(shipRotation, -ship->getAngleDeg());
+#ifdef LATE_INPUT
+    GameLoop::waitForLine(LATE_INPUT_LINE);
+#endif
+
+    /*
+     *  Update the game state, once for each tick due this frame. The
+     *  camera follows what is drawn, which depends on when frames happen,
+     *  so the ticks only see where it was when the frame began.
+     */
+    MathVector2D<int> view = camera.getView();
+    int ticks = gameLoop.beginFrame();
+    for (int tick = 0; tick < ticks; tick++) {
+      previousPosition = ship->getPosition();
+      updateInput(&input, recording);
+      latencySample(input.down);
+
+#ifdef LATENCY_TRACE
+      /* Follow the press to the screen, if it changed anything. */
+      MathVector2D<fixed> velocity = ship->getVelocity();
+      int angle = ship->getAngleDeg();
+      handleInput(ship, shipInfo, moonPos, moonInfo, &input, sfx, view);
+      if (ship->getVelocity().x != velocity.x ||
+          ship->getVelocity().y != velocity.y ||
+          ship->getAngleDeg() != angle) {
+        latencyTag(SHUTTLE_OAM_ID, shipInfo->entry);
+      }
+#else
+      handleInput(ship, shipInfo, moonPos, moonInfo, &input, sfx, view);
+#endif
+      ship->moveShip();
+
+      /* Shoot while A is held, one bullet every FIRE_INTERVAL ticks. */
+      if (fireCooldown > 0) {
+        fireCooldown--;
+      }
+      if ((input.held & KEY_A) && fireCooldown == 0) {
+        fireBullet(entities, ship, shipInfo, bullets, &nextBullet);
+        fireCooldown = FIRE_INTERVAL;
+      }
+
+      /* Move the aliens and bullets, and let the old bullets go. */
+      entities->integrate();
+      entities->age(&oamShadow);
+
+#ifdef INPUT_RECORD
+      /* Save what we have so far whenever SELECT is pressed. */
+      if (input.down & KEY_SELECT) {
+        saveRecording(recording);
+      }
+#endif
+    }
+
+    /* Start whichever sound effects won a voice this frame. */
+    sfx->update();
+    const SfxStats *sfxStats = sfx->getStats();
+    profilerSetCounter(PROFILE_COUNTER_SFX_VOICES, sfxStats->voicesUsed);
+    profilerSetCounter(PROFILE_COUNTER_SFX_DROPPED, sfxStats->dropped);
+
+    /*
+     *  The ship is drawn between where it was before the last tick and
+     *  where it is now, by how far we are into the next tick. The camera
+     *  follows the middle of it.
+     */
+    MathVector2D<fixed> position = ship->getPosition();
+    MathVector2D<fixed> drawPosition =
+        gameLoop.interpolate(previousPosition, position);
+    MathVector2D<fixed> shipCenter;
+    shipCenter.x = drawPosition.x + fixed::fromInt(shipInfo->width / 2);
+    shipCenter.y = drawPosition.y + fixed::fromInt(shipInfo->height / 2);
+    camera.follow(shipCenter);
+
+    /*
+     *  Build the backgrounds' scroll for the next frame. The star field
+     *  leans the way the camera is moving.
+     */
+    MathVector2D<fixed> cameraPosition = camera.getPosition();
+    parallax->setCamera(cameraPosition.x, cameraPosition.y);
+    parallax->setLean(camera.getStep().x * STAR_FIELD_LEAN);
+    parallax->build();
+
+    /*
+     *  Update ship sprite attributes. Off screen, it is hidden and gives
+     *  up its matrix.
+     */
+    int culled = 0;
+    matrixPool.beginFrame();
+    shipInfo->angle = -ship->getAngleDeg();
+    if (!camera.placeSprite(shipInfo, drawPosition, &oamShadow,
+                            &matrixPool)) {
+      culled++;
+    }
+
+    /*
+     *  Don't let the moon be dragged through the ship. The ship can still
+     *  fly into the moon, so a drag is only refused when it would make the
+     *  two touch when they didn't before. That way the moon can always be
+     *  dragged back out.
+     */
+    if ((moonPlaced.x != moonPos->x || moonPlaced.y != moonPos->y) &&
+        moonTouchesShip(collisions, shipInfo, position, moonInfo, moonPos->x,
+                        moonPos->y) &&
+        !moonTouchesShip(collisions, shipInfo, position, moonInfo,
+                         moonPlaced.x, moonPlaced.y)) {
+      *moonPos = moonPlaced;
+    }
+    moonPlaced = *moonPos;
+
     /* Update moon sprite attributes. */
-    moonEntry->x = (int)moonPos->x;
-    moonEntry->y = (int)moonPos->y;
+    MathVector2D<fixed> moonWorld;
+    moonWorld.x = fixed::fromInt(moonPlaced.x);
+    moonWorld.y = fixed::fromInt(moonPlaced.y);
+    if (!camera.placeSprite(moonInfo, moonWorld, &oamShadow)) {
+      culled++;
+    }
+    profilerSetCounter(PROFILE_COUNTER_CULLED_SPRITES, culled);
+
+    /* Place the aliens and bullets, hiding those that are off screen. */
+    entities->writeSprites(&oamShadow, camera.getView());
+
+#ifdef SPRITE_MULTIPLEXER
+    /*
+     *  Build the bands for the next frame. The ship, the moon and the
+     *  aliens and bullets on screen are more important than the swarm, so
+     *  in a crowded band a moon of the swarm is left out rather than them.
+     */
+    multiplexer->begin();
+    multiplexer->submit(shipInfo, 1);
+    multiplexer->submit(moonInfo, 1);
+    for (int oamId = ALIEN_OAM_ID; oamId < BULLET_OAM_ID + BULLET_COUNT;
+         oamId++) {
+      if (!spriteInfo[oamId].entry->isHidden) {
+        multiplexer->submit(&spriteInfo[oamId], 1);
+      }
+    }
+    submitSwarm(multiplexer);
+    multiplexer->build();
+#endif
 
     /*
      *  Update the OAM.
      *
      *  We have to copy our copy of OAM data into the actual OAM during
-     *  VBlank (writes to it are locked during other times).
+     *  VBlank (writes to it are locked during other times). Only the parts
+     *  we marked as changed are copied. The multiplexer, when it is used,
+     *  owns OAM instead.
      */
     swiWaitForVBlank();
-    updateOAM(oam);
+#ifdef SPRITE_MULTIPLEXER
+    multiplexer->commit();
+#else
+    oamShadow.commit();
+#endif
+
+    /*
+     *  Scroll the backgrounds, bringing in any star field that scrolled into
+     *  view, and start the star field's line table.
+     */
+    parallax->update();
+
+    /* Use the rest of VBlank to continue any queued copies. */
+    dmaQueue->service();
+
+#ifdef STREAM_MUSIC
+    /* Then read ahead some more music. */
+    music->service();
+    profilerSetCounter(PROFILE_COUNTER_AUDIO_UNDERRUNS,
+                       music->getUnderruns());
+#endif
+
+    profilerEndFrame();
   }
 
   return 0;
@@ -0,0 +1,148 @@
+/*
+ *  matrix_pool.cpp
+ *
+ *  Hands out the 32 hardware affine matrices (SpriteRotation) by reference
+ *  count, instead of tying matrix n to OAM entry n.
+ *
+ */
+
+#include "matrix_pool.h"
+#include "sprites.h"
+#include <assert.h>
+#include <nds.h>
+
+/* The distance between two angles, going whichever way round is shorter. */
+static int angleDistance(int a, int b) {
+  int d = (a - b) & (DEGREES_IN_CIRCLE - 1);
+  return d > DEGREES_IN_CIRCLE / 2 ? DEGREES_IN_CIRCLE - d : d;
+}
+
+MatrixPool::MatrixPool(OAMShadow *_oamShadow, int _angleStep) {
+  oamShadow = _oamShadow;
+  angleStep = _angleStep;
+  fallbacks = 0;
+
+  for (int i = 0; i < MATRIX_COUNT; i++) {
+    slots[i].refCount = 0;
+    slots[i].valid = false;
+  }
+}
+
+int MatrixPool::quantize(int angle) const {
+  angle &= DEGREES_IN_CIRCLE - 1;
+  angle += angleStep / 2;
+  angle -= angle % angleStep;
+  return angle & (DEGREES_IN_CIRCLE - 1);
+}
+
+int MatrixPool::find(int angle, int scale) const {
+  for (int i = 0; i < MATRIX_COUNT; i++) {
+    const Slot *slot = &slots[i];
+    if (slot->valid && slot->angle == angle && slot->scale == scale) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void MatrixPool::write(int matrixId, int angle, int scale) {
+  Slot *slot = &slots[matrixId];
+  slot->angle = angle;
+  slot->scale = scale;
+  slot->valid = true;
+
+  rotateScaleSprite(&oamShadow->table->matrixBuffer[matrixId], angle, scale);
+  oamShadow->markMatrix(matrixId);
+}
+
+int MatrixPool::acquire(int angle, int scale) {
+  angle = quantize(angle);
+
+  /* Share a matrix that already holds this transform. */
+  int matrixId = find(angle, scale);
+  if (matrixId >= 0) {
+    slots[matrixId].refCount++;
+    return matrixId;
+  }
+
+  /*
+   *  Otherwise, take a free matrix. Prefer one that has never been used, so
+   *  that released matrices stay around in case their transform comes back.
+   */
+  int freeSlot = -1;
+  for (int i = 0; i < MATRIX_COUNT; i++) {
+    Slot *slot = &slots[i];
+    if (slot->refCount == 0 &&
+        (freeSlot < 0 || (slots[freeSlot].valid && !slot->valid))) {
+      freeSlot = i;
+    }
+  }
+
+  if (freeSlot >= 0) {
+    slots[freeSlot].refCount = 1;
+    write(freeSlot, angle, scale);
+    return freeSlot;
+  }
+
+  /*
+   *  Every matrix is in use. Rather than fail, share whichever matrix is
+   *  closest to what was asked for. A matching scale matters more than the
+   *  angle, since a wrongly scaled sprite is much more noticeable.
+   */
+  fallbacks++;
+  int best = 0;
+  int bestCost = 0x7FFFFFFF;
+  for (int i = 0; i < MATRIX_COUNT; i++) {
+    int cost = angleDistance(slots[i].angle, angle);
+    if (slots[i].scale != scale) {
+      cost += DEGREES_IN_CIRCLE;
+    }
+    if (cost < bestCost) {
+      best = i;
+      bestCost = cost;
+    }
+  }
+  slots[best].refCount++;
+  return best;
+}
+
+void MatrixPool::release(int matrixId) {
+  assert(slots[matrixId].refCount > 0);
+  slots[matrixId].refCount--;
+}
+
+int MatrixPool::update(int matrixId, int angle, int scale) {
+  Slot *slot = &slots[matrixId];
+  angle = quantize(angle);
+  if (slot->angle == angle && slot->scale == scale) {
+    return matrixId;
+  }
+
+  /*
+   *  If we are the only user of this matrix and nobody else has the new
+   *  transform, just rewrite the matrix in place. This is the common case of
+   *  a single sprite turning, and it keeps the sprite's rotationIndex
+   *  unchanged.
+   */
+  if (slot->refCount == 1 && find(angle, scale) < 0) {
+    write(matrixId, angle, scale);
+    return matrixId;
+  }
+
+  release(matrixId);
+  return acquire(angle, scale);
+}
+
+void MatrixPool::beginFrame() { fallbacks = 0; }
+
+int MatrixPool::getUsedCount() const {
+  int used = 0;
+  for (int i = 0; i < MATRIX_COUNT; i++) {
+    if (slots[i].refCount > 0) {
+      used++;
+    }
+  }
+  return used;
+}
+
+int MatrixPool::getFallbackCount() const { return fallbacks; }
@@ -0,0 +1,120 @@
+/*
+ *  oam_shadow.cpp
+ *
+ *  Tracks which parts of our OAM copy changed since they were last uploaded,
+ *  so we only spend VBlank time copying what actually changed.
+ *
+ */
+
+#include "oam_shadow.h"
+#include "latency.h"
+#include "profiler.h"
+#include "sprites.h"
+#include "tcm.h"
+#include <nds.h>
+
+/* The number of halfwords between two parts of the same rotation matrix. */
+static const int MATRIX_STRIDE = sizeof(SpriteEntry) / sizeof(u16);
+
+OAMShadow::OAMShadow(OAMTable *_table) {
+  table = _table;
+  bytesTransferred = 0;
+  tableInDtcm = isInDtcm(table);
+  markAll();
+}
+
+HOT_CODE void OAMShadow::markEntry(int oamId) {
+  dirtyEntries[oamId / 32] |= BIT(oamId % 32);
+}
+
+HOT_CODE void OAMShadow::markMatrix(int matrixId) {
+  dirtyMatrices |= BIT(matrixId);
+}
+
+void OAMShadow::markAll() {
+  for (int i = 0; i < SPRITE_COUNT / 32; i++) {
+    dirtyEntries[i] = 0xFFFFFFFF;
+  }
+  dirtyMatrices = 0xFFFFFFFF;
+}
+
+HOT_CODE void OAMShadow::uploadEntries(int first, int count) {
+  u32 bytes = count * sizeof(SpriteEntry);
+  SpriteEntry *src = &table->oamBuffer[first];
+  SpriteEntry *dst = (SpriteEntry *)OAM + first;
+
+  if (bytes >= DMA_THRESHOLD && !tableInDtcm) {
+    /* DMA reads main RAM directly, so get our writes out of the cache. */
+    DC_FlushRange(src, bytes);
+    dmaCopyWords(SPRITE_DMA_CHANNEL, src, dst, bytes);
+  } else {
+    /* OAM can't be written a byte at a time, so copy whole words. */
+    const u32 *s = (const u32 *)src;
+    vu32 *d = (vu32 *)dst;
+    for (u32 i = 0; i < bytes / sizeof(u32); i++) {
+      d[i] = s[i];
+    }
+  }
+
+  bytesTransferred += bytes;
+}
+
+HOT_CODE void OAMShadow::uploadMatrix(int matrixId) {
+  const SpriteRotation *src = &table->matrixBuffer[matrixId];
+  vu16 *dst = (vu16 *)&((SpriteRotation *)OAM)[matrixId].hdx;
+
+  dst[0] = src->hdx;
+  dst[MATRIX_STRIDE] = src->hdy;
+  dst[MATRIX_STRIDE * 2] = src->vdx;
+  dst[MATRIX_STRIDE * 3] = src->vdy;
+
+  bytesTransferred += 4 * sizeof(u16);
+}
+
+HOT_CODE void OAMShadow::commit() {
+  PROFILE_SCOPE(PROFILE_UPDATE_OAM);
+
+  bytesTransferred = 0;
+
+  /*
+   *  Walk the dirty bits, uploading each contiguous run of dirty entries in
+   *  one go. Runs may cross from one 32-bit word of the bitmap into the
+   *  next.
+   */
+  int runStart = -1;
+  for (int i = 0; i < SPRITE_COUNT; i++) {
+    bool dirty = dirtyEntries[i / 32] & BIT(i % 32);
+    if (dirty && runStart < 0) {
+      runStart = i;
+    } else if (!dirty && runStart >= 0) {
+      uploadEntries(runStart, i - runStart);
+      runStart = -1;
+    }
+  }
+  if (runStart >= 0) {
+    uploadEntries(runStart, SPRITE_COUNT - runStart);
+  }
+
+  /*
+   *  A matrix whose four sprite entries were all just uploaded is already
+   *  in OAM. Any other dirty matrix is written on its own.
+   */
+  while (dirtyMatrices) {
+    int matrixId = __builtin_ctz(dirtyMatrices);
+    dirtyMatrices &= ~BIT(matrixId);
+
+    int firstEntry = matrixId * 4;
+    u32 entryBits = (dirtyEntries[firstEntry / 32] >> (firstEntry % 32)) & 0xF;
+    if (entryBits != 0xF) {
+      uploadMatrix(matrixId);
+    }
+  }
+
+  latencyCommit(dirtyEntries);
+
+  for (int i = 0; i < SPRITE_COUNT / 32; i++) {
+    dirtyEntries[i] = 0;
+  }
+}
+
+u32 OAMShadow::getBytesTransferred() const { return bytesTransferred; }
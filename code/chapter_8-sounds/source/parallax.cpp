@@ -0,0 +1,136 @@
+/*
+ *  parallax.cpp
+ *
+ *  Scrolls the backgrounds at different rates as the camera moves, so the
+ *  far away ones seem further away.
+ *
+ */
+
+#include "parallax.h"
+#include "profiler.h"
+#include <nds.h>
+#include <string.h>
+
+/* The star field's hardware map is this many pixels across. */
+static const int MAP_PIXELS = TiledBackground::MAP_TILES * 8;
+
+/*
+ *  The planet passes by once every this many pixels of its own scrolling.
+ *  It is off screen by the time it wraps around, so it never jumps.
+ */
+static const int PLANET_LOOP = 512;
+
+Parallax::Parallax(TiledBackground *_starField, int _starFieldId,
+                   int _planetId, int _planetX, int _planetY) {
+  starField = _starField;
+  planetId = _planetId;
+  planetX = _planetX;
+  planetY = _planetY;
+  lineRegister = _starFieldId == 2 ? &REG_BG2X : &REG_BG3X;
+  starFieldRate = fixed::fromInt(1);
+  planetRate = fixed::fromInt(1);
+  lean = fixed();
+  cameraX = fixed();
+  cameraY = fixed();
+  starFieldX = 0;
+  starFieldY = 0;
+  planetScrollX = -planetX;
+  planetScrollY = -planetY;
+  front = 0;
+  backReady = false;
+  memset(lineTables, 0, sizeof(lineTables));
+}
+
+Parallax::~Parallax() { stopLineDma(); }
+
+void Parallax::setRates(fixed _starFieldRate, fixed _planetRate) {
+  starFieldRate = _starFieldRate;
+  planetRate = _planetRate;
+}
+
+void Parallax::setLean(fixed _lean) { lean = _lean; }
+
+void Parallax::setCamera(fixed x, fixed y) {
+  cameraX = x;
+  cameraY = y;
+}
+
+void Parallax::build() {
+  PROFILE_SCOPE(PROFILE_SCROLL_TABLES);
+
+  starFieldX = (cameraX * starFieldRate).toInt();
+  starFieldY = (cameraY * starFieldRate).toInt();
+
+  /* Keep the planet's place on screen between -PLANET_LOOP / 2 and half. */
+  int x = planetX - (cameraX * planetRate).toInt();
+  int y = planetY - (cameraY * planetRate).toInt();
+  x = ((x + PLANET_LOOP / 2) & (PLANET_LOOP - 1)) - PLANET_LOOP / 2;
+  y = ((y + PLANET_LOOP / 2) & (PLANET_LOOP - 1)) - PLANET_LOOP / 2;
+  planetScrollX = -x;
+  planetScrollY = -y;
+
+  if (lean == fixed()) {
+    return;
+  }
+
+  /*
+   *  Step the offset down the screen a line at a time, rather than
+   *  multiplying for every line.
+   */
+  s32 *table = lineTables[front ^ 1];
+  fixed offset = lean * fixed::fromInt(-SCREEN_HEIGHT / 2);
+  for (int line = 0; line <= SCREEN_HEIGHT; line++) {
+    int shift = offset.toInt();
+    if (shift < -MAX_LINE_OFFSET) {
+      shift = -MAX_LINE_OFFSET;
+    } else if (shift > MAX_LINE_OFFSET) {
+      shift = MAX_LINE_OFFSET;
+    }
+    table[line] = ((starFieldX + shift) & (MAP_PIXELS - 1)) << 8;
+    offset += lean;
+  }
+
+  /* The DMA reads memory, not the cache. */
+  DC_FlushRange(table, sizeof(lineTables[0]));
+  backReady = true;
+}
+
+void Parallax::stopLineDma() { DMA_CR(DMA_CHANNEL) = 0; }
+
+/*
+ *  Copy line 0's scroll now, and have the DMA copy each following line's
+ *  at the end of the line before it.
+ */
+void Parallax::startLineDma() {
+  const s32 *table = lineTables[front];
+  *lineRegister = table[0];
+  DMA_SRC(DMA_CHANNEL) = (u32)(uintptr_t)&table[1];
+  DMA_DEST(DMA_CHANNEL) = (u32)(uintptr_t)lineRegister;
+  DMA_CR(DMA_CHANNEL) = DMA_ENABLE | DMA_REPEAT | DMA_START_HBL |
+                        DMA_32_BIT | DMA_SRC_INC | DMA_DST_FIX | 1;
+}
+
+void Parallax::update() {
+  /* The DMA has copied its last line, so it is safe to stop it. */
+  stopLineDma();
+
+  starField->setCamera(starFieldX, starFieldY);
+  starField->update();
+  bgSetScroll(planetId, planetScrollX, planetScrollY);
+  bgUpdate();
+
+  /*
+   *  bgUpdate() has just set the scroll for the whole screen. Only with a
+   *  lean does the line table take over from it.
+   */
+  if (lean == fixed()) {
+    backReady = false;
+    return;
+  }
+
+  if (backReady) {
+    front ^= 1;
+    backReady = false;
+  }
+  startLineDma();
+}
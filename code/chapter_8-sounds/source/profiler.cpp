@@ -0,0 +1,194 @@
+/*
+ *  profiler.cpp
+ *
+ *  A lightweight frame profiler built on the ARM9 hardware timers.
+ *
+ */
+
+#include "profiler.h"
+
+#ifdef PROFILER
+
+#include <nds.h>
+#include <stdio.h>
+
+/*
+ *  Timer 2 counts at the full bus clock, and timer 3 counts each time timer
+ *  2 overflows. Together they make a 32-bit clock that wraps every two
+ *  minutes or so, which is plenty for timing pieces of a frame.
+ */
+static const int PROFILE_TIMER_LOW = 2;
+static const int PROFILE_TIMER_HIGH = 3;
+
+/*
+ *  A frame lasts 263 lines of 355 dots each, and each dot takes 6 bus clock
+ *  cycles.
+ */
+static const u32 FRAME_TICKS = 263 * 355 * 6;
+
+/* How often (in frames) to refresh the overlay and print a report. */
+static const int REPORT_INTERVAL = 60;
+
+/* The overlay draws one bar per zone, this many lines tall. */
+static const int BAR_HEIGHT = 4;
+
+static const char *zoneNames[PROFILE_ZONE_COUNT] = {
+    "updateInput", "handleInput", "moveShip", "rotateSprite", "updateOAM",
+    "streamAudio", "scrollTables",
+};
+
+static const u16 zoneColors[PROFILE_ZONE_COUNT] = {
+    RGB15(31, 0, 0), RGB15(31, 31, 0), RGB15(0, 31, 0), RGB15(0, 31, 31),
+    RGB15(31, 0, 31), RGB15(31, 15, 0), RGB15(15, 15, 31),
+};
+
+static const char *counterNames[PROFILE_COUNTER_COUNT] = {
+    "frameDrops", "tickDrops", "tickLag", "underruns", "sfxVoices",
+    "sfxDropped", "culled",
+};
+
+/* The latest value of each counter. */
+static u32 counters[PROFILE_COUNTER_COUNT];
+
+/* The zone totals of the frame in progress. */
+static u32 currentFrame[PROFILE_ZONE_COUNT];
+
+/* A ring buffer of the totals of previous frames. */
+static u32 history[PROFILE_HISTORY][PROFILE_ZONE_COUNT];
+static int historyNext = 0;
+static int historyCount = 0;
+static int framesUntilReport = REPORT_INTERVAL;
+
+u32 profilerNow() {
+  /*
+   *  The low half might overflow between reading the two halves, so read
+   *  the high half twice and start over if it changed.
+   */
+  u16 high;
+  u16 low;
+  do {
+    high = TIMER_DATA(PROFILE_TIMER_HIGH);
+    low = TIMER_DATA(PROFILE_TIMER_LOW);
+  } while (high != TIMER_DATA(PROFILE_TIMER_HIGH));
+
+  return ((u32)high << 16) | low;
+}
+
+void profilerRecord(ProfileZone zone, u32 ticks) {
+  currentFrame[zone] += ticks;
+}
+
+void profilerInit() {
+  TIMER_CR(PROFILE_TIMER_LOW) = 0;
+  TIMER_CR(PROFILE_TIMER_HIGH) = 0;
+  TIMER_DATA(PROFILE_TIMER_LOW) = 0;
+  TIMER_DATA(PROFILE_TIMER_HIGH) = 0;
+  TIMER_CR(PROFILE_TIMER_HIGH) = TIMER_ENABLE | TIMER_CASCADE;
+  TIMER_CR(PROFILE_TIMER_LOW) = TIMER_ENABLE | TIMER_DIV_1;
+
+  for (int i = 0; i < PROFILE_ZONE_COUNT; i++) {
+    currentFrame[i] = 0;
+  }
+  historyNext = 0;
+  historyCount = 0;
+}
+
+void profilerGetStats(ProfileZone zone, ProfileStats *out) {
+  if (historyCount == 0) {
+    out->min = out->avg = out->max = 0;
+    return;
+  }
+
+  u32 min = 0xFFFFFFFF;
+  u32 max = 0;
+  u32 total = 0;
+  for (int i = 0; i < historyCount; i++) {
+    u32 ticks = history[i][zone];
+    if (ticks < min) {
+      min = ticks;
+    }
+    if (ticks > max) {
+      max = ticks;
+    }
+    total += ticks;
+  }
+
+  out->min = min;
+  out->avg = total / historyCount;
+  out->max = max;
+}
+
+/*
+ *  Draw a bar per zone over the top of the sub screen's bitmap background,
+ *  as long as the average time, with a white mark at the maximum. The full
+ *  width of the screen is one whole frame.
+ */
+static void drawOverlay() {
+  u16 *bitmap = BG_GFX_SUB;
+
+  for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+    ProfileStats stats;
+    profilerGetStats((ProfileZone)zone, &stats);
+
+    u32 avgWidth = (u64)stats.avg * SCREEN_WIDTH / FRAME_TICKS;
+    u32 maxX = (u64)stats.max * SCREEN_WIDTH / FRAME_TICKS;
+    if (maxX >= SCREEN_WIDTH) {
+      maxX = SCREEN_WIDTH - 1;
+    }
+
+    for (int y = zone * BAR_HEIGHT; y < (zone + 1) * BAR_HEIGHT - 1; y++) {
+      u16 *line = &bitmap[y * SCREEN_WIDTH];
+      for (u32 x = 0; x < SCREEN_WIDTH; x++) {
+        /* Bit 15 makes a bitmap pixel opaque. */
+        line[x] = BIT(15) | (x < avgWidth ? zoneColors[zone] : 0);
+      }
+      line[maxX] = BIT(15) | RGB15(31, 31, 31);
+    }
+  }
+}
+
+/* Print each zone's timings to the emulator's debug console. */
+static void printReport() {
+  char line[96];
+
+  nocashMessage("zone            min     avg     max  (ticks)\n");
+  for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+    ProfileStats stats;
+    profilerGetStats((ProfileZone)zone, &stats);
+
+    snprintf(line, sizeof(line), "%-12s %7lu %7lu %7lu  %2lu%%\n",
+             zoneNames[zone], (unsigned long)stats.min,
+             (unsigned long)stats.avg, (unsigned long)stats.max,
+             (unsigned long)((u64)stats.avg * 100 / FRAME_TICKS));
+    nocashMessage(line);
+  }
+
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+    snprintf(line, sizeof(line), "%-12s %7lu\n", counterNames[counter],
+             (unsigned long)counters[counter]);
+    nocashMessage(line);
+  }
+}
+
+void profilerSetCounter(ProfileCounter counter, u32 value) {
+  counters[counter] = value;
+}
+
+void profilerEndFrame() {
+  for (int i = 0; i < PROFILE_ZONE_COUNT; i++) {
+    history[historyNext][i] = currentFrame[i];
+    currentFrame[i] = 0;
+  }
+  historyNext = (historyNext + 1) % PROFILE_HISTORY;
+  if (historyCount < PROFILE_HISTORY) {
+    historyCount++;
+  }
+
+  if (--framesUntilReport == 0) {
+    framesUntilReport = REPORT_INTERVAL;
+    drawOverlay();
+    printReport();
+  }
+}
+
+#endif
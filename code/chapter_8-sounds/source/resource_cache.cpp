@@ -0,0 +1,249 @@
+/*
+ *  resource_cache.cpp
+ *
+ *  Loads game assets from NitroFS by name, and keeps the ones used most
+ *  recently in RAM.
+ *
+ */
+
+#include "resource_cache.h"
+#include <malloc.h>
+#include <nds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Buffers start and end on data cache lines. */
+static const u32 CACHE_LINE = 32;
+
+static int handleSlot(ResourceHandle handle) { return handle & 0xFFFF; }
+
+static u16 handleGeneration(ResourceHandle handle) { return handle >> 16; }
+
+static ResourceHandle makeHandle(int slot, u16 generation) {
+  return ((ResourceHandle)generation << 16) | slot;
+}
+
+ResourceCache::ResourceCache(u32 _budget, const char *_root) {
+  budget = _budget;
+  usedBytes = 0;
+  clock = 0;
+  hits = 0;
+  misses = 0;
+  evictions = 0;
+
+  snprintf(root, sizeof(root), "%s", _root);
+
+  for (int i = 0; i < MAX_RESOURCES; i++) {
+    entries[i].name[0] = '\0';
+    entries[i].data = NULL;
+    entries[i].size = 0;
+    entries[i].references = 0;
+    entries[i].generation = 1;
+  }
+}
+
+ResourceCache::~ResourceCache() {
+  for (int i = 0; i < MAX_RESOURCES; i++) {
+    free(entries[i].data);
+  }
+}
+
+ResourceCache::Entry *ResourceCache::lookup(ResourceHandle handle) const {
+  int slot = handleSlot(handle);
+  if (slot >= MAX_RESOURCES) {
+    return NULL;
+  }
+
+  const Entry *entry = &entries[slot];
+  if (entry->data == NULL || entry->generation != handleGeneration(handle)) {
+    return NULL;
+  }
+  return const_cast<Entry *>(entry);
+}
+
+int ResourceCache::find(const char *name) const {
+  for (int i = 0; i < MAX_RESOURCES; i++) {
+    if (entries[i].data != NULL && strcmp(entries[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void ResourceCache::evict(int slot) {
+  Entry *entry = &entries[slot];
+  free(entry->data);
+  usedBytes -= entry->size;
+
+  entry->data = NULL;
+  entry->name[0] = '\0';
+  entry->size = 0;
+
+  /* Retire the slot's handles, skipping generation 0 when it wraps. */
+  if (++entry->generation == 0) {
+    entry->generation = 1;
+  }
+  evictions++;
+}
+
+/*
+ *  Throw out the least recently used asset that isn't acquired. Returns
+ *  the slot it was in, or -1 if every asset is acquired.
+ */
+int ResourceCache::evictOldest() {
+  int oldest = -1;
+  for (int i = 0; i < MAX_RESOURCES; i++) {
+    const Entry *entry = &entries[i];
+    if (entry->data != NULL && entry->references == 0 &&
+        (oldest < 0 || entry->lastUsed < entries[oldest].lastUsed)) {
+      oldest = i;
+    }
+  }
+  if (oldest >= 0) {
+    evict(oldest);
+  }
+  return oldest;
+}
+
+/* Throw out assets until there is room for bytes more. */
+bool ResourceCache::makeRoom(u32 bytes) {
+  while (usedBytes + bytes > budget) {
+    if (evictOldest() < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Load an asset into a free slot. Returns the slot, or -1. */
+int ResourceCache::load(const char *name) {
+  if (strlen(name) > (size_t)MAX_NAME_LENGTH) {
+    return -1;
+  }
+
+  char path[MAX_PATH_LENGTH + MAX_NAME_LENGTH + 1];
+  snprintf(path, sizeof(path), "%s%s", root, name);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  /*
+   *  Something bigger than the whole budget can never fit, so don't throw
+   *  anything out for it.
+   */
+  if (size <= 0 || (u32)size > budget) {
+    fclose(file);
+    return -1;
+  }
+
+  /* Make room before finding a slot, as making room frees slots too. */
+  int slot = -1;
+  if (makeRoom(size)) {
+    for (int i = 0; i < MAX_RESOURCES; i++) {
+      if (entries[i].data == NULL) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot < 0) {
+      /* Every slot is taken, so throw something out to free one. */
+      slot = evictOldest();
+    }
+  }
+
+  /*
+   *  Round the buffer up to whole cache lines, so that flushing or
+   *  invalidating it never touches anything that shares a line with it.
+   */
+  u8 *data = NULL;
+  if (slot >= 0) {
+    u32 bytes = (size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+    data = (u8 *)memalign(CACHE_LINE, bytes);
+  }
+  if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+    free(data);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+
+  /* DMA reads memory, not the cache, so write the data out to memory. */
+  DC_FlushRange(data, size);
+
+  Entry *entry = &entries[slot];
+  snprintf(entry->name, sizeof(entry->name), "%s", name);
+  entry->data = data;
+  entry->size = size;
+  entry->references = 0;
+  usedBytes += size;
+  return slot;
+}
+
+ResourceHandle ResourceCache::acquire(const char *name) {
+  int slot = find(name);
+  if (slot >= 0) {
+    hits++;
+  } else {
+    misses++;
+    slot = load(name);
+    if (slot < 0) {
+      return INVALID_RESOURCE;
+    }
+  }
+
+  Entry *entry = &entries[slot];
+  entry->references++;
+  entry->lastUsed = clock++;
+  return makeHandle(slot, entry->generation);
+}
+
+void ResourceCache::release(ResourceHandle handle) {
+  Entry *entry = lookup(handle);
+  if (entry != NULL && entry->references > 0) {
+    entry->references--;
+  }
+}
+
+const void *ResourceCache::getData(ResourceHandle handle) const {
+  Entry *entry = lookup(handle);
+  return entry != NULL ? entry->data : NULL;
+}
+
+u32 ResourceCache::getSize(ResourceHandle handle) const {
+  Entry *entry = lookup(handle);
+  return entry != NULL ? entry->size : 0;
+}
+
+/* The DMA queue calls this when a copy made by copyToVram() is done. */
+void ResourceCache::onCopied(DmaFence, void *userData) {
+  Entry *entry = (Entry *)userData;
+  entry->references--;
+}
+
+DmaFence ResourceCache::copyToVram(ResourceHandle handle, void *dst,
+                                   DmaQueue *dmaQueue, int priority) {
+  Entry *entry = lookup(handle);
+  if (entry == NULL) {
+    return 0;
+  }
+
+  /* Hold on to the asset until the copy is done. */
+  entry->references++;
+  DmaFence fence = dmaQueue->submit(entry->data, dst, entry->size, priority,
+                                    DmaQueue::NO_DEADLINE, onCopied, entry);
+  if (fence == 0) {
+    entry->references--;
+  }
+  return fence;
+}
+
+void ResourceCache::setBudget(u32 _budget) {
+  budget = _budget;
+  makeRoom(0);
+}
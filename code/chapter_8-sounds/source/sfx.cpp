@@ -0,0 +1,204 @@
+/*
+ *  sfx.cpp
+ *
+ *  Decides which sound effects get to play, when more are asked for than
+ *  there are voices to play them.
+ *
+ */
+
+#include "sfx.h"
+#include <assert.h>
+#include <maxmod9.h>
+#include <nds.h>
+#include <string.h>
+
+/* maxmod plays an effect at its normal pitch at this rate. */
+static const int NORMAL_RATE = 1024;
+
+SfxManager::SfxManager(SfxStealPolicy _stealPolicy) {
+  stealPolicy = _stealPolicy;
+  frame = 0;
+  requestCount = 0;
+  memset(effects, 0, sizeof(effects));
+  memset(voices, 0, sizeof(voices));
+  memset(&stats, 0, sizeof(stats));
+  memset(&pending, 0, sizeof(pending));
+}
+
+void SfxManager::setup(mm_word effectId, int priority, int maxInstances,
+                       int minInterval, int volume) {
+  assert(effectId < (mm_word)MAX_EFFECTS);
+  assert(maxInstances > 0 && maxInstances <= MAX_VOICES);
+
+  mmLoadEffect(effectId);
+
+  Effect *effect = &effects[effectId];
+  effect->priority = priority;
+  effect->maxInstances = maxInstances;
+  effect->minInterval = minInterval;
+  effect->volume = volume;
+  /* Allow the first play straight away. */
+  effect->lastStart = frame - minInterval;
+  effect->used = true;
+}
+
+void SfxManager::play(mm_word effectId, int screenX) {
+  assert(effectId < (mm_word)MAX_EFFECTS && effects[effectId].used);
+
+  /* Asking again in the same frame doesn't make it any louder. */
+  for (int i = 0; i < requestCount; i++) {
+    if (requests[i].effectId == effectId) {
+      pending.merged++;
+      return;
+    }
+  }
+
+  if (requestCount == MAX_REQUESTS) {
+    pending.dropped++;
+    return;
+  }
+  requests[requestCount].effectId = effectId;
+  requests[requestCount].screenX = screenX;
+  requestCount++;
+}
+
+/* Forget voices whose effects have finished playing. */
+void SfxManager::refreshVoices() {
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (voices[i].active && !mmEffectActive(voices[i].handle)) {
+      voices[i].active = false;
+    }
+  }
+}
+
+int SfxManager::countInstances(mm_word effectId) const {
+  int count = 0;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (voices[i].active && voices[i].effectId == effectId) {
+      count++;
+    }
+  }
+  return count;
+}
+
+int SfxManager::findOldestInstance(mm_word effectId) const {
+  int oldest = -1;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (voices[i].active && voices[i].effectId == effectId &&
+        (oldest < 0 || voices[i].started < voices[oldest].started)) {
+      oldest = i;
+    }
+  }
+  return oldest;
+}
+
+/*
+ *  Find a voice for an effect of the given priority: a free one if there is
+ *  one, or else the one to steal. Returns -1 if every voice is playing
+ *  something more important.
+ */
+int SfxManager::findVoice(int priority) const {
+  int best = -1;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    const Voice *voice = &voices[i];
+    if (!voice->active) {
+      return i;
+    }
+    if (voice->priority > priority) {
+      continue;
+    }
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+
+    /* Take from the least important first, then by the steal policy. */
+    const Voice *current = &voices[best];
+    if (voice->priority != current->priority) {
+      if (voice->priority < current->priority) {
+        best = i;
+      }
+    } else if (stealPolicy == SFX_STEAL_QUIETEST &&
+               voice->volume != current->volume) {
+      if (voice->volume < current->volume) {
+        best = i;
+      }
+    } else if (voice->started < current->started) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void SfxManager::start(const Request *request, int voice) {
+  const Effect *effect = &effects[request->effectId];
+
+  /* Pan from 0 (left) to 255 (right), by where on the screen it is. */
+  int x = request->screenX;
+  if (x < 0) {
+    x = 0;
+  } else if (x >= SCREEN_WIDTH) {
+    x = SCREEN_WIDTH - 1;
+  }
+
+  mm_sound_effect sound;
+  sound.id = request->effectId;
+  sound.rate = NORMAL_RATE;
+  sound.handle = 0;
+  sound.volume = effect->volume;
+  sound.panning = x * 256 / SCREEN_WIDTH;
+
+  voices[voice].handle = mmEffectEx(&sound);
+  voices[voice].effectId = request->effectId;
+  voices[voice].priority = effect->priority;
+  voices[voice].volume = effect->volume;
+  voices[voice].started = frame;
+  voices[voice].active = true;
+}
+
+void SfxManager::update() {
+  refreshVoices();
+
+  for (int r = 0; r < requestCount; r++) {
+    const Request *request = &requests[r];
+    Effect *effect = &effects[request->effectId];
+
+    /* Too soon since it last started. */
+    if (frame - effect->lastStart < effect->minInterval) {
+      pending.dropped++;
+      continue;
+    }
+
+    /* Too many copies already playing: restart the oldest one instead. */
+    int voice = -1;
+    if (countInstances(request->effectId) >= effect->maxInstances) {
+      voice = findOldestInstance(request->effectId);
+    } else {
+      voice = findVoice(effect->priority);
+    }
+    if (voice < 0) {
+      pending.dropped++;
+      continue;
+    }
+
+    if (voices[voice].active) {
+      mmEffectCancel(voices[voice].handle);
+      pending.stolen++;
+    }
+    start(request, voice);
+    effect->lastStart = frame;
+    pending.started++;
+  }
+  requestCount = 0;
+
+  pending.voicesUsed = 0;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (voices[i].active) {
+      pending.voicesUsed++;
+    }
+  }
+
+  stats = pending;
+  memset(&pending, 0, sizeof(pending));
+  frame++;
+}
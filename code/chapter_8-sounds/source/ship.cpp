@@ -8,31 +8,30 @@
  */
 
 #include "ship.h"
-#include <math.h>
-
-int Ship::radToDeg(float rad) {
-  return (int)(rad * (DEGREES_IN_CIRCLE / (2 * PI)));
-}
+#include "profiler.h"
+#include "tcm.h"
+#include "trig.h"
 
 Ship::Ship(SpriteInfo *_spriteInfo) {
   spriteInfo = _spriteInfo;
 
   /* Place the ship in an interesting part of the screen. */
-  position.x = SCREEN_WIDTH / 2 - spriteInfo->width * 2 + spriteInfo->width / 2;
-  position.y = SCREEN_HEIGHT / 2 - spriteInfo->height;
+  position.x = fixed::fromInt(SCREEN_WIDTH / 2 - spriteInfo->width * 2 +
+                              spriteInfo->width / 2);
+  position.y = fixed::fromInt(SCREEN_HEIGHT / 2 - spriteInfo->height);
 
   /* Stop the ship from moving */
-  velocity.x = 0;
-  velocity.y = 0;
+  velocity.x = fixed::fromInt(0);
+  velocity.y = fixed::fromInt(0);
 
-  /* Point the ship at a cool angle. */
-  angle = 5.67232007;
+  /* Point the ship at a cool angle (about 5.672 radians). */
+  angle = 29582;
 
   /* Set up some sane kinematic static properties. */
-  turnSpeed = .0368;
-  thrust = .05;
-  maxSpeed = 1.0;
-  mass = 1.0;
+  turnSpeed = 192; // about .0368 radians
+  thrust = fixed::fromFloat(.05);
+  maxSpeed = fixed::fromInt(1);
+  mass = fixed::fromInt(1);
 }
 
 Ship::~Ship() {
@@ -40,49 +39,80 @@ Ship::~Ship() {
   // pointed to by spriteInfo)
 }
 
-void Ship::accelerate() {
+HOT_CODE void Ship::accelerate() {
+  /*
+   *  sinLerp() and cosLerp() return 4.12 fixed-point values from a lookup
+   *  table, which happens to be exactly our fixed format.
+   */
+  velocity.x += thrust * fixed::fromRaw(sinLerp(angle));
+  velocity.y -= thrust * fixed::fromRaw(cosLerp(angle));
+
+  /*
+   *  Make sure the ship can't go too fast in any direction. Comparing the
+   *  squares of the speeds tells us whether we are too fast without a square
+   *  root. The squares have 24 fractional bits, and are done in 64 bits so
+   *  that a large maxSpeed can't overflow them.
+   */
+  s64 speedSquared = (s64)velocity.x.raw * velocity.x.raw +
+                     (s64)velocity.y.raw * velocity.y.raw;
+  s64 maxSpeedSquared = (s64)maxSpeed.raw * maxSpeed.raw;
+  if (speedSquared <= maxSpeedSquared) {
+    return;
+  }
 
-  float incX = thrust * sin(angle);
-  float incY = -(thrust * cos(angle));
+  /*
+   *  Too fast, so scale the velocity back down to maxSpeed. This is the
+   *  rare case, and the DS has hardware to help: sqrt64() uses the square
+   *  root unit and divf32() the divider, so neither needs soft-float. The
+   *  square root of a number with 24 fractional bits has 12.
+   */
+  s32 speed = sqrt64(speedSquared);
+  fixed scale = fixed::fromRaw(divf32(maxSpeed.raw, speed));
+  velocity = velocity * scale;
+}
 
-  // The following method of speed limitation is not accurate. Traveling
-  // diagonally is faster than straight, which is not the desired limitation.
-  // A more accurate method is needed at a later time.
+HOT_CODE void Ship::moveShip() {
+  PROFILE_SCOPE(PROFILE_MOVE_SHIP);
 
-  velocity.x += incX;
-  // Make sure the ship can't go too fast in x direction.
-  if (velocity.x > maxSpeed) {
-    velocity.x = maxSpeed;
-  }
-  if (velocity.x < -maxSpeed) {
-    velocity.x = -maxSpeed;
-  }
+  // Move the ship.
+  position += velocity;
 
-  velocity.y += incY;
-  // Make sure the ship can't go too fast in y direction.
-  if (velocity.y > maxSpeed) {
-    velocity.y = maxSpeed;
-  }
-  if (velocity.y < -maxSpeed) {
-    velocity.y = -maxSpeed;
-  }
+  // Hardware does wrap around for the sprite, but we keep our own position
+  // inside the same space so it can never overflow. Both world dimensions are
+  // powers of two, so a mask is enough.
+  position.x.raw &= (WORLD_WIDTH << fixed::FRACTION_BITS) - 1;
+  position.y.raw &= (WORLD_HEIGHT << fixed::FRACTION_BITS) - 1;
 }
 
-void Ship::moveShip() {
-  // Move the ship.
-  position.x += velocity.x;
-  position.y += velocity.y;
+void Ship::reverseTurn() {
+  angle = (DEGREES_IN_CIRCLE - atan2Lerp(velocity.x.raw, velocity.y.raw)) &
+          (DEGREES_IN_CIRCLE - 1);
+}
 
-  // Hardware does wrap around for us, so we don't have to have any of that
-  // sort of logic in here.
+void Ship::turnClockwise() {
+  angle = (angle + turnSpeed) & (DEGREES_IN_CIRCLE - 1);
 }
 
-void Ship::reverseTurn() { angle = (2 * PI) - atan2(velocity.x, velocity.y); }
+void Ship::turnCounterClockwise() {
+  angle = (angle - turnSpeed) & (DEGREES_IN_CIRCLE - 1);
+}
 
-void Ship::turnClockwise() { angle += turnSpeed; }
+MathVector2D<fixed> Ship::getPosition() { return position; }
 
-void Ship::turnCounterClockwise() { angle -= turnSpeed; }
+MathVector2D<fixed> Ship::getVelocity() { return velocity; }
 
-MathVector2D<float> Ship::getPosition() { return position; }
+int Ship::getAngleDeg() { return angle; }
 
-int Ship::getAngleDeg() { return radToDeg(angle); }
+/* Wrap a raw fixed-point distance into [-size / 2, size / 2). */
+static s32 wrapDelta(s32 delta, int size) {
+  s32 span = size << fixed::FRACTION_BITS;
+  return ((delta + span / 2) & (span - 1)) - span / 2;
+}
+
+MathVector2D<fixed> worldDelta(MathVector2D<fixed> from,
+                               MathVector2D<fixed> to) {
+  MathVector2D<fixed> delta;
+  delta.x = fixed::fromRaw(wrapDelta(to.x.raw - from.x.raw, WORLD_WIDTH));
+  delta.y = fixed::fromRaw(wrapDelta(to.y.raw - from.y.raw, WORLD_HEIGHT));
+  return delta;
+}
@@ -0,0 +1,196 @@
+/*
+ *  sprite_batch.cpp
+ *
+ *  Draws sprites as textured quads with the 3D engine, for when there are
+ *  more of them than OAM can hold.
+ *
+ */
+
+#include "sprite_batch.h"
+#include <assert.h>
+#include <nds.h>
+#include <stdlib.h>
+#include <string.h>
+
+SpriteBatch::SpriteBatch() {
+  textureCount = 0;
+  quadCount = 0;
+  dropped = 0;
+  memset(&stats, 0, sizeof(stats));
+
+  glInit();
+  glEnable(GL_TEXTURE_2D);
+
+  /*
+   *  Clear to transparent, so the 2D backgrounds behind show through where
+   *  there are no sprites.
+   */
+  glClearColor(0, 0, 0, 0);
+  glClearPolyID(63);
+  glClearDepth(GL_MAX_DEPTH);
+  glViewport(0, 0, SCREEN_WIDTH - 1, SCREEN_HEIGHT - 1);
+
+  /*
+   *  Vertices are 4.12 fixed point, and so is the projection. Making the
+   *  projection SCREEN_WIDTH by SCREEN_HEIGHT units of 1/4096 means a
+   *  vertex's raw value is in screen pixels, so vertices can be sent as
+   *  plain integers with no scaling at all.
+   */
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrthof32(0, SCREEN_WIDTH, SCREEN_HEIGHT, 0, -inttof32(1), inttof32(1));
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+
+  glColor(RGB15(31, 31, 31));
+}
+
+int SpriteBatch::addTexture(const void *tiles, const u16 *palette, int width,
+                            int height) {
+  if (textureCount == MAX_TEXTURES) {
+    return NO_TEXTURE;
+  }
+
+  /*
+   *  A row of one 16-color tile is 8 pixels in 4 bytes, low nibble first,
+   *  which is just how a row of a texture is packed. So each tile row can
+   *  be copied as one word, to wherever that row of the texture is.
+   */
+  int columns = width / 8;
+  u32 *rows = (u32 *)malloc(width * height / 2);
+  if (rows == NULL) {
+    return NO_TEXTURE;
+  }
+  const u32 *tileRows = (const u32 *)tiles;
+  for (int y = 0; y < height; y++) {
+    for (int column = 0; column < columns; column++) {
+      int tile = (y / 8) * columns + column;
+      rows[y * columns + column] = tileRows[tile * 8 + y % 8];
+    }
+  }
+
+  Texture *texture = &textures[textureCount];
+  texture->width = width;
+  texture->height = height;
+  glGenTextures(1, &texture->name);
+  glBindTexture(0, texture->name);
+  int loaded = glTexImage2D(0, 0, GL_RGB16, width, height, 0,
+                            TEXGEN_TEXCOORD | GL_TEXTURE_COLOR0_TRANSPARENT,
+                            rows);
+  free(rows);
+  if (!loaded) {
+    glDeleteTextures(1, &texture->name);
+    return NO_TEXTURE;
+  }
+  glColorTableEXT(0, 0, 16, 0, 0, palette);
+
+  return textureCount++;
+}
+
+void SpriteBatch::begin() {
+  quadCount = 0;
+  dropped = 0;
+}
+
+bool SpriteBatch::submit(const SpriteInfo *spriteInfo, int texture, int x,
+                         int y, int scale) {
+  assert(texture >= 0 && texture < textureCount);
+
+  if (quadCount == MAX_QUADS) {
+    dropped++;
+    return false;
+  }
+
+  Quad *quad = &quads[quadCount++];
+  quad->x = x;
+  quad->y = y;
+  quad->width = spriteInfo->width;
+  quad->height = spriteInfo->height;
+  quad->angle = spriteInfo->angle;
+  quad->scale = scale;
+  quad->texture = texture;
+  return true;
+}
+
+/* Counting sort, which keeps the quads of each texture in submit order. */
+void SpriteBatch::sortByTexture() {
+  memset(textureStart, 0, sizeof(textureStart));
+  for (int i = 0; i < quadCount; i++) {
+    textureStart[quads[i].texture + 1]++;
+  }
+  for (int t = 0; t < textureCount; t++) {
+    textureStart[t + 1] += textureStart[t];
+  }
+
+  u16 next[MAX_TEXTURES];
+  memcpy(next, textureStart, sizeof(next));
+  for (int i = 0; i < quadCount; i++) {
+    order[next[quads[i].texture]++] = i;
+  }
+}
+
+/*
+ *  Send one quad's four corners, rotated and scaled about its middle. The
+ *  quad's index is its depth, so later quads are nearer.
+ */
+void SpriteBatch::drawQuad(int index) {
+  const Quad *quad = &quads[index];
+  const Texture *texture = &textures[quad->texture];
+
+  /* Half the quad's size on screen, and its middle. */
+  int halfWidth = (quad->width * quad->scale) >> 9;
+  int halfHeight = (quad->height * quad->scale) >> 9;
+  int centerX = quad->x + quad->width / 2;
+  int centerY = quad->y + quad->height / 2;
+
+  /* Turn counter-clockwise on screen, as rotateSprite() does. */
+  s32 s = sinLerp(quad->angle);
+  s32 c = cosLerp(quad->angle);
+  s32 ax = (halfWidth * c) >> 12;
+  s32 ay = -(halfWidth * s) >> 12;
+  s32 bx = (halfHeight * s) >> 12;
+  s32 by = (halfHeight * c) >> 12;
+
+  glTexCoord2t16(0, 0);
+  glVertex3v16(centerX - ax - bx, centerY - ay - by, index);
+  glTexCoord2t16(0, inttot16(texture->height));
+  glVertex3v16(centerX - ax + bx, centerY - ay + by, index);
+  glTexCoord2t16(inttot16(texture->width), inttot16(texture->height));
+  glVertex3v16(centerX + ax + bx, centerY + ay + by, index);
+  glTexCoord2t16(inttot16(texture->width), 0);
+  glVertex3v16(centerX + ax - bx, centerY + ay - by, index);
+}
+
+void SpriteBatch::flush() {
+  sortByTexture();
+
+  stats.textureBinds = 0;
+  glPolyFmt(POLY_ALPHA(31) | POLY_CULL_NONE);
+  for (int t = 0; t < textureCount; t++) {
+    if (textureStart[t] == textureStart[t + 1]) {
+      continue;
+    }
+
+    glBindTexture(0, textures[t].name);
+    stats.textureBinds++;
+    glBegin(GL_QUADS);
+    for (int i = textureStart[t]; i < textureStart[t + 1]; i++) {
+      drawQuad(order[i]);
+    }
+    glEnd();
+  }
+
+  stats.quads = quadCount;
+  stats.dropped = dropped;
+  stats.polygons = quadCount;
+  stats.vertices = quadCount * 4;
+
+  int polygonsInRam = 0;
+  int verticesInRam = 0;
+  glGetInt(GL_GET_POLYGON_RAM_COUNT, &polygonsInRam);
+  glGetInt(GL_GET_VERTEX_RAM_COUNT, &verticesInRam);
+  stats.polygonsInRam = polygonsInRam;
+  stats.verticesInRam = verticesInRam;
+
+  glFlush(0);
+}
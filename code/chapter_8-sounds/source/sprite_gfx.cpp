@@ -0,0 +1,263 @@
+/*
+ *  sprite_gfx.cpp
+ *
+ *  An allocator for sprite graphics memory (SPRITE_GFX).
+ *
+ */
+
+#include "sprite_gfx.h"
+#include "sprites.h"
+#include <assert.h>
+#include <nds.h>
+
+static const s16 NO_BLOCK = -1;
+
+SpriteGfxAllocator::SpriteGfxAllocator(u16 *_gfxBase, u32 bankSize,
+                                       u32 _boundary) {
+  gfxBase = _gfxBase;
+  boundary = _boundary;
+  dmaQueue = NULL;
+
+  /*
+   *  Only the first MAX_BLOCKS blocks can be reached by a gfxIndex. With the
+   *  default 32 byte boundary, that is only the first 32KB of a bank.
+   */
+  blockCount = bankSize / boundary;
+  if (blockCount > MAX_BLOCKS) {
+    blockCount = MAX_BLOCKS;
+  }
+  topOrder = 0;
+  while ((2 << topOrder) <= blockCount) {
+    topOrder++;
+  }
+
+  for (int i = 0; i <= MAX_ORDER; i++) {
+    freeHead[i] = NO_BLOCK;
+  }
+  for (int i = 0; i < MAX_BLOCKS; i++) {
+    blockUsed[i] = false;
+  }
+  for (int i = 0; i < MAX_SHARED; i++) {
+    shared[i].source = NULL;
+  }
+
+  /* Everything starts out as one big free region. */
+  pushFree(0, topOrder);
+}
+
+void SpriteGfxAllocator::setDmaQueue(DmaQueue *_dmaQueue) {
+  dmaQueue = _dmaQueue;
+}
+
+void SpriteGfxAllocator::pushFree(int block, int order) {
+  blockOrder[block] = order;
+  blockUsed[block] = false;
+  prevFree[block] = NO_BLOCK;
+  nextFree[block] = freeHead[order];
+  if (freeHead[order] != NO_BLOCK) {
+    prevFree[freeHead[order]] = block;
+  }
+  freeHead[order] = block;
+}
+
+void SpriteGfxAllocator::removeFree(int block, int order) {
+  if (prevFree[block] != NO_BLOCK) {
+    nextFree[prevFree[block]] = nextFree[block];
+  } else {
+    freeHead[order] = nextFree[block];
+  }
+  if (nextFree[block] != NO_BLOCK) {
+    prevFree[nextFree[block]] = prevFree[block];
+  }
+}
+
+int SpriteGfxAllocator::orderForBytes(u32 bytes) const {
+  u32 blocks = (bytes + boundary - 1) / boundary;
+  int order = 0;
+  while ((1u << order) < blocks) {
+    order++;
+  }
+  return order;
+}
+
+int SpriteGfxAllocator::alloc(u32 bytes) {
+  int order = orderForBytes(bytes);
+  if (order > topOrder) {
+    return -1;
+  }
+
+  /* Find the smallest free region that is big enough. */
+  int found = order;
+  while (found <= topOrder && freeHead[found] == NO_BLOCK) {
+    found++;
+  }
+  if (found > topOrder) {
+    return -1;
+  }
+
+  int block = freeHead[found];
+  removeFree(block, found);
+
+  /* Split it in halves until it is the size we want, freeing the upper
+   * halves as we go. */
+  while (found > order) {
+    found--;
+    pushFree(block + (1 << found), found);
+  }
+
+  blockOrder[block] = order;
+  blockUsed[block] = true;
+  return block;
+}
+
+void SpriteGfxAllocator::free(int gfxIndex) {
+  assert(gfxIndex >= 0 && gfxIndex < blockCount && blockUsed[gfxIndex]);
+
+  int block = gfxIndex;
+  int order = blockOrder[block];
+
+  /*
+   *  Merge with our buddy for as long as it is free and the same size. The
+   *  buddy is always the first block of a region, so its bookkeeping is
+   *  valid.
+   */
+  while (order < topOrder) {
+    int buddy = block ^ (1 << order);
+    if (blockUsed[buddy] || blockOrder[buddy] != order) {
+      break;
+    }
+    removeFree(buddy, order);
+    if (buddy < block) {
+      block = buddy;
+    }
+    order++;
+  }
+
+  pushFree(block, order);
+}
+
+int SpriteGfxAllocator::findShared(const void *source) const {
+  /* Pointers to graphics are at least word aligned, so skip the low bits. */
+  u32 slot = ((u32)(uintptr_t)source >> 2) % MAX_SHARED;
+  for (int i = 0; i < MAX_SHARED; i++) {
+    int index = (slot + i) % MAX_SHARED;
+    if (shared[index].source == source) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+int SpriteGfxAllocator::acquireShared(const void *source, u32 bytes,
+                                      DmaFence *fence) {
+  int index = findShared(source);
+  if (index >= 0) {
+    shared[index].refCount++;
+    if (fence) {
+      *fence = shared[index].fence;
+    }
+    return shared[index].gfxIndex;
+  }
+
+  /* Not loaded yet, so look for a free slot in the table. */
+  u32 slot = ((u32)(uintptr_t)source >> 2) % MAX_SHARED;
+  for (int i = 0; i < MAX_SHARED; i++) {
+    index = (slot + i) % MAX_SHARED;
+    if (shared[index].source == NULL) {
+      break;
+    }
+  }
+  if (shared[index].source != NULL) {
+    return -1;
+  }
+
+  int gfxIndex = alloc(bytes);
+  if (gfxIndex < 0) {
+    return -1;
+  }
+
+  DmaFence uploadFence = 0;
+  if (dmaQueue) {
+    uploadFence = dmaQueue->submit(source, getPointer(gfxIndex), bytes);
+  }
+  if (uploadFence == 0) {
+    /* No queue, or it is full. Copy the graphics right now instead. */
+    dmaCopyHalfWords(SPRITE_DMA_CHANNEL, source, getPointer(gfxIndex), bytes);
+  }
+  if (fence) {
+    *fence = uploadFence;
+  }
+
+  shared[index].source = source;
+  shared[index].gfxIndex = gfxIndex;
+  shared[index].refCount = 1;
+  shared[index].fence = uploadFence;
+  return gfxIndex;
+}
+
+void SpriteGfxAllocator::releaseShared(const void *source) {
+  int index = findShared(source);
+  assert(index >= 0);
+
+  if (--shared[index].refCount > 0) {
+    return;
+  }
+
+  free(shared[index].gfxIndex);
+  shared[index].source = NULL;
+}
+
+u16 *SpriteGfxAllocator::getPointer(int gfxIndex) const {
+  /*
+   *  Since gfxBase is a u16*, the compiler will increment the address it
+   *  points to by 2 for each change in 1 of the array index. (The compiler
+   *  does pointer arithmetic.)
+   */
+  return &gfxBase[gfxIndex * (boundary / sizeof(gfxBase[0]))];
+}
+
+void SpriteGfxAllocator::report(SpriteGfxReport *out) const {
+  out->totalBytes = (1 << topOrder) * boundary;
+  out->usedBytes = 0;
+  out->freeBytes = 0;
+  out->largestFreeBytes = 0;
+  out->freeRegions = 0;
+  out->compactionBytes = 0;
+
+  /*
+   *  Walk the regions in address order. Neighbouring free regions of
+   *  different sizes can't be merged by the buddy system, but they still
+   *  form one usable run as far as fragmentation is concerned.
+   */
+  u32 run = 0;
+  bool seenFree = false;
+  for (int block = 0; block < (1 << topOrder);
+       block += 1 << blockOrder[block]) {
+    u32 bytes = (1 << blockOrder[block]) * boundary;
+    if (blockUsed[block]) {
+      out->usedBytes += bytes;
+      /* Anything above the first hole would move if we compacted. */
+      if (seenFree) {
+        out->compactionBytes += bytes;
+      }
+      run = 0;
+    } else {
+      out->freeBytes += bytes;
+      if (run == 0) {
+        out->freeRegions++;
+      }
+      run += bytes;
+      if (run > out->largestFreeBytes) {
+        out->largestFreeBytes = run;
+      }
+      seenFree = true;
+    }
+  }
+
+  if (out->freeBytes == 0) {
+    out->fragmentationPercent = 0;
+  } else {
+    out->fragmentationPercent =
+        100 - (out->largestFreeBytes * 100) / out->freeBytes;
+  }
+}
@@ -0,0 +1,267 @@
+/*
+ *  sprite_mux.cpp
+ *
+ *  An optional sprite multiplexer, for showing more than SPRITE_COUNT
+ *  sprites at once.
+ *
+ */
+
+#include "sprite_mux.h"
+#include <nds.h>
+
+SpriteMultiplexer *SpriteMultiplexer::active = NULL;
+
+/*
+ *  Sprites with a y coordinate near the bottom of the 256 line range are
+ *  really above the top of the screen, poking down into it.
+ */
+static const int Y_WRAP = 256;
+static const int Y_WRAP_START = SCREEN_HEIGHT;
+static const int TOP_OFFSET = Y_WRAP - Y_WRAP_START;
+
+SpriteMultiplexer::SpriteMultiplexer(OAMShadow *_oamShadow, int _dmaChannel) {
+  oamShadow = _oamShadow;
+  dmaChannel = _dmaChannel;
+  enabled = false;
+  spriteCount = 0;
+  frontTables = 0;
+
+  for (int t = 0; t < 2; t++) {
+    for (int b = 0; b < BAND_COUNT; b++) {
+      for (int i = 0; i < ENTRIES_PER_BAND; i++) {
+        bandTables[t][b][i].attribute[0] = ATTR0_DISABLED;
+        bandTables[t][b][i].attribute[1] = 0;
+        bandTables[t][b][i].attribute[2] = 0;
+      }
+    }
+  }
+  for (int b = 0; b < BAND_COUNT; b++) {
+    stats[b].requested = 0;
+    stats[b].shown = 0;
+    stats[b].dropped = 0;
+  }
+}
+
+void SpriteMultiplexer::enable() {
+  active = this;
+  enabled = true;
+
+  /*
+   *  The DS only lets us touch OAM during HBlank when we tell it to. This
+   *  costs some of the time the hardware has for drawing sprites on each
+   *  line, which is fine since each band holds at most half of OAM anyway.
+   */
+  REG_DISPCNT |= DISPLAY_SPR_HBLANK;
+
+  irqSet(IRQ_VCOUNT, onVCount);
+  irqEnable(IRQ_VCOUNT);
+}
+
+void SpriteMultiplexer::disable() {
+  irqDisable(IRQ_VCOUNT);
+  REG_DISPCNT &= ~DISPLAY_SPR_HBLANK;
+
+  enabled = false;
+  active = NULL;
+}
+
+void SpriteMultiplexer::begin() { spriteCount = 0; }
+
+bool SpriteMultiplexer::submit(SpriteInfo *info, int importance) {
+  if (spriteCount >= MAX_SPRITES) {
+    return false;
+  }
+
+  SpriteEntry *entry = info->entry;
+  VirtualSprite *sprite = &sprites[spriteCount++];
+  sprite->info = info;
+  sprite->importance = importance;
+
+  /* Double bound affine sprites take up twice their size on screen. */
+  int height = info->height;
+  if (entry->isRotateScale && entry->isSizeDouble) {
+    height *= 2;
+  }
+  sprite->top = entry->y >= Y_WRAP_START ? entry->y - Y_WRAP : entry->y;
+  sprite->bottom = sprite->top + height;
+
+  return true;
+}
+
+void SpriteMultiplexer::build() {
+  /*
+   *  Sort the sprites by their top line with a counting sort. There are
+   *  only 256 possible top lines, so this is a linear time sort.
+   */
+  static u16 counts[Y_WRAP];
+  for (int i = 0; i < Y_WRAP; i++) {
+    counts[i] = 0;
+  }
+  for (int i = 0; i < spriteCount; i++) {
+    counts[sprites[i].top + TOP_OFFSET]++;
+  }
+  int position = 0;
+  for (int i = 0; i < Y_WRAP; i++) {
+    int count = counts[i];
+    counts[i] = position;
+    position += count;
+  }
+  for (int i = 0; i < spriteCount; i++) {
+    sorted[counts[sprites[i].top + TOP_OFFSET]++] = i;
+  }
+
+  int backTables = frontTables ^ 1;
+  static u16 candidates[MAX_SPRITES];
+
+  for (int band = 0; band < BAND_COUNT; band++) {
+    int bandTop = band * BAND_HEIGHT;
+    int bandBottom = bandTop + BAND_HEIGHT;
+
+    /* Every sprite that covers at least one line of the band. Since the
+     * sprites are sorted by top line, we can stop at the first one that
+     * starts below the band. */
+    int count = 0;
+    for (int i = 0; i < spriteCount; i++) {
+      VirtualSprite *sprite = &sprites[sorted[i]];
+      if (sprite->top >= bandBottom) {
+        break;
+      }
+      if (sprite->bottom > bandTop) {
+        candidates[count++] = i;
+      }
+    }
+
+    stats[band].requested = count;
+
+    /*
+     *  Too many sprites for the band. Keep the most important ones: sort
+     *  by importance (an insertion sort, which keeps sprites of equal
+     *  importance in y order), cut the list, then put the survivors back
+     *  in y order.
+     */
+    if (count > ENTRIES_PER_BAND) {
+      for (int i = 1; i < count; i++) {
+        u16 c = candidates[i];
+        int importance = sprites[sorted[c]].importance;
+        int j = i - 1;
+        while (j >= 0 &&
+               sprites[sorted[candidates[j]]].importance < importance) {
+          candidates[j + 1] = candidates[j];
+          j--;
+        }
+        candidates[j + 1] = c;
+      }
+      count = ENTRIES_PER_BAND;
+      for (int i = 1; i < count; i++) {
+        u16 c = candidates[i];
+        int j = i - 1;
+        while (j >= 0 && candidates[j] > c) {
+          candidates[j + 1] = candidates[j];
+          j--;
+        }
+        candidates[j + 1] = c;
+      }
+    }
+
+    stats[band].shown = count;
+    stats[band].dropped = stats[band].requested - count;
+
+    /*
+     *  Fill in the band's half of OAM. The fourth halfword of each entry is
+     *  part of a rotation matrix, so it comes from the OAM shadow, not from
+     *  the sprite.
+     */
+    SpriteEntry *table = bandTables[backTables][band];
+    const SpriteEntry *matrices =
+        &oamShadow->table->oamBuffer[(band % 2) * ENTRIES_PER_BAND];
+    for (int i = 0; i < ENTRIES_PER_BAND; i++) {
+      table[i] = matrices[i];
+      if (i < count) {
+        const SpriteEntry *entry = sprites[sorted[candidates[i]]].info->entry;
+        table[i].attribute[0] = entry->attribute[0];
+        table[i].attribute[1] = entry->attribute[1];
+        table[i].attribute[2] = entry->attribute[2];
+      } else {
+        table[i].attribute[0] = ATTR0_DISABLED;
+      }
+    }
+  }
+
+  /* The tables are read by DMA, so get them out of the cache. */
+  DC_FlushRange(bandTables[backTables], sizeof(bandTables[backTables]));
+}
+
+void SpriteMultiplexer::uploadBand(int band, bool now) {
+  const SpriteEntry *src = bandTables[frontTables][band];
+  SpriteEntry *dst = (SpriteEntry *)OAM + (band % 2) * ENTRIES_PER_BAND;
+  u32 bytes = ENTRIES_PER_BAND * sizeof(SpriteEntry);
+
+  if (now) {
+    dmaCopyWords(dmaChannel, src, dst, bytes);
+  } else {
+    /*
+     *  Let the DMA hardware start the copy at the beginning of the next
+     *  HBlank, when OAM can be written without disturbing the picture.
+     */
+    DMA_SRC(dmaChannel) = (uintptr_t)src;
+    DMA_DEST(dmaChannel) = (uintptr_t)dst;
+    DMA_CR(dmaChannel) =
+        DMA_ENABLE | DMA_START_HBL | DMA_32_BIT | (bytes / sizeof(u32));
+  }
+}
+
+/* Put bands 0 and 1 in OAM, during VBlank, and start the band chain. */
+void SpriteMultiplexer::startFrame() {
+  /* The first two bands each get a half of OAM straight away. */
+  uploadBand(0, true);
+  uploadBand(1, true);
+
+  /* When band 1 starts, band 0's half can be rewritten for band 2. */
+  SetYtrigger(BAND_HEIGHT);
+}
+
+void SpriteMultiplexer::commit() {
+  if (!enabled) {
+    return;
+  }
+
+  frontTables ^= 1;
+  startFrame();
+}
+
+void SpriteMultiplexer::onVCount() {
+  SpriteMultiplexer *mux = active;
+  if (mux == NULL) {
+    return;
+  }
+
+  /*
+   *  At the end of the frame, OAM holds the last two bands. Put the first
+   *  two back straight away, so that a frame with no commit() shows the
+   *  last frame again, instead of the bottom bands' sprites at the top of
+   *  the screen. A commit() later in VBlank replaces them.
+   */
+  int line = REG_VCOUNT;
+  if (line >= SCREEN_HEIGHT) {
+    mux->startFrame();
+    return;
+  }
+
+  /*
+   *  We are at the top of a band, and the band before it is done with its
+   *  half of OAM. Fill that half in for the band after this one.
+   */
+  int band = line / BAND_HEIGHT;
+  if (band + 1 < BAND_COUNT) {
+    mux->uploadBand(band + 1, false);
+  }
+  if (band + 2 < BAND_COUNT) {
+    SetYtrigger((band + 1) * BAND_HEIGHT);
+  } else {
+    SetYtrigger(SCREEN_HEIGHT);
+  }
+}
+
+const MuxBandStats *SpriteMultiplexer::getBandStats(int band) const {
+  return &stats[band];
+}
@@ -10,10 +10,23 @@
  */
 
 #include "sprites.h"
+#include "profiler.h"
+#include "tcm.h"
 #include <nds.h>
 #include <nds/arm9/trig_lut.h>
 
-void updateOAM(OAMTable *oam) {
+HOT_CODE void updateOAM(OAMTable *oam) {
+  if (isInDtcm(oam)) {
+    /* DMA can't read DTCM, so copy the table ourselves. */
+    const u32 *src = (const u32 *)oam->oamBuffer;
+    vu32 *dst = (vu32 *)OAM;
+    for (u32 i = 0; i < SPRITE_COUNT * sizeof(SpriteEntry) / sizeof(u32);
+         i++) {
+      dst[i] = src[i];
+    }
+    return;
+  }
+
   DC_FlushRange(oam->oamBuffer, SPRITE_COUNT * sizeof(SpriteEntry));
   dmaCopyHalfWords(SPRITE_DMA_CHANNEL, oam->oamBuffer, OAM,
                    SPRITE_COUNT * sizeof(SpriteEntry));
@@ -43,7 +56,9 @@ void initOAM(OAMTable *oam) {
   updateOAM(oam);
 }
 
-void rotateSprite(SpriteRotation *spriteRotation, int angle) {
+HOT_CODE void rotateSprite(SpriteRotation *spriteRotation, int angle) {
+  PROFILE_SCOPE(PROFILE_ROTATE_SPRITE);
+
   s16 s = sinLerp(angle) >> 4;
   s16 c = cosLerp(angle) >> 4;
 
@@ -53,6 +68,28 @@ void rotateSprite(SpriteRotation *spriteRotation, int angle) {
   spriteRotation->vdy = c;
 }
 
+HOT_CODE void rotateScaleSprite(SpriteRotation *spriteRotation, int angle,
+                                int scale) {
+  PROFILE_SCOPE(PROFILE_ROTATE_SPRITE);
+
+  s16 s = sinLerp(angle) >> 4;
+  s16 c = cosLerp(angle) >> 4;
+
+  /*
+   *  The matrix maps screen pixels back to texture pixels, so to make the
+   *  sprite bigger we have to divide by the scale rather than multiply.
+   *  The ARM9 has no divide instruction, so take one reciprocal with the
+   *  hardware divider and multiply by it. It has 12 fractional bits, and
+   *  s and c have 8, so shifting the products down by 12 leaves the 8.8
+   *  the hardware wants.
+   */
+  s32 inverse = divf32(1 << 8, scale);
+  spriteRotation->hdx = (c * inverse) >> 12;
+  spriteRotation->hdy = (s * inverse) >> 12;
+  spriteRotation->vdx = -((s * inverse) >> 12);
+  spriteRotation->vdy = (c * inverse) >> 12;
+}
+
 void setSpriteVisibility(SpriteEntry *spriteEntry, bool hidden, bool affine,
                          bool doubleBound) {
   if (hidden) {
@@ -0,0 +1,122 @@
+/*
+ *  tiled_background.cpp
+ *
+ *  Scrolls a tiled background over a world much larger than the hardware
+ *  map, by only keeping the part around the camera loaded.
+ *
+ */
+
+#include "tiled_background.h"
+#include <nds.h>
+
+/* The hardware map is this many pixels across and down. */
+static const int MAP_PIXELS = TiledBackground::MAP_TILES * 8;
+
+/* Divide, rounding towards minus infinity, so tiles left of 0 work. */
+static int floorDiv(int a, int b) {
+  int q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0))) {
+    q--;
+  }
+  return q;
+}
+
+/* The remainder that goes with floorDiv(), always from 0 to b - 1. */
+static int floorMod(int a, int b) { return a - floorDiv(a, b) * b; }
+
+TiledBackground::TiledBackground(int _id, const u16 *_worldMap,
+                                 int _worldColumns, int _worldRows) {
+  id = _id;
+  hardwareMap = bgGetMapPtr(id);
+  worldMap = _worldMap;
+  worldColumns = _worldColumns;
+  worldRows = _worldRows;
+  cameraX = 0;
+  cameraY = 0;
+  loadedColumn = 0;
+  loadedRow = 0;
+  loaded = false;
+  entriesWritten = 0;
+
+  /* Scrolling past the edge of the hardware map shows the other side. */
+  bgWrapOn(id);
+}
+
+u16 TiledBackground::worldTile(int column, int row) const {
+  return worldMap[floorMod(row, worldRows) * worldColumns +
+                  floorMod(column, worldColumns)];
+}
+
+/* Copy VIEW_ROWS tiles of a world column, starting at firstRow. */
+void TiledBackground::writeColumn(int column, int firstRow) {
+  int mapColumn = column & (MAP_TILES - 1);
+  for (int row = firstRow; row < firstRow + VIEW_ROWS; row++) {
+    hardwareMap[(row & (MAP_TILES - 1)) * MAP_TILES + mapColumn] =
+        worldTile(column, row);
+  }
+  entriesWritten += VIEW_ROWS;
+}
+
+/* Copy VIEW_COLUMNS tiles of a world row, starting at firstColumn. */
+void TiledBackground::writeRow(int row, int firstColumn) {
+  u16 *mapRow = &hardwareMap[(row & (MAP_TILES - 1)) * MAP_TILES];
+  for (int column = firstColumn; column < firstColumn + VIEW_COLUMNS;
+       column++) {
+    mapRow[column & (MAP_TILES - 1)] = worldTile(column, row);
+  }
+  entriesWritten += VIEW_COLUMNS;
+}
+
+void TiledBackground::setCamera(int x, int y) {
+  cameraX = x;
+  cameraY = y;
+}
+
+void TiledBackground::update() {
+  entriesWritten = 0;
+
+  int column = floorDiv(cameraX, 8) - MARGIN_COLUMNS;
+  int row = floorDiv(cameraY, 8);
+  int dx = column - loadedColumn;
+  int dy = row - loadedRow;
+
+  if (!loaded || dx <= -VIEW_COLUMNS || dx >= VIEW_COLUMNS ||
+      dy <= -VIEW_ROWS || dy >= VIEW_ROWS) {
+    /* Nothing loaded is still in view, so load the whole view. */
+    for (int c = column; c < column + VIEW_COLUMNS; c++) {
+      writeColumn(c, row);
+    }
+    loaded = true;
+  } else {
+    /*
+     *  Load the columns that came into view on the left or right, then the
+     *  rows that came into view at the top or bottom. Both use the new
+     *  position, so the corner where they meet is covered.
+     */
+    if (dx > 0) {
+      for (int c = loadedColumn + VIEW_COLUMNS; c < column + VIEW_COLUMNS;
+           c++) {
+        writeColumn(c, row);
+      }
+    } else {
+      for (int c = column; c < loadedColumn; c++) {
+        writeColumn(c, row);
+      }
+    }
+    if (dy > 0) {
+      for (int r = loadedRow + VIEW_ROWS; r < row + VIEW_ROWS; r++) {
+        writeRow(r, column);
+      }
+    } else {
+      for (int r = row; r < loadedRow; r++) {
+        writeRow(r, column);
+      }
+    }
+  }
+
+  loadedColumn = column;
+  loadedRow = row;
+
+  /* The hardware map repeats every 512 pixels, and so does the scroll. */
+  bgSetScroll(id, cameraX & (MAP_PIXELS - 1), cameraY & (MAP_PIXELS - 1));
+}
@@ -0,0 +1,119 @@
+/*
+ *  trig.cpp
+ *
+ *  Lookup table trigonometry to go with libnds' sinLerp() and cosLerp().
+ *
+ */
+
+#include "trig.h"
+#include <nds.h>
+
+/*
+ *  ATAN_LUT[i] is atan(i / 256) in eighths of a libnds degree, for i from 0
+ *  to 256. That covers the first eighth of the circle, from 0 to 45
+ *  degrees; symmetry gives us the rest. The extra 3 bits of precision keep
+ *  the table's own rounding from adding to the final rounding.
+ */
+static const int ATAN_LUT_BITS = 8;
+static const int ATAN_LUT_PRECISION = 3;
+static const u16 ATAN_LUT[(1 << ATAN_LUT_BITS) + 1] = {
+    0, 163, 326, 489, 652, 815, 978, 1141,
+    1303, 1466, 1629, 1792, 1954, 2117, 2279, 2442,
+    2604, 2767, 2929, 3091, 3253, 3415, 3577, 3738,
+    3900, 4061, 4223, 4384, 4545, 4706, 4867, 5028,
+    5188, 5349, 5509, 5669, 5829, 5989, 6148, 6308,
+    6467, 6626, 6784, 6943, 7101, 7260, 7418, 7575,
+    7733, 7890, 8047, 8204, 8361, 8517, 8673, 8829,
+    8985, 9140, 9296, 9450, 9605, 9759, 9914, 10067,
+    10221, 10374, 10527, 10680, 10832, 10984, 11136, 11287,
+    11439, 11590, 11740, 11890, 12040, 12190, 12339, 12488,
+    12637, 12785, 12933, 13081, 13228, 13375, 13522, 13668,
+    13814, 13959, 14105, 14249, 14394, 14538, 14682, 14825,
+    14968, 15111, 15253, 15395, 15537, 15678, 15819, 15960,
+    16100, 16239, 16379, 16518, 16656, 16794, 16932, 17069,
+    17206, 17343, 17479, 17615, 17750, 17885, 18020, 18154,
+    18288, 18421, 18554, 18687, 18819, 18951, 19083, 19213,
+    19344, 19474, 19604, 19733, 19862, 19991, 20119, 20247,
+    20374, 20501, 20627, 20753, 20879, 21004, 21129, 21254,
+    21378, 21501, 21624, 21747, 21870, 21992, 22113, 22234,
+    22355, 22475, 22595, 22714, 22834, 22952, 23070, 23188,
+    23306, 23423, 23539, 23655, 23771, 23886, 24001, 24116,
+    24230, 24344, 24457, 24570, 24682, 24795, 24906, 25017,
+    25128, 25239, 25349, 25459, 25568, 25677, 25785, 25893,
+    26001, 26108, 26215, 26321, 26427, 26533, 26638, 26743,
+    26848, 26952, 27056, 27159, 27262, 27364, 27467, 27568,
+    27670, 27771, 27871, 27972, 28072, 28171, 28270, 28369,
+    28467, 28565, 28663, 28760, 28857, 28953, 29050, 29145,
+    29241, 29336, 29430, 29525, 29619, 29712, 29805, 29898,
+    29991, 30083, 30175, 30266, 30357, 30448, 30538, 30628,
+    30718, 30807, 30896, 30985, 31073, 31161, 31248, 31336,
+    31423, 31509, 31595, 31681, 31767, 31852, 31937, 32022,
+    32106, 32190, 32273, 32357, 32439, 32522, 32604, 32686,
+    32768,
+};
+
+/*
+ *  The ratio we look up has 16 fractional bits: 8 to pick a table entry and
+ *  8 more to interpolate with. 12 would leave too few to interpolate with.
+ */
+static const int RATIO_BITS = 16;
+
+/*
+ *  atanLerp
+ *
+ *  Returns atan(t) in libnds degrees for t from 0 to 1 (with RATIO_BITS
+ *  fractional bits), interpolating between the two nearest table entries.
+ *
+ */
+static s32 atanLerp(s32 t) {
+  static const int FRACTION_BITS = RATIO_BITS - ATAN_LUT_BITS;
+  static const int SHIFT = FRACTION_BITS + ATAN_LUT_PRECISION;
+
+  int index = t >> FRACTION_BITS;
+  int fraction = t & ((1 << FRACTION_BITS) - 1);
+
+  /* Interpolate, then round away both the fraction and the extra bits. */
+  s32 low = ATAN_LUT[index] << FRACTION_BITS;
+  if (fraction != 0) {
+    low += (ATAN_LUT[index + 1] - ATAN_LUT[index]) * fraction;
+  }
+  return (low + (1 << (SHIFT - 1))) >> SHIFT;
+}
+
+/* The smaller of two lengths over the larger, rounded to nearest. */
+static s32 ratio(s32 smaller, s32 larger) {
+  return div64(((s64)smaller << RATIO_BITS) + larger / 2, larger);
+}
+
+s32 atan2Lerp(s32 y, s32 x) {
+  static const s32 QUARTER_CIRCLE = DEGREES_IN_CIRCLE / 4;
+  static const s32 HALF_CIRCLE = DEGREES_IN_CIRCLE / 2;
+
+  if (x == 0 && y == 0) {
+    return 0;
+  }
+
+  /*
+   *  Fold the vector into the first eighth of the circle, where the smaller
+   *  coordinate divided by the larger is between 0 and 1. div64() uses the
+   *  hardware divider.
+   */
+  s32 absX = x < 0 ? -x : x;
+  s32 absY = y < 0 ? -y : y;
+  s32 angle;
+  if (absY <= absX) {
+    angle = atanLerp(ratio(absY, absX));
+  } else {
+    angle = QUARTER_CIRCLE - atanLerp(ratio(absX, absY));
+  }
+
+  /* Then unfold it into the right quadrant. */
+  if (x < 0) {
+    angle = HALF_CIRCLE - angle;
+  }
+  if (y < 0) {
+    angle = -angle;
+  }
+
+  return angle & (DEGREES_IN_CIRCLE - 1);
+}
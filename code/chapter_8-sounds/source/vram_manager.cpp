@@ -0,0 +1,295 @@
+/*
+ *  vram_manager.cpp
+ *
+ *  Keeps track of what each of the nine VRAM banks is used for, and hands
+ *  out memory from them.
+ *
+ */
+
+#include "vram_manager.h"
+#include <nds.h>
+
+static const u32 KB = 1024;
+
+/* How big each bank is. */
+static const u32 bankSizes[VRAM_BANK_COUNT] = {
+    128 * KB, 128 * KB, 128 * KB, 128 * KB, 64 * KB,
+    16 * KB,  16 * KB,  32 * KB,  16 * KB,
+};
+
+/* Where the CPU sees each use's memory, for the uses it can see. */
+static const u32 useAddresses[VRAM_USE_COUNT] = {
+    0, 0x06000000, 0x06400000, 0x06200000, 0x06600000, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char *useNames[VRAM_USE_COUNT] = {
+    "LCD",
+    "main BG",
+    "main sprites",
+    "sub BG",
+    "sub sprites",
+    "textures",
+    "tex palettes",
+    "main BG ext pal",
+    "main spr ext pal",
+    "sub BG ext pal",
+    "sub spr ext pal",
+    "ARM7",
+};
+
+/*
+ *  VramRule
+ *
+ *  One use a bank can be put to. mst is what goes in the bank's control
+ *  register for it. The bank can go at offsets places, each stride bytes
+ *  apart from base, and provides bytes of the use's memory. Banks F and G
+ *  are split: odd offsets add one stride, and the next two go 64KB on.
+ */
+struct VramRule {
+    u8 bank;
+    u8 use;
+    u8 mst;
+    u8 offsets;
+    u32 base;
+    u32 stride;
+    u32 bytes;
+    bool split;
+};
+
+static const VramRule rules[] = {
+    {VRAM_BANK_A, VRAM_USE_MAIN_BG, 1, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_A, VRAM_USE_MAIN_SPRITE, 2, 2, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_A, VRAM_USE_TEXTURE, 3, 4, 0, 128 * KB, 128 * KB, false},
+
+    {VRAM_BANK_B, VRAM_USE_MAIN_BG, 1, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_B, VRAM_USE_MAIN_SPRITE, 2, 2, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_B, VRAM_USE_TEXTURE, 3, 4, 0, 128 * KB, 128 * KB, false},
+
+    {VRAM_BANK_C, VRAM_USE_MAIN_BG, 1, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_C, VRAM_USE_ARM7, 2, 2, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_C, VRAM_USE_TEXTURE, 3, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_C, VRAM_USE_SUB_BG, 4, 1, 0, 0, 128 * KB, false},
+
+    {VRAM_BANK_D, VRAM_USE_MAIN_BG, 1, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_D, VRAM_USE_ARM7, 2, 2, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_D, VRAM_USE_TEXTURE, 3, 4, 0, 128 * KB, 128 * KB, false},
+    {VRAM_BANK_D, VRAM_USE_SUB_SPRITE, 4, 1, 0, 0, 128 * KB, false},
+
+    {VRAM_BANK_E, VRAM_USE_MAIN_BG, 1, 1, 0, 0, 64 * KB, false},
+    {VRAM_BANK_E, VRAM_USE_MAIN_SPRITE, 2, 1, 0, 0, 64 * KB, false},
+    {VRAM_BANK_E, VRAM_USE_TEXTURE_PALETTE, 3, 1, 0, 0, 64 * KB, false},
+    /* Only the first 32KB of bank E holds extended palettes. */
+    {VRAM_BANK_E, VRAM_USE_MAIN_BG_EXT_PALETTE, 4, 1, 0, 0, 32 * KB, false},
+
+    {VRAM_BANK_F, VRAM_USE_MAIN_BG, 1, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_F, VRAM_USE_MAIN_SPRITE, 2, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_F, VRAM_USE_TEXTURE_PALETTE, 3, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_F, VRAM_USE_MAIN_BG_EXT_PALETTE, 4, 2, 0, 16 * KB, 16 * KB,
+     false},
+    {VRAM_BANK_F, VRAM_USE_MAIN_SPRITE_EXT_PALETTE, 5, 1, 0, 0, 8 * KB, false},
+
+    {VRAM_BANK_G, VRAM_USE_MAIN_BG, 1, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_G, VRAM_USE_MAIN_SPRITE, 2, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_G, VRAM_USE_TEXTURE_PALETTE, 3, 4, 0, 16 * KB, 16 * KB, true},
+    {VRAM_BANK_G, VRAM_USE_MAIN_BG_EXT_PALETTE, 4, 2, 0, 16 * KB, 16 * KB,
+     false},
+    {VRAM_BANK_G, VRAM_USE_MAIN_SPRITE_EXT_PALETTE, 5, 1, 0, 0, 8 * KB, false},
+
+    {VRAM_BANK_H, VRAM_USE_SUB_BG, 1, 1, 0, 0, 32 * KB, false},
+    {VRAM_BANK_H, VRAM_USE_SUB_BG_EXT_PALETTE, 2, 1, 0, 0, 32 * KB, false},
+
+    /* Bank I goes in sub background memory right after bank H. */
+    {VRAM_BANK_I, VRAM_USE_SUB_BG, 1, 1, 32 * KB, 0, 16 * KB, false},
+    {VRAM_BANK_I, VRAM_USE_SUB_SPRITE, 2, 1, 0, 0, 16 * KB, false},
+    {VRAM_BANK_I, VRAM_USE_SUB_SPRITE_EXT_PALETTE, 3, 1, 0, 0, 8 * KB, false},
+};
+
+static const int RULE_COUNT = sizeof(rules) / sizeof(rules[0]);
+
+/* Each bank's control register. */
+static vu8 *bankControl(VramBank bank) {
+  static vu8 *const registers[VRAM_BANK_COUNT] = {
+      &VRAM_A_CR, &VRAM_B_CR, &VRAM_C_CR, &VRAM_D_CR, &VRAM_E_CR,
+      &VRAM_F_CR, &VRAM_G_CR, &VRAM_H_CR, &VRAM_I_CR,
+  };
+  return registers[bank];
+}
+
+static const VramRule *findRule(VramBank bank, VramUse use) {
+  for (int i = 0; i < RULE_COUNT; i++) {
+    if (rules[i].bank == bank && rules[i].use == use) {
+      return &rules[i];
+    }
+  }
+  return NULL;
+}
+
+VramManager::VramManager() {
+  allocationCount = 0;
+  for (int bank = 0; bank < VRAM_BANK_COUNT; bank++) {
+    mappings[bank].use = VRAM_USE_LCD;
+    mappings[bank].start = 0;
+    mappings[bank].size = bankSizes[bank];
+    *bankControl((VramBank)bank) = VRAM_ENABLE;
+  }
+}
+
+/* Returns whether [start, end) of use's memory is all in mapped banks. */
+bool VramManager::isMapped(VramUse use, u32 start, u32 end) const {
+  u32 position = start;
+  while (position < end) {
+    bool found = false;
+    for (int bank = 0; bank < VRAM_BANK_COUNT; bank++) {
+      const Mapping *mapping = &mappings[bank];
+      if (mapping->use == use && mapping->start <= position &&
+          position < mapping->start + mapping->size) {
+        position = mapping->start + mapping->size;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Returns whether nothing is allocated in [start, end) of use's memory. */
+bool VramManager::isFree(VramUse use, u32 start, u32 end) const {
+  return usedBytes(use, start, end) == 0;
+}
+
+/* Returns how many bytes of [start, end) of use's memory are allocated. */
+u32 VramManager::usedBytes(VramUse use, u32 start, u32 end) const {
+  u32 used = 0;
+  for (int i = 0; i < allocationCount; i++) {
+    const Allocation *allocation = &allocations[i];
+    if (allocation->use != use) {
+      continue;
+    }
+    u32 from = allocation->start > start ? allocation->start : start;
+    u32 to = allocation->start + allocation->size;
+    to = to < end ? to : end;
+    if (from < to) {
+      used += to - from;
+    }
+  }
+  return used;
+}
+
+bool VramManager::map(VramBank bank, VramUse use, int offset) {
+  Mapping *mapping = &mappings[bank];
+  if (mapping->use != VRAM_USE_LCD &&
+      !isFree(mapping->use, mapping->start,
+              mapping->start + mapping->size)) {
+    return false;
+  }
+
+  u8 mst = 0;
+  u32 start = 0;
+  u32 size = bankSizes[bank];
+  if (use != VRAM_USE_LCD) {
+    const VramRule *rule = findRule(bank, use);
+    if (rule == NULL || offset < 0 || offset >= rule->offsets) {
+      return false;
+    }
+    mst = rule->mst;
+    size = rule->bytes;
+    if (rule->split) {
+      start = rule->base + (offset & 1) * rule->stride +
+              (offset >> 1) * 64 * KB;
+    } else {
+      start = rule->base + offset * rule->stride;
+    }
+
+    /* Two banks in the same place would show a mix of both. */
+    for (int other = 0; other < VRAM_BANK_COUNT; other++) {
+      const Mapping *otherMapping = &mappings[other];
+      if (other != bank && otherMapping->use == use &&
+          otherMapping->start < start + size &&
+          start < otherMapping->start + otherMapping->size) {
+        return false;
+      }
+    }
+  }
+
+  mapping->use = use;
+  mapping->start = start;
+  mapping->size = size;
+  *bankControl(bank) = VRAM_ENABLE | mst | (offset << 3);
+  return true;
+}
+
+s32 VramManager::allocate(VramUse use, u32 bytes, u32 alignment) {
+  if (use == VRAM_USE_LCD || bytes == 0 ||
+      allocationCount == MAX_ALLOCATIONS) {
+    return NO_SPACE;
+  }
+
+  /*
+   *  The lowest place that fits starts either where a bank starts or
+   *  where an allocation ends, rounded up to the alignment. Try them all
+   *  and take the lowest, so memory fills from the bottom.
+   */
+  s32 best = NO_SPACE;
+  for (int i = 0; i < VRAM_BANK_COUNT + allocationCount; i++) {
+    u32 candidate;
+    if (i < VRAM_BANK_COUNT) {
+      if (mappings[i].use != use) {
+        continue;
+      }
+      candidate = mappings[i].start;
+    } else {
+      const Allocation *allocation = &allocations[i - VRAM_BANK_COUNT];
+      if (allocation->use != use) {
+        continue;
+      }
+      candidate = allocation->start + allocation->size;
+    }
+    candidate = (candidate + alignment - 1) & ~(alignment - 1);
+
+    if ((best == NO_SPACE || candidate < (u32)best) &&
+        isMapped(use, candidate, candidate + bytes) &&
+        isFree(use, candidate, candidate + bytes)) {
+      best = candidate;
+    }
+  }
+
+  if (best != NO_SPACE) {
+    Allocation *allocation = &allocations[allocationCount++];
+    allocation->use = use;
+    allocation->start = best;
+    allocation->size = bytes;
+  }
+  return best;
+}
+
+void VramManager::free(VramUse use, s32 offset) {
+  for (int i = 0; i < allocationCount; i++) {
+    if (allocations[i].use == use && allocations[i].start == (u32)offset) {
+      allocations[i] = allocations[--allocationCount];
+      return;
+    }
+  }
+}
+
+void *VramManager::getAddress(VramUse use, s32 offset) {
+  if (useAddresses[use] == 0 || offset < 0) {
+    return NULL;
+  }
+  return (void *)(uintptr_t)(useAddresses[use] + offset);
+}
+
+void VramManager::getBankInfo(VramBank bank, VramBankInfo *info) const {
+  const Mapping *mapping = &mappings[bank];
+  info->use = mapping->use;
+  info->start = mapping->start;
+  info->size = mapping->size;
+  info->used = mapping->use == VRAM_USE_LCD
+                   ? 0
+                   : usedBytes(mapping->use, mapping->start,
+                               mapping->start + mapping->size);
+}
+
+const char *VramManager::getUseName(VramUse use) { return useNames[use]; }
@@ -0,0 +1,83 @@
+# SPDX-License-Identifier: CC0-1.0
+#
+# tcm_report.awk
+#
+# Sums up how much of ITCM and DTCM a build uses, from the linker map file,
+# and lists what each object file put there. Exits with an error when
+# either memory is over its budget, so a build script can catch it.
+#
+# Usage:
+#
+#     awk -v itcmLimit=32768 -v dtcmLimit=8192 -f tools/tcm_report.awk \
+#         build/c8_sounds.map
+#
+# ITCM code lives in .itcm sections, and DTCM data in .dtcm (initialized)
+# and .sbss (zeroed) sections.
+
+function hex(s,    i, v) {
+    s = tolower(s)
+    sub(/^0x/, "", s)
+    v = 0
+    for (i = 1; i <= length(s); i++) {
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    }
+    return v
+}
+
+function record(section, size, file,    mem) {
+    if (section ~ /^\.itcm/) {
+        mem = "ITCM"
+    } else {
+        mem = "DTCM"
+    }
+    if (size == 0) {
+        return
+    }
+
+    sub(/.*\//, "", file)
+    if (!((mem, file) in perFile)) {
+        fileCount[mem]++
+        fileOrder[mem, fileCount[mem]] = file
+    }
+    perFile[mem, file] += size
+    used[mem] += size
+}
+
+# Input sections are indented by one space. When the section name is long,
+# its address, size and file are on the following line instead.
+/^ \.(itcm|dtcm|sbss)/ {
+    if (NF >= 4) {
+        record($1, hex($3), $4)
+    } else if (NF == 1) {
+        pending = $1
+    }
+    next
+}
+
+pending != "" {
+    if (NF >= 3 && $1 ~ /^0x/) {
+        record(pending, hex($2), $3)
+    }
+    pending = ""
+}
+
+END {
+    limit["ITCM"] = itcmLimit
+    limit["DTCM"] = dtcmLimit
+    split("ITCM DTCM", memories, " ")
+
+    status = 0
+    for (m = 1; m <= 2; m++) {
+        mem = memories[m]
+        printf "%s: %d of %d bytes used\n", mem, used[mem], limit[mem]
+        for (i = 1; i <= fileCount[mem]; i++) {
+            file = fileOrder[mem, i]
+            printf "    %6d  %s\n", perFile[mem, file], file
+        }
+        if (used[mem] > limit[mem]) {
+            printf "%s is over budget by %d bytes\n", mem, used[mem] - limit[mem]
+            status = 1
+        }
+    }
+    exit status
+}